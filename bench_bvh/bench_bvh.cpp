@@ -0,0 +1,181 @@
+// bench_bvh: Bvh build, refit and queries against testing every object.
+//
+//	bench_bvh [--queries N] [--max OBJECTS]
+//
+// For 10k, 100k and 1M boxes scattered through a cube (up to --max), times
+// building the tree, refitting it after a hundredth and then a tenth of the
+// objects have moved, and three kinds of query, each done N times: a camera frustum from a random
+// place in the scene, a box a few units across, and the nearest box along a
+// random ray. The brute force versions test every box. Both must find the
+// same objects: the frustum and box queries the same set, the ray the same
+// distance.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../learnopengl/src/Bvh.h"
+
+#include "../bench_common/bench_common.h"
+
+static glm::vec3 randomPoint(float size)
+{
+	return glm::vec3(random01() - 0.5f, random01() - 0.5f, random01() - 0.5f) * size;
+}
+
+static bool boxInFrustum(const Aabb& box, const Frustum& frustum)
+{
+	for (const glm::vec4& p : frustum.Planes)
+	{
+		glm::vec3 n(p);
+		glm::vec3 farthest(n.x >= 0.0f ? box.Max.x : box.Min.x, n.y >= 0.0f ? box.Max.y : box.Min.y, n.z >= 0.0f ? box.Max.z : box.Min.z);
+		if (glm::dot(n, farthest) + p.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+static float rayBox(const Aabb& box, glm::vec3 origin, glm::vec3 inverse, float maxDistance)
+{
+	float tNear = 0.0f, tFar = maxDistance;
+	for (int a = 0; a < 3; ++a)
+	{
+		float t0 = (box.Min[a] - origin[a]) * inverse[a], t1 = (box.Max[a] - origin[a]) * inverse[a];
+		tNear = std::max(tNear, std::min(t0, t1));
+		tFar = std::min(tFar, std::max(t0, t1));
+	}
+	return tNear <= tFar ? tNear : -1.0f;
+}
+
+int main(int argc, char** argv)
+{
+	int queries = 200, maxObjects = 1000000;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--queries" && i + 1 < argc)
+			queries = std::max(1, atoi(argv[++i]));
+		else if (arg == "--max" && i + 1 < argc)
+			maxObjects = std::max(1, atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr, "usage: bench_bvh [--queries N] [--max OBJECTS]\n");
+			return 1;
+		}
+	}
+
+	printf("%-8s %9s %9s %9s %6s | %-7s %12s %12s %8s %6s\n", "objects", "build ms", "1% ms", "10% ms", "cost", "query", "bvh us", "brute us", "speedup", "same");
+	const int counts[] = { 10000, 100000, 1000000 };
+	for (int count : counts)
+	{
+		if (count > maxObjects)
+			break;
+		// objects one unit across on average, 20 per 10x10x10 block
+		float size = std::cbrt(count / 20.0f) * 10.0f;
+		std::vector<Aabb> boxes(count);
+		for (Aabb& box : boxes)
+		{
+			glm::vec3 center = randomPoint(size), half = glm::vec3(random01(), random01(), random01()) * 0.5f + 0.05f;
+			box.Min = center - half;
+			box.Max = center + half;
+		}
+
+		Bvh bvh;
+		Clock::time_point start = Clock::now();
+		bvh.build(boxes.data(), boxes.size());
+		double buildMs = msSince(start);
+
+		// refit after moving every 100th object, then every 10th
+		double refitMs[2];
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			for (int i = pass; i < count; i += pass ? 10 : 100)
+			{
+				glm::vec3 move = randomPoint(2.0f);
+				boxes[i].Min += move;
+				boxes[i].Max += move;
+				bvh.setBounds(i, boxes[i]);
+			}
+			start = Clock::now();
+			bvh.refit();
+			refitMs[pass] = msSince(start);
+		}
+		printf("%-8d %9.2f %9.2f %9.2f %6.1f |", count, buildMs, refitMs[0], refitMs[1], bvh.cost());
+
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+		for (int kind = 0; kind < 3; ++kind)
+		{
+			double bvhMs = 0.0, bruteMs = 0.0;
+			bool same = true;
+			std::vector<std::uint32_t> found, expected;
+			for (int q = 0; q < queries; ++q)
+			{
+				glm::vec3 origin = randomPoint(size), direction = glm::normalize(randomPoint(2.0f) + glm::vec3(0.0f, 0.0f, 0.001f));
+				found.clear();
+				expected.clear();
+				if (kind == 0)
+				{
+					Frustum frustum(projection * glm::lookAt(origin, origin + direction, glm::vec3(0.0f, 1.0f, 0.0f)));
+					start = Clock::now();
+					bvh.queryFrustum(frustum, [&](std::uint32_t object) { found.push_back(object); });
+					bvhMs += msSince(start);
+					start = Clock::now();
+					for (int i = 0; i < count; ++i)
+						if (boxInFrustum(boxes[i], frustum))
+							expected.push_back(i);
+					bruteMs += msSince(start);
+				}
+				else if (kind == 1)
+				{
+					Aabb query = { origin - 2.5f, origin + 2.5f };
+					start = Clock::now();
+					bvh.queryAabb(query, [&](std::uint32_t object) { found.push_back(object); });
+					bvhMs += msSince(start);
+					start = Clock::now();
+					for (int i = 0; i < count; ++i)
+						if (boxes[i].overlaps(query))
+							expected.push_back(i);
+					bruteMs += msSince(start);
+				}
+				else
+				{
+					RayHit hit;
+					start = Clock::now();
+					bool hitSomething = bvh.raycast(origin, direction, 1000.0f, hit);
+					bvhMs += msSince(start);
+
+					start = Clock::now();
+					glm::vec3 inverse = 1.0f / direction;
+					float best = 1000.0f;
+					bool bruteHit = false;
+					for (int i = 0; i < count; ++i)
+					{
+						float d = rayBox(boxes[i], origin, inverse, best);
+						if (d >= 0.0f)
+						{
+							best = d;
+							bruteHit = true;
+						}
+					}
+					bruteMs += msSince(start);
+					if (hitSomething != bruteHit || (hitSomething && std::fabs(hit.Distance - best) > 1e-4f * std::max(1.0f, best)))
+						same = false;
+				}
+				std::sort(found.begin(), found.end());
+				if (found != expected)
+					same = false;
+			}
+			const char* names[3] = { "frustum", "box", "ray" };
+			printf("%s %-7s %12.2f %12.2f %7.0fx %6s\n", kind == 0 ? "" : "                                              |",
+				names[kind], bvhMs * 1000.0 / queries, bruteMs * 1000.0 / queries, bruteMs / bvhMs, same ? "yes" : "NO");
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+// Helpers shared by the bench_* programs. Each bench is one source file, so
+// the state here is per program.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// Fixed-seed random numbers, so every run of a bench sees the same data
+static unsigned int seed = 1;
+
+inline float random01()
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) / 16777216.0f;
+}
+
+inline float random11()
+{
+	return random01() * 2.0f - 1.0f;
+}
+
+inline double msSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Best of 'repeat' runs, in nanoseconds per item
+template <typename F>
+inline double best(int repeat, std::size_t count, F f)
+{
+	double bestNs = 1e30;
+	for (int r = 0; r < repeat; ++r)
+	{
+		Clock::time_point start = Clock::now();
+		f();
+		double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count;
+		bestNs = std::min(bestNs, ns);
+	}
+	return bestNs;
+}
+
+// Largest difference between two results, relative where the values are big
+inline float maxDiff(const std::vector<float>& a, const std::vector<float>& b)
+{
+	float d = 0.0f;
+	for (std::size_t i = 0; i < a.size(); ++i)
+		d = std::max(d, std::fabs(a[i] - b[i]) / std::max(1.0f, std::fabs(a[i])));
+	return d;
+}
@@ -0,0 +1,207 @@
+// bench_ecs: per-frame scene work on heap objects against EntityWorld queries.
+//
+//	bench_ecs [--entities N] [--frames F] [--threads T]
+//
+// Each frame runs the three passes the render loop does: animate (turn the
+// objects that spin), cull (test bounding spheres against the view frustum)
+// and extract (gather the visible objects' transforms into a TransformBatch).
+// The object version is the usual first design: one heap-allocated struct per
+// object holding everything about it, a material included, in a vector of
+// pointers. The EntityWorld version stores the same state as components, with
+// a third of the entities spinning, and runs the passes as queries, once on
+// one thread and once over the chunks with a WorkerPool. Afterwards every
+// object's rotation and visibility is checked against its entity's.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../learnopengl/src/Entities.h"
+#include "../learnopengl/src/Frustum.h"
+#include "../learnopengl/src/Transforms.h"
+
+#include "../bench_common/bench_common.h"
+
+struct Transform
+{
+	glm::vec3 Position;
+	glm::quat Rotation;
+};
+
+struct Spin
+{
+	glm::vec3 Axis;
+	float Speed;
+};
+
+struct Renderable
+{
+	float Radius;
+	bool Visible;
+};
+
+struct Material
+{
+	glm::vec4 Diffuse, Specular;
+	float Shininess;
+	unsigned int Textures[4];
+};
+
+struct SceneObject
+{
+	Transform Placement;
+	Material Surface;
+	bool Spins;
+	Spin Turn;
+	Renderable Bounds;
+};
+
+static void objectFrame(std::vector<SceneObject*>& objects, float seconds, const Frustum& frustum, TransformBatch& batch)
+{
+	for (SceneObject* o : objects)
+		if (o->Spins)
+			o->Placement.Rotation = glm::normalize(glm::angleAxis(o->Turn.Speed * seconds, o->Turn.Axis) * o->Placement.Rotation);
+	for (SceneObject* o : objects)
+		o->Bounds.Visible = frustum.intersectsSphere(o->Placement.Position, o->Bounds.Radius);
+	batch.clear();
+	for (SceneObject* o : objects)
+		if (o->Bounds.Visible)
+			batch.add(o->Placement.Position, o->Placement.Rotation);
+}
+
+static void entityFrame(EntityWorld& world, WorkerPool* pool, float seconds, const Frustum& frustum, TransformBatch& batch)
+{
+	auto animate = [seconds](Transform& t, const Spin& s)
+	{
+		t.Rotation = glm::normalize(glm::angleAxis(s.Speed * seconds, s.Axis) * t.Rotation);
+	};
+	auto cull = [&frustum](const Transform& t, Renderable& r)
+	{
+		r.Visible = frustum.intersectsSphere(t.Position, r.Radius);
+	};
+	if (pool)
+	{
+		world.parallelEach<Transform, const Spin>(*pool, animate);
+		world.parallelEach<const Transform, Renderable>(*pool, cull);
+	}
+	else
+	{
+		world.each<Transform, const Spin>(animate);
+		world.each<const Transform, Renderable>(cull);
+	}
+	// appending to one batch doesn't split across threads
+	batch.clear();
+	world.each<const Transform, const Renderable>([&batch](const Transform& t, const Renderable& r)
+	{
+		if (r.Visible)
+			batch.add(t.Position, t.Rotation);
+	});
+}
+
+int main(int argc, char** argv)
+{
+	int count = 1000000, frames = 20;
+	unsigned threads = std::thread::hardware_concurrency();
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--entities" && hasValue)
+			count = std::max(1, atoi(argv[++i]));
+		else if (arg == "--frames" && hasValue)
+			frames = std::max(1, atoi(argv[++i]));
+		else if (arg == "--threads" && hasValue)
+			threads = std::max(1, atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr, "usage: bench_ecs [--entities N] [--frames F] [--threads T]\n");
+			return 1;
+		}
+	}
+
+	// Objects are allocated in a shuffled order, as they would be after a
+	// while of creating and destroying them
+	std::vector<std::unique_ptr<SceneObject> > storage;
+	for (int i = 0; i < count; ++i)
+		storage.push_back(std::unique_ptr<SceneObject>(new SceneObject()));
+	std::vector<SceneObject*> objects;
+	for (std::unique_ptr<SceneObject>& o : storage)
+		objects.push_back(o.get());
+	for (int i = count - 1; i > 0; --i)
+		std::swap(objects[i], objects[(int)(random01() * (i + 1)) % (i + 1)]);
+
+	EntityWorld world;
+	std::vector<Entity> entities;
+	for (SceneObject* o : objects)
+	{
+		o->Placement.Position = glm::vec3(random01() * 200.0f - 100.0f, random01() * 200.0f - 100.0f, random01() * 200.0f - 100.0f);
+		o->Placement.Rotation = glm::angleAxis(random01() * 6.2831853f, glm::normalize(glm::vec3(random01(), random01(), random01()) + glm::vec3(0.01f)));
+		o->Spins = random01() < 1.0f / 3.0f;
+		o->Turn.Axis = glm::normalize(glm::vec3(random01(), random01(), random01()) + glm::vec3(0.01f));
+		o->Turn.Speed = random01() * 3.0f;
+		o->Bounds.Radius = 0.87f;
+		o->Bounds.Visible = true;
+
+		Entity e = world.create(o->Placement, o->Surface, o->Bounds);
+		if (o->Spins)
+			world.add(e, o->Turn);
+		entities.push_back(e);
+	}
+
+	// A camera turning on the spot, so the visible set changes every frame
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+	const float seconds = 1.0f / 60.0f;
+	WorkerPool pool(threads);
+	TransformBatch batch;
+	double ms[3] = { 0.0, 0.0, 0.0 };
+	size_t visible[3] = { 0, 0, 0 };
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(std::sin(frame * 0.1f), 0.0f, -std::cos(frame * 0.1f)), glm::vec3(0.0f, 1.0f, 0.0f));
+		Frustum frustum(projection * view);
+		for (int kind = 0; kind < 3; ++kind)
+		{
+			Clock::time_point start = Clock::now();
+			if (kind == 0)
+				objectFrame(objects, seconds, frustum, batch);
+			else
+				entityFrame(world, kind == 2 ? &pool : NULL, seconds, frustum, batch);
+			ms[kind] += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			visible[kind] += batch.size();
+		}
+	}
+
+	// the entities were animated twice per frame, the objects once: compare
+	// the visibility, and the rotations after running the objects once more
+	for (int frame = 0; frame < frames; ++frame)
+		for (SceneObject* o : objects)
+			if (o->Spins)
+				o->Placement.Rotation = glm::normalize(glm::angleAxis(o->Turn.Speed * seconds, o->Turn.Axis) * o->Placement.Rotation);
+	float diff = 0.0f;
+	int mismatched = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		const Transform* t = world.get<Transform>(entities[i]);
+		glm::vec4 a(objects[i]->Placement.Rotation.x, objects[i]->Placement.Rotation.y, objects[i]->Placement.Rotation.z, objects[i]->Placement.Rotation.w);
+		glm::vec4 b(t->Rotation.x, t->Rotation.y, t->Rotation.z, t->Rotation.w);
+		diff = std::max(diff, glm::length(a - b));
+		if (objects[i]->Bounds.Visible != world.get<Renderable>(entities[i])->Visible)
+			++mismatched;
+	}
+
+	printf("%d entities, %d frames, %u threads, %.0f visible per frame\n", count, frames, pool.size(), (double)visible[0] / frames);
+	const char* names[3] = { "heap objects", "EntityWorld", "EntityWorld, parallel" };
+	for (int kind = 0; kind < 3; ++kind)
+		printf("%-22s %9.3f ms/frame %7.2f ns/entity\n", names[kind], ms[kind] / frames, ms[kind] * 1e6 / frames / count);
+	printf("visible counts %s, visibility mismatches %d, max rotation difference %.2g\n",
+		visible[0] == visible[1] && visible[1] == visible[2] ? "match" : "differ", mismatched, diff);
+	return 0;
+}
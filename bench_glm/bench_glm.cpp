@@ -0,0 +1,186 @@
+// bench_glm: glm's mat4 math against the Mat4Simd paths.
+//
+//	bench_glm [--count N] [--repeat R]
+//
+// Four batches of N each: mat4 * mat4 products, one mat4 times N vec4s,
+// inverses of model matrices (translate, rotate, scale) and cameras, where
+// glm::perspective and glm::lookAt build both matrices and the product is
+// taken by glm or by a path. Every path in Mat4Simd.h the compiler allows is
+// timed (the project sets /arch:AVX2, so all three), best of R runs, and the
+// largest difference from glm's results is printed for each. Build with
+// /p:GlmSimd=true to time glm with its aligned SIMD types as well.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../learnopengl/src/Mat4Simd.h"
+
+#include "../bench_common/bench_common.h"
+
+enum Op { OP_MULTIPLY, OP_TRANSFORM, OP_INVERSE, OP_CAMERA, OP_COUNT };
+
+struct Data
+{
+	std::vector<glm::mat4> A, B, Out;	// N each
+	std::vector<glm::vec4> Vectors, TransformedVectors;
+	std::vector<glm::vec3> Eyes;
+	glm::mat4 Matrix;
+};
+
+static glm::mat4 camera(const glm::vec3& eye)
+{
+	// named first: with aligned types, the two come back with different qualifiers
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	return projection * view;
+}
+
+static void runGlm(Op op, Data& d)
+{
+	size_t count = d.A.size();
+	switch (op)
+	{
+	case OP_MULTIPLY:
+		for (size_t i = 0; i < count; ++i)
+			d.Out[i] = d.A[i] * d.B[i];
+		break;
+	case OP_TRANSFORM:
+		for (size_t i = 0; i < count; ++i)
+			d.TransformedVectors[i] = d.Matrix * d.Vectors[i];
+		break;
+	case OP_INVERSE:
+		for (size_t i = 0; i < count; ++i)
+			d.Out[i] = glm::inverse(d.A[i]);
+		break;
+	default:
+		for (size_t i = 0; i < count; ++i)
+			d.Out[i] = camera(d.Eyes[i]);
+		break;
+	}
+}
+
+template <typename P>
+static void run(Op op, Data& d)
+{
+	size_t count = d.A.size();
+	switch (op)
+	{
+	case OP_MULTIPLY:
+		for (size_t i = 0; i < count; ++i)
+			P::multiply(&d.A[i][0][0], &d.B[i][0][0], &d.Out[i][0][0]);
+		break;
+	case OP_TRANSFORM:
+		P::transform(&d.Matrix[0][0], &d.Vectors[0][0], &d.TransformedVectors[0][0], count);
+		break;
+	case OP_INVERSE:
+		for (size_t i = 0; i < count; ++i)
+			P::inverse(&d.A[i][0][0], &d.Out[i][0][0]);
+		break;
+	default:
+		for (size_t i = 0; i < count; ++i)
+		{
+			glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+			glm::mat4 view = glm::lookAt(d.Eyes[i], glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+			P::multiply(&projection[0][0], &view[0][0], &d.Out[i][0][0]);
+		}
+		break;
+	}
+}
+
+// The results of the last run, as floats
+static std::vector<float> results(Op op, const Data& d)
+{
+	const float* first = op == OP_TRANSFORM ? &d.TransformedVectors[0][0] : &d.Out[0][0][0];
+	size_t floats = op == OP_TRANSFORM ? d.TransformedVectors.size() * 4 : d.Out.size() * 16;
+	return std::vector<float>(first, first + floats);
+}
+
+int main(int argc, char** argv)
+{
+	int count = 100000, repeat = 5;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--count" && hasValue)
+			count = std::max(1, atoi(argv[++i]));
+		else if (arg == "--repeat" && hasValue)
+			repeat = std::max(1, atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr, "usage: bench_glm [--count N] [--repeat R]\n");
+			return 1;
+		}
+	}
+
+	Data d;
+	d.A.resize(count);
+	d.B.resize(count);
+	d.Out.resize(count);
+	d.Vectors.resize(count);
+	d.TransformedVectors.resize(count);
+	d.Eyes.resize(count);
+	for (int i = 0; i < count; ++i)
+	{
+		glm::vec3 position(random11(), random11(), random11());
+		glm::vec3 axis = glm::normalize(glm::vec3(random11(), random11(), random11()) + glm::vec3(0.0f, 0.0f, 0.01f));
+		glm::vec3 scale = glm::vec3(random11(), random11(), random11()) * 0.5f + 1.0f;
+		d.A[i] = glm::scale(glm::rotate(glm::translate(glm::mat4(1.0f), position * 50.0f), random11() * 3.14159f, axis), scale);
+		for (int k = 0; k < 16; ++k)
+			d.B[i][k / 4][k % 4] = random11();
+		d.Vectors[i] = glm::vec4(position, 1.0f);
+		d.Eyes[i] = position * 20.0f + glm::vec3(0.0f, 0.0f, 0.01f);
+	}
+	d.Matrix = d.A[0];
+
+#if defined(GLM_FORCE_ALIGNED)
+	printf("glm: aligned SIMD types\n");
+#else
+	printf("glm: default types\n");
+#endif
+	std::string paths = "scalar";
+#if defined(MAT4_SSE)
+	paths += ", SSE";
+#endif
+#if defined(MAT4_FMA)
+	paths += ", AVX with FMA";
+#elif defined(MAT4_AVX)
+	paths += ", AVX";
+#endif
+	printf("Mat4Simd paths: %s\n", paths.c_str());
+	printf("%-9s %8s | %8s %9s | %8s %9s | %8s %9s   (ns per item | max diff)\n", "op", "glm", "scalar", "", "sse", "", "avx", "");
+
+	const char* names[OP_COUNT] = { "mat*mat", "mat*vec", "inverse", "camera" };
+	for (int op = 0; op < OP_COUNT; ++op)
+	{
+		Op o = (Op)op;
+		double glmNs = best(repeat, count, [&]() { runGlm(o, d); });
+		std::vector<float> expected = results(o, d);
+		printf("%-9s %8.2f", names[op], glmNs);
+
+		double ns = best(repeat, count, [&]() { run<Mat4Scalar>(o, d); });
+		printf(" | %8.2f %9.2g", ns, maxDiff(expected, results(o, d)));
+#if defined(MAT4_SSE)
+		ns = best(repeat, count, [&]() { run<Mat4Sse>(o, d); });
+		printf(" | %8.2f %9.2g", ns, maxDiff(expected, results(o, d)));
+#else
+		printf(" | %8s %9s", "-", "");
+#endif
+#if defined(MAT4_AVX)
+		ns = best(repeat, count, [&]() { run<Mat4Avx>(o, d); });
+		printf(" | %8.2f %9.2g", ns, maxDiff(expected, results(o, d)));
+#else
+		printf(" | %8s %9s", "-", "");
+#endif
+		printf("\n");
+	}
+	return 0;
+}
@@ -0,0 +1,1131 @@
+// bench_image: decode speed of every format path in stb_image.
+//
+//	bench_image [options] [directory...]
+//
+//	--size WxH       size of the generated images (default 1024x768)
+//	--threads 1,4    values for stbi_set_jpeg_threads (default 1 and the CPU count)
+//	--min-time S     seconds to keep decoding each format (default 0.5)
+//	--label TEXT     stored in the JSON, e.g. the commit being measured
+//	--json FILE      also write the results as JSON; "-" for stdout, which
+//	                 moves the table to stderr
+//
+// Every format this file can encode (8-bit, 16-bit and interlaced PNG, BMP,
+// TGA, PSD, GIF, HDR, PNM) is generated in memory, so the numbers don't depend
+// on what's on disk. "zlib" is the inflate on its own, run over the IDAT data
+// of the 8-bit PNGs. Images in the given directories (learnopengl/textures by
+// default) are added to the format they're detected as; that's where the
+// baseline and progressive JPEGs come from; a kind with no readable file is
+// printed as skipped. Decoding is from memory, so file I/O isn't measured.
+//
+// MB/s counts the encoded input and Mpixel/s the decoded pixels (for zlib, the
+// inflated megabytes). Peak heap is
+// the most stb_image had allocated at once while decoding that format. Peak RSS
+// is the process high-water mark; it is reset before each format on Linux, but
+// can only grow on other systems. Only the JPEG decoder uses threads, so the
+// other formats are run with one thread only.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <dirent.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+// Count what stb_image allocates. STBI_FREE doesn't pass the size, so each
+// block carries it in a 16-byte header, which also keeps the alignment.
+static std::atomic<size_t> heapNow(0), heapPeak(0);
+
+static void heapAdd(size_t size)
+{
+	size_t now = heapNow += size;
+	size_t peak = heapPeak;
+	while (now > peak && !heapPeak.compare_exchange_weak(peak, now))
+		;
+}
+
+static void* benchMalloc(size_t size)
+{
+	size_t* p = (size_t*)malloc(size + 16);
+	if (!p)
+		return NULL;
+	p[0] = size;
+	heapAdd(size);
+	return (char*)p + 16;
+}
+
+static void benchFree(void* ptr)
+{
+	if (!ptr)
+		return;
+	size_t* p = (size_t*)((char*)ptr - 16);
+	heapNow -= p[0];
+	free(p);
+}
+
+static void* benchRealloc(void* ptr, size_t size)
+{
+	if (!ptr)
+		return benchMalloc(size);
+	size_t* p = (size_t*)((char*)ptr - 16);
+	size_t old = p[0];
+	size_t* q = (size_t*)realloc(p, size + 16);
+	if (!q)
+		return NULL;
+	q[0] = size;
+	heapNow -= old;
+	heapAdd(size);
+	return (char*)q + 16;
+}
+
+#define STBI_MALLOC(size) benchMalloc(size)
+#define STBI_REALLOC(p, size) benchRealloc(p, size)
+#define STBI_FREE(p) benchFree(p)
+#define STBI_THREADS
+#define STB_IMAGE_IMPLEMENTATION
+#include "../learnopengl/src/stb_image.h"
+
+typedef std::vector<unsigned char> Bytes;
+
+/////////////////////
+// PROCESS MEMORY  //
+/////////////////////
+
+#ifdef _WIN32
+static long peakRssKb()
+{
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0;
+	return (long)(pmc.PeakWorkingSetSize / 1024);
+}
+
+static void resetPeakRss()
+{
+	// Windows keeps the peak for the life of the process
+}
+
+static int cpuCount()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+}
+#else
+static long peakRssKb()
+{
+	// VmHWM can be reset (see below), getrusage's maximum can't
+	long kb = 0;
+	FILE* f = fopen("/proc/self/status", "r");
+	if (f)
+	{
+		char line[256];
+		while (fgets(line, sizeof(line), f))
+			if (sscanf(line, "VmHWM: %ld", &kb) == 1)
+				break;
+		fclose(f);
+	}
+	if (kb == 0)
+	{
+		struct rusage ru;
+		getrusage(RUSAGE_SELF, &ru);
+		kb = ru.ru_maxrss;
+#ifdef __APPLE__
+		kb /= 1024; // bytes there
+#endif
+	}
+	return kb;
+}
+
+static void resetPeakRss()
+{
+	FILE* f = fopen("/proc/self/clear_refs", "w");
+	if (f)
+	{
+		fputs("5", f);
+		fclose(f);
+	}
+}
+
+static int cpuCount()
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+#endif
+
+/////////////////////
+// SYNTHETIC IMAGE //
+/////////////////////
+
+// Smooth gradients and rings with some noise and a few hard edges, roughly
+// as compressible as a photo or a painted texture.
+static void makeImage(int width, int height, std::vector<unsigned short>& rgba16)
+{
+	rgba16.resize((size_t)width * height * 4);
+	unsigned int seed = 12345;
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+		{
+			float fx = (float)x / width, fy = (float)y / height;
+			float dx = fx - 0.5f, dy = fy - 0.4f;
+			float ring = std::sin(std::sqrt(dx * dx + dy * dy) * 60.0f);
+			bool stripe = ((x / 37 + y / 53) & 3) == 0;
+			for (int c = 0; c < 4; ++c)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				float noise = ((seed >> 16) & 1023) / 1023.0f - 0.5f;
+				float v;
+				if (c == 3)
+					v = 0.6f + 0.4f * fx;
+				else
+					v = 0.5f + 0.3f * std::sin(fx * (4.0f + c) + fy * 3.0f) + 0.15f * ring + 0.03f * noise + (stripe ? 0.1f : 0.0f);
+				v = std::min(1.0f, std::max(0.0f, v));
+				rgba16[((size_t)y * width + x) * 4 + c] = (unsigned short)(v * 65535.0f + 0.5f);
+			}
+		}
+}
+
+static unsigned char to8(unsigned short v)
+{
+	return (unsigned char)(v >> 8);
+}
+
+static void put16le(Bytes& b, unsigned v) { b.push_back(v & 255); b.push_back((v >> 8) & 255); }
+static void put32le(Bytes& b, unsigned v) { put16le(b, v & 0xffff); put16le(b, v >> 16); }
+static void put16be(Bytes& b, unsigned v) { b.push_back((v >> 8) & 255); b.push_back(v & 255); }
+static void put32be(Bytes& b, unsigned v) { put16be(b, v >> 16); put16be(b, v & 0xffff); }
+static void putString(Bytes& b, const char* s) { b.insert(b.end(), s, s + strlen(s)); }
+
+//////////////
+// ENCODERS //
+//////////////
+
+static Bytes encodeBmp(int w, int h, const std::vector<unsigned short>& img)
+{
+	Bytes b;
+	int row = (w * 3 + 3) & ~3;
+	putString(b, "BM");
+	put32le(b, 54 + row * h);
+	put32le(b, 0);
+	put32le(b, 54);
+	put32le(b, 40);
+	put32le(b, w);
+	put32le(b, h);
+	put16le(b, 1);
+	put16le(b, 24);
+	put32le(b, 0);
+	put32le(b, row * h);
+	put32le(b, 2835);
+	put32le(b, 2835);
+	put32le(b, 0);
+	put32le(b, 0);
+	for (int y = h - 1; y >= 0; --y)
+	{
+		const unsigned short* p = &img[(size_t)y * w * 4];
+		for (int x = 0; x < w; ++x, p += 4)
+		{
+			b.push_back(to8(p[2]));
+			b.push_back(to8(p[1]));
+			b.push_back(to8(p[0]));
+		}
+		for (int i = w * 3; i < row; ++i)
+			b.push_back(0);
+	}
+	return b;
+}
+
+static Bytes encodeTga(int w, int h, const std::vector<unsigned short>& img, bool rle)
+{
+	Bytes b;
+	b.push_back(0);
+	b.push_back(0);
+	b.push_back(rle ? 10 : 2);
+	for (int i = 0; i < 5; ++i)
+		b.push_back(0);
+	put16le(b, 0);
+	put16le(b, 0);
+	put16le(b, w);
+	put16le(b, h);
+	b.push_back(24);
+	b.push_back(0x20); // top-left origin
+	for (int y = 0; y < h; ++y)
+	{
+		std::vector<unsigned int> row(w);
+		for (int x = 0; x < w; ++x)
+		{
+			const unsigned short* p = &img[((size_t)y * w + x) * 4];
+			row[x] = to8(p[2]) | to8(p[1]) << 8 | to8(p[0]) << 16;
+		}
+		int x = 0;
+		while (x < w)
+		{
+			int run = 1;
+			while (rle && x + run < w && run < 128 && row[x + run] == row[x])
+				++run;
+			int n = run;
+			if (rle && run >= 2)
+				b.push_back(0x80 | (run - 1));
+			else
+			{
+				// raw packet up to the next run
+				n = 1;
+				while (x + n < w && n < 128 && !(rle && x + n + 1 < w && row[x + n] == row[x + n + 1]))
+					++n;
+				if (rle)
+					b.push_back(n - 1);
+			}
+			for (int i = 0; i < (rle && run >= 2 ? 1 : n); ++i)
+			{
+				b.push_back(row[x + i] & 255);
+				b.push_back((row[x + i] >> 8) & 255);
+				b.push_back(row[x + i] >> 16);
+			}
+			x += n;
+		}
+	}
+	return b;
+}
+
+static Bytes encodePnm(int w, int h, const std::vector<unsigned short>& img)
+{
+	Bytes b;
+	char header[64];
+	sprintf(header, "P6\n%d %d\n255\n", w, h);
+	putString(b, header);
+	for (size_t i = 0; i < (size_t)w * h; ++i)
+		for (int c = 0; c < 3; ++c)
+			b.push_back(to8(img[i * 4 + c]));
+	return b;
+}
+
+static Bytes encodeHdr(int w, int h, const std::vector<unsigned short>& img)
+{
+	Bytes b;
+	char header[128];
+	sprintf(header, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", h, w);
+	putString(b, header);
+	std::vector<unsigned char> rgbe(w * 4);
+	for (int y = 0; y < h; ++y)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			const unsigned short* p = &img[((size_t)y * w + x) * 4];
+			// spread the values over a few stops, as HDR data would be
+			float scale = 4.0f * (1.0f + (float)x / w);
+			float r = p[0] / 65535.0f * scale, g = p[1] / 65535.0f * scale, bl = p[2] / 65535.0f * scale;
+			float m = std::max(r, std::max(g, bl));
+			unsigned char* e = &rgbe[x * 4];
+			if (m < 1e-32f)
+				e[0] = e[1] = e[2] = e[3] = 0;
+			else
+			{
+				int exponent;
+				float f = std::frexp(m, &exponent) * 256.0f / m;
+				e[0] = (unsigned char)(r * f);
+				e[1] = (unsigned char)(g * f);
+				e[2] = (unsigned char)(bl * f);
+				e[3] = (unsigned char)(exponent + 128);
+			}
+		}
+		// new-style RLE scanline: each component separately, runs of 3+
+		// as run packets and the rest as literal packets
+		b.push_back(2);
+		b.push_back(2);
+		b.push_back(w >> 8);
+		b.push_back(w & 255);
+		for (int c = 0; c < 4; ++c)
+		{
+			int x = 0;
+			while (x < w)
+			{
+				int run = 1;
+				while (x + run < w && run < 127 && rgbe[(x + run) * 4 + c] == rgbe[x * 4 + c])
+					++run;
+				if (run >= 3)
+				{
+					b.push_back(128 + run);
+					b.push_back(rgbe[x * 4 + c]);
+					x += run;
+					continue;
+				}
+				int n = 1;
+				while (x + n < w && n < 128 && !(x + n + 2 < w && rgbe[(x + n) * 4 + c] == rgbe[(x + n + 1) * 4 + c] && rgbe[(x + n) * 4 + c] == rgbe[(x + n + 2) * 4 + c]))
+					++n;
+				b.push_back(n);
+				for (int i = 0; i < n; ++i)
+					b.push_back(rgbe[(x + i) * 4 + c]);
+				x += n;
+			}
+		}
+	}
+	return b;
+}
+
+// PackBits, as PSD uses it
+static void packBits(Bytes& b, const unsigned char* p, int n)
+{
+	int x = 0;
+	while (x < n)
+	{
+		int run = 1;
+		while (x + run < n && run < 128 && p[x + run] == p[x])
+			++run;
+		if (run >= 2)
+		{
+			b.push_back((unsigned char)(257 - run));
+			b.push_back(p[x]);
+			x += run;
+			continue;
+		}
+		int lit = 1;
+		while (x + lit < n && lit < 128 && !(x + lit + 1 < n && p[x + lit] == p[x + lit + 1]))
+			++lit;
+		b.push_back(lit - 1);
+		b.insert(b.end(), p + x, p + x + lit);
+		x += lit;
+	}
+}
+
+static Bytes encodePsd(int w, int h, const std::vector<unsigned short>& img, bool rle)
+{
+	Bytes b;
+	putString(b, "8BPS");
+	put16be(b, 1);
+	for (int i = 0; i < 6; ++i)
+		b.push_back(0);
+	put16be(b, 4); // RGBA
+	put32be(b, h);
+	put32be(b, w);
+	put16be(b, 8);
+	put16be(b, 3); // RGB color mode
+	put32be(b, 0); // color mode data
+	put32be(b, 0); // image resources
+	put32be(b, 0); // layers and masks
+	put16be(b, rle ? 1 : 0);
+	std::vector<unsigned char> row(w);
+	if (!rle)
+	{
+		for (int c = 0; c < 4; ++c)
+			for (size_t i = 0; i < (size_t)w * h; ++i)
+				b.push_back(to8(img[i * 4 + c]));
+		return b;
+	}
+	// a table of compressed row sizes, then the rows
+	size_t table = b.size();
+	b.resize(b.size() + 4 * h * 2);
+	for (int c = 0; c < 4; ++c)
+		for (int y = 0; y < h; ++y)
+		{
+			for (int x = 0; x < w; ++x)
+				row[x] = to8(img[((size_t)y * w + x) * 4 + c]);
+			size_t before = b.size();
+			packBits(b, row.data(), w);
+			size_t len = b.size() - before;
+			b[table + (c * h + y) * 2] = (unsigned char)(len >> 8);
+			b[table + (c * h + y) * 2 + 1] = (unsigned char)(len & 255);
+		}
+	return b;
+}
+
+static Bytes encodeGif(int w, int h, const std::vector<unsigned short>& img)
+{
+	Bytes b;
+	putString(b, "GIF89a");
+	put16le(b, w);
+	put16le(b, h);
+	b.push_back(0xF7); // 256-entry global color table
+	b.push_back(0);
+	b.push_back(0);
+	// 3-3-2 palette
+	for (int i = 0; i < 256; ++i)
+	{
+		b.push_back((unsigned char)((i >> 5) * 255 / 7));
+		b.push_back((unsigned char)(((i >> 2) & 7) * 255 / 7));
+		b.push_back((unsigned char)((i & 3) * 255 / 3));
+	}
+	b.push_back(0x2C);
+	put16le(b, 0);
+	put16le(b, 0);
+	put16le(b, w);
+	put16le(b, h);
+	b.push_back(0);
+	b.push_back(8); // LZW minimum code size
+
+	Bytes data;
+	unsigned int bits = 0;
+	int nbits = 0, codeSize = 9, next = 258;
+	std::vector<short> table(4096 * 256, -1);
+	auto emit = [&](int code)
+	{
+		bits |= code << nbits;
+		nbits += codeSize;
+		while (nbits >= 8)
+		{
+			data.push_back(bits & 255);
+			bits >>= 8;
+			nbits -= 8;
+		}
+		// the decoder adds its table entries one code later than we do,
+		// so the code size goes up after the code that fills it
+		if (next >= (1 << codeSize) && codeSize < 12)
+			++codeSize;
+	};
+	auto pixel = [&](size_t i)
+	{
+		return (to8(img[i * 4]) & 0xE0) | ((to8(img[i * 4 + 1]) >> 3) & 0x1C) | (to8(img[i * 4 + 2]) >> 6);
+	};
+
+	emit(256);
+	int prefix = pixel(0);
+	for (size_t i = 1; i < (size_t)w * h; ++i)
+	{
+		int k = pixel(i);
+		short entry = table[prefix * 256 + k];
+		if (entry >= 0)
+		{
+			prefix = entry;
+			continue;
+		}
+		emit(prefix);
+		if (next < 4096)
+			table[prefix * 256 + k] = (short)next++;
+		else
+		{
+			emit(256);
+			std::fill(table.begin(), table.end(), -1);
+			codeSize = 9;
+			next = 258;
+		}
+		prefix = k;
+	}
+	emit(prefix);
+	emit(257);
+	if (nbits > 0)
+		data.push_back(bits & 255);
+
+	for (size_t i = 0; i < data.size(); i += 255)
+	{
+		size_t n = std::min((size_t)255, data.size() - i);
+		b.push_back((unsigned char)n);
+		b.insert(b.end(), data.begin() + i, data.begin() + i + n);
+	}
+	b.push_back(0);
+	b.push_back(0x3B);
+	return b;
+}
+
+// zlib stream with a single fixed-Huffman deflate block and a simple
+// one-candidate LZ77 match finder; good enough to exercise the inflater's
+// length/distance paths the way real PNGs do.
+class Deflater
+{
+public:
+	Bytes out;
+
+	void compress(const Bytes& in)
+	{
+		out.push_back(0x78);
+		out.push_back(0x01);
+		putBits(1, 1); // final block
+		putBits(1, 2); // fixed Huffman
+		std::vector<int> head(1 << 15, -1);
+		size_t i = 0;
+		while (i < in.size())
+		{
+			int len = 0, dist = 0;
+			if (i + 3 <= in.size())
+			{
+				unsigned h = ((in[i] << 10) ^ (in[i + 1] << 5) ^ in[i + 2]) & 0x7fff;
+				int cand = head[h];
+				head[h] = (int)i;
+				if (cand >= 0 && i - cand <= 32768)
+				{
+					size_t max = std::min((size_t)258, in.size() - i);
+					while ((size_t)len < max && in[cand + len] == in[i + len])
+						++len;
+					dist = (int)(i - cand);
+				}
+			}
+			if (len >= 3)
+			{
+				putLength(len);
+				putDistance(dist);
+				i += len;
+			}
+			else
+			{
+				putLiteral(in[i]);
+				++i;
+			}
+		}
+		putLiteral(256);
+		if (nbits > 0)
+			out.push_back(bits & 255);
+		unsigned a = 1, b = 0;
+		for (unsigned char c : in)
+		{
+			a = (a + c) % 65521;
+			b = (b + a) % 65521;
+		}
+		put32be(out, b << 16 | a);
+	}
+
+private:
+	unsigned int bits = 0;
+	int nbits = 0;
+
+	void putBits(unsigned v, int n)
+	{
+		bits |= v << nbits;
+		nbits += n;
+		while (nbits >= 8)
+		{
+			out.push_back(bits & 255);
+			bits >>= 8;
+			nbits -= 8;
+		}
+	}
+
+	// Huffman codes go out most significant bit first
+	void putCode(unsigned code, int n)
+	{
+		unsigned r = 0;
+		for (int i = 0; i < n; ++i)
+			r |= ((code >> i) & 1) << (n - 1 - i);
+		putBits(r, n);
+	}
+
+	void putLiteral(int v)
+	{
+		if (v < 144)      putCode(0x30 + v, 8);
+		else if (v < 256) putCode(0x190 + v - 144, 9);
+		else if (v < 280) putCode(v - 256, 7);
+		else              putCode(0xC0 + v - 280, 8);
+	}
+
+	void putLength(int len)
+	{
+		static const int base[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+		static const int extra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+		int i = 28;
+		while (base[i] > len)
+			--i;
+		putLiteral(257 + i);
+		putBits(len - base[i], extra[i]);
+	}
+
+	void putDistance(int dist)
+	{
+		static const int base[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+		int i = 29;
+		while (base[i] > dist)
+			--i;
+		putCode(i, 5);
+		putBits(dist - base[i], i < 4 ? 0 : i / 2 - 1);
+	}
+};
+
+static unsigned crc32(const unsigned char* p, size_t n, unsigned crc = 0)
+{
+	static unsigned table[256];
+	if (!table[1])
+		for (unsigned i = 0; i < 256; ++i)
+		{
+			unsigned c = i;
+			for (int k = 0; k < 8; ++k)
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+	crc = ~crc;
+	for (size_t i = 0; i < n; ++i)
+		crc = table[(crc ^ p[i]) & 255] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void pngChunk(Bytes& b, const char* type, const Bytes& data)
+{
+	put32be(b, (unsigned)data.size());
+	size_t start = b.size();
+	putString(b, type);
+	b.insert(b.end(), data.begin(), data.end());
+	put32be(b, crc32(&b[start], b.size() - start));
+}
+
+static int paeth(int a, int b, int c)
+{
+	int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// filter one image (or interlace pass) of packed rows into 'out', picking
+// each row's filter like libpng does: smallest sum of absolute differences
+static void pngFilter(Bytes& out, const Bytes& rows, int rowBytes, int height, int bpp)
+{
+	Bytes zero(rowBytes, 0), best, cand(rowBytes);
+	for (int y = 0; y < height; ++y)
+	{
+		const unsigned char* cur = &rows[(size_t)y * rowBytes];
+		const unsigned char* up = y ? &rows[(size_t)(y - 1) * rowBytes] : zero.data();
+		long bestSum = -1;
+		int bestType = 0;
+		for (int type = 0; type < 5; ++type)
+		{
+			long sum = 0;
+			for (int i = 0; i < rowBytes; ++i)
+			{
+				int a = i >= bpp ? cur[i - bpp] : 0, b = up[i], c = i >= bpp ? up[i - bpp] : 0;
+				int pred = type == 0 ? 0 : type == 1 ? a : type == 2 ? b : type == 3 ? (a + b) / 2 : paeth(a, b, c);
+				cand[i] = (unsigned char)(cur[i] - pred);
+				sum += cand[i] < 128 ? cand[i] : 256 - cand[i];
+			}
+			if (bestSum < 0 || sum < bestSum)
+			{
+				bestSum = sum;
+				bestType = type;
+				best = cand;
+			}
+		}
+		out.push_back((unsigned char)bestType);
+		out.insert(out.end(), best.begin(), best.end());
+	}
+}
+
+static Bytes encodePng(int w, int h, const std::vector<unsigned short>& img, int depth, int channels, bool interlaced)
+{
+	int bpp = channels * depth / 8;
+	auto packRows = [&](int x0, int dx, int y0, int dy, int& pw, int& ph)
+	{
+		pw = (w - x0 + dx - 1) / dx;
+		ph = (h - y0 + dy - 1) / dy;
+		Bytes rows;
+		if (pw <= 0 || ph <= 0)
+			return rows;
+		for (int y = y0; y < h; y += dy)
+			for (int x = x0; x < w; x += dx)
+				for (int c = 0; c < channels; ++c)
+				{
+					unsigned short v = img[((size_t)y * w + x) * 4 + c];
+					if (depth == 16)
+						rows.push_back(v >> 8);
+					rows.push_back(depth == 16 ? v & 255 : to8(v));
+				}
+		return rows;
+	};
+
+	Bytes raw;
+	if (!interlaced)
+	{
+		int pw, ph;
+		Bytes rows = packRows(0, 1, 0, 1, pw, ph);
+		pngFilter(raw, rows, pw * bpp, ph, bpp);
+	}
+	else
+	{
+		static const int x0[7] = { 0,4,0,2,0,1,0 }, y0[7] = { 0,0,4,0,2,0,1 };
+		static const int dx[7] = { 8,8,4,4,2,2,1 }, dy[7] = { 8,8,8,4,4,2,2 };
+		for (int pass = 0; pass < 7; ++pass)
+		{
+			int pw, ph;
+			Bytes rows = packRows(x0[pass], dx[pass], y0[pass], dy[pass], pw, ph);
+			if (!rows.empty())
+				pngFilter(raw, rows, pw * bpp, ph, bpp);
+		}
+	}
+
+	Bytes b;
+	const unsigned char signature[8] = { 137,80,78,71,13,10,26,10 };
+	b.insert(b.end(), signature, signature + 8);
+	Bytes ihdr;
+	put32be(ihdr, w);
+	put32be(ihdr, h);
+	ihdr.push_back((unsigned char)depth);
+	ihdr.push_back(channels == 4 ? 6 : 2);
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	ihdr.push_back(interlaced ? 1 : 0);
+	pngChunk(b, "IHDR", ihdr);
+	Deflater z;
+	z.compress(raw);
+	pngChunk(b, "IDAT", z.out);
+	pngChunk(b, "IEND", Bytes());
+	return b;
+}
+
+// The IDAT chunks of a PNG joined up, which is the zlib stream stb_image
+// inflates; empty if there are none
+static Bytes pngIdat(const Bytes& png)
+{
+	Bytes idat;
+	for (size_t at = 8; at + 12 <= png.size();)
+	{
+		size_t len = (size_t)png[at] << 24 | png[at + 1] << 16 | png[at + 2] << 8 | png[at + 3];
+		if (len > png.size() - at - 12)
+			break;
+		if (!memcmp(&png[at + 4], "IDAT", 4))
+			idat.insert(idat.end(), png.begin() + at + 8, png.begin() + at + 8 + len);
+		at += len + 12;
+	}
+	return idat;
+}
+
+////////////
+// CORPUS //
+////////////
+
+struct Sample
+{
+	std::string name;
+	Bytes data;
+};
+
+struct Format
+{
+	std::string name;
+	std::vector<Sample> samples;
+};
+
+static Format& formatNamed(std::vector<Format>& formats, const std::string& name)
+{
+	for (Format& f : formats)
+		if (f.name == name)
+			return f;
+	formats.push_back(Format());
+	formats.back().name = name;
+	return formats.back();
+}
+
+// Which of our format names a file counts as, or "" to skip it
+static std::string classify(const std::string& path, const Bytes& d)
+{
+	size_t n = d.size();
+	if (n > 4 && d[0] == 0xFF && d[1] == 0xD8)
+	{
+		// look for the frame header: SOF2 is progressive
+		for (size_t i = 2; i + 1 < n; ++i)
+			if (d[i] == 0xFF && (d[i + 1] == 0xC0 || d[i + 1] == 0xC1))
+				return "jpeg_baseline";
+			else if (d[i] == 0xFF && d[i + 1] == 0xC2)
+				return "jpeg_progressive";
+		return "";
+	}
+	if (n > 29 && d[0] == 137 && d[1] == 'P' && d[2] == 'N' && d[3] == 'G')
+		return std::string(d[24] == 16 ? "png16" : "png8") + (d[28] ? "_interlaced" : "");
+	if (n > 6 && !memcmp(d.data(), "GIF8", 4))
+		return "gif";
+	if (n > 2 && d[0] == 'B' && d[1] == 'M')
+		return "bmp";
+	if (n > 26 && !memcmp(d.data(), "8BPS", 4))
+		return d[27] ? "psd_rle" : "psd";
+	if (n > 2 && d[0] == '#' && d[1] == '?')
+		return "hdr";
+	if (n > 2 && d[0] == 'P' && (d[1] == '5' || d[1] == '6'))
+		return "pnm";
+	std::string ext = path.size() > 4 ? path.substr(path.size() - 4) : "";
+	if ((ext == ".tga" || ext == ".TGA") && n > 18)
+		return d[2] >= 9 ? "tga_rle" : "tga";
+	return "";
+}
+
+static bool readFile(const std::string& path, Bytes& out)
+{
+	FILE* f = fopen(path.c_str(), "rb");
+	if (!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	out.resize(len > 0 ? len : 0);
+	bool ok = len > 0 && fread(out.data(), 1, len, f) == (size_t)len;
+	fclose(f);
+	return ok;
+}
+
+static std::vector<std::string> listDirectory(const std::string& dir)
+{
+	std::vector<std::string> files;
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &data);
+	if (h == INVALID_HANDLE_VALUE)
+		return files;
+	do
+		if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			files.push_back(dir + "\\" + data.cFileName);
+	while (FindNextFileA(h, &data));
+	FindClose(h);
+#else
+	DIR* d = opendir(dir.c_str());
+	if (!d)
+		return files;
+	while (struct dirent* e = readdir(d))
+		if (e->d_name[0] != '.')
+			files.push_back(dir + "/" + e->d_name);
+	closedir(d);
+#endif
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+///////////////
+// BENCHMARK //
+///////////////
+
+struct Result
+{
+	std::string format;
+	int threads, files;
+	double seconds, megabytes, megapixels;
+	long peakRssKb, peakHeapKb;
+};
+
+// Decodes one sample the way an application would for that format.
+// Returns the pixel count, or 0 on failure.
+static long decode(const std::string& format, const Bytes& data)
+{
+	int w, h, comp;
+	void* p;
+	if (format == "zlib")
+	{
+		int len = 0;
+		p = stbi_zlib_decode_malloc((const char*)data.data(), (int)data.size(), &len);
+		stbi_image_free(p);
+		return len;
+	}
+	if (format == "hdr")
+		p = stbi_loadf_from_memory(data.data(), (int)data.size(), &w, &h, &comp, 0);
+	else if (format.compare(0, 5, "png16") == 0)
+		p = stbi_load_16_from_memory(data.data(), (int)data.size(), &w, &h, &comp, 0);
+	else
+		p = stbi_load_from_memory(data.data(), (int)data.size(), &w, &h, &comp, 0);
+	if (!p)
+		return 0;
+	stbi_image_free(p);
+	return (long)w * h;
+}
+
+static Result run(Format& format, int threads, double minTime)
+{
+	typedef std::chrono::steady_clock Clock;
+	stbi_set_jpeg_threads(threads);
+
+	// decode each once first: drops files that stb_image can't read and
+	// warms up the caches and the allocator
+	std::vector<long> pixels;
+	for (size_t i = 0; i < format.samples.size();)
+	{
+		long n = decode(format.name, format.samples[i].data);
+		if (n)
+		{
+			pixels.push_back(n);
+			++i;
+			continue;
+		}
+		fprintf(stderr, "skipping %s: %s\n", format.samples[i].name.c_str(), stbi_failure_reason());
+		format.samples.erase(format.samples.begin() + i);
+	}
+
+	Result r;
+	r.format = format.name;
+	r.threads = threads;
+	r.files = (int)format.samples.size();
+	r.megabytes = r.megapixels = 0.0;
+	resetPeakRss();
+	heapPeak = heapNow.load();
+	size_t heapBase = heapNow;
+
+	Clock::time_point start = Clock::now();
+	do
+	{
+		for (size_t i = 0; i < format.samples.size(); ++i)
+		{
+			decode(format.name, format.samples[i].data);
+			r.megabytes += format.samples[i].data.size() / 1e6;
+			r.megapixels += pixels[i] / 1e6;
+		}
+		r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (r.seconds < minTime && !format.samples.empty());
+
+	r.peakRssKb = peakRssKb();
+	r.peakHeapKb = (long)((heapPeak - heapBase) / 1024);
+	return r;
+}
+
+static void writeJson(FILE* f, const std::vector<Result>& results, const std::vector<std::string>& skipped, const std::string& label, int width, int height)
+{
+	fprintf(f, "{\n");
+	fprintf(f, "  \"label\": \"");
+	for (char c : label)
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if ((unsigned char)c >= 32)
+			fputc(c, f);
+	fprintf(f, "\",\n");
+	fprintf(f, "  \"cpus\": %d,\n", cpuCount());
+	fprintf(f, "  \"synthetic_size\": [%d, %d],\n", width, height);
+	fprintf(f, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const Result& r = results[i];
+		fprintf(f, "    {\"format\": \"%s\", \"threads\": %d, \"files\": %d, \"seconds\": %.4f, "
+			"\"mb_per_s\": %.2f, \"mpixel_per_s\": %.2f, \"peak_rss_kb\": %ld, \"peak_heap_kb\": %ld}%s\n",
+			r.format.c_str(), r.threads, r.files, r.seconds,
+			r.megabytes / r.seconds, r.megapixels / r.seconds, r.peakRssKb, r.peakHeapKb,
+			i + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "  ],\n");
+	fprintf(f, "  \"skipped\": [");
+	for (size_t i = 0; i < skipped.size(); ++i)
+		fprintf(f, "%s\"%s\"", i ? ", " : "", skipped[i].c_str());
+	fprintf(f, "]\n}\n");
+}
+
+int main(int argc, char** argv)
+{
+	int width = 1024, height = 768;
+	double minTime = 0.5;
+	std::vector<int> threadCounts;
+	std::vector<std::string> dirs;
+	std::string label, jsonPath;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--size" && hasValue)
+		{
+			if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width < 8 || height < 1 || width > 32767 || height > 32767)
+			{
+				fprintf(stderr, "bad --size, want WxH\n");
+				return 1;
+			}
+		}
+		else if (arg == "--threads" && hasValue)
+		{
+			for (char* s = argv[++i]; *s;)
+			{
+				int t = (int)strtol(s, &s, 10);
+				if (t > 0)
+					threadCounts.push_back(t);
+				while (*s == ',')
+					++s;
+				if (*s && (*s < '0' || *s > '9'))
+					break;
+			}
+		}
+		else if (arg == "--min-time" && hasValue)
+			minTime = atof(argv[++i]);
+		else if (arg == "--label" && hasValue)
+			label = argv[++i];
+		else if (arg == "--json" && hasValue)
+			jsonPath = argv[++i];
+		else if (arg[0] == '-')
+		{
+			fprintf(stderr, "usage: bench_image [--size WxH] [--threads 1,4] [--min-time S] [--label TEXT] [--json FILE] [directory...]\n");
+			return 1;
+		}
+		else
+			dirs.push_back(arg);
+	}
+	if (threadCounts.empty())
+	{
+		threadCounts.push_back(1);
+		if (cpuCount() > 1)
+			threadCounts.push_back(cpuCount());
+	}
+	if (dirs.empty())
+	{
+		// run from the solution directory, or from here as Visual Studio does
+		dirs.push_back("learnopengl/textures");
+		if (listDirectory(dirs[0]).empty())
+			dirs[0] = "../learnopengl/textures";
+	}
+
+	// the corpus: generated images first, then files
+	std::vector<Format> formats;
+	std::vector<unsigned short> img;
+	makeImage(width, height, img);
+	char size[32];
+	sprintf(size, "%dx%d", width, height);
+	std::string tag = std::string("synthetic ") + size;
+	formatNamed(formats, "png8").samples.push_back({ tag + " rgba", encodePng(width, height, img, 8, 4, false) });
+	formatNamed(formats, "png8").samples.push_back({ tag + " rgb", encodePng(width, height, img, 8, 3, false) });
+	formatNamed(formats, "png16").samples.push_back({ tag, encodePng(width, height, img, 16, 3, false) });
+	formatNamed(formats, "png8_interlaced").samples.push_back({ tag, encodePng(width, height, img, 8, 4, true) });
+	for (const Sample& png : formatNamed(formats, "png8").samples)
+		formatNamed(formats, "zlib").samples.push_back({ png.name + " IDAT", pngIdat(png.data) });
+	formatNamed(formats, "bmp").samples.push_back({ tag, encodeBmp(width, height, img) });
+	formatNamed(formats, "tga").samples.push_back({ tag, encodeTga(width, height, img, false) });
+	formatNamed(formats, "tga_rle").samples.push_back({ tag, encodeTga(width, height, img, true) });
+	formatNamed(formats, "psd").samples.push_back({ tag, encodePsd(width, height, img, false) });
+	formatNamed(formats, "psd_rle").samples.push_back({ tag, encodePsd(width, height, img, true) });
+	formatNamed(formats, "gif").samples.push_back({ tag, encodeGif(width, height, img) });
+	formatNamed(formats, "hdr").samples.push_back({ tag, encodeHdr(width, height, img) });
+	formatNamed(formats, "pnm").samples.push_back({ tag, encodePnm(width, height, img) });
+	// JPEGs only come from files; listed anyway so a missing one shows up as skipped
+	formatNamed(formats, "jpeg_baseline");
+	formatNamed(formats, "jpeg_progressive");
+	for (const std::string& dir : dirs)
+		for (const std::string& path : listDirectory(dir))
+		{
+			Sample s;
+			s.name = path;
+			if (!readFile(path, s.data))
+				continue;
+			std::string name = classify(path, s.data);
+			if (!name.empty())
+				formatNamed(formats, name).samples.push_back(s);
+			if (name.compare(0, 4, "png8") == 0)
+				formatNamed(formats, "zlib").samples.push_back({ path + " IDAT", pngIdat(s.data) });
+		}
+
+	// with the JSON on stdout, the table goes to stderr so the output parses
+	FILE* table = jsonPath == "-" ? stderr : stdout;
+	std::vector<Result> results;
+	std::vector<std::string> skipped;
+	fprintf(table, "%-18s %7s %5s %9s %9s %12s %13s\n", "format", "threads", "files", "MB/s", "Mpix/s", "peak RSS KB", "peak heap KB");
+	for (Format& format : formats)
+	{
+		bool threaded = format.name.compare(0, 4, "jpeg") == 0;
+		for (size_t t = 0; t < (threaded ? threadCounts.size() : 1); ++t)
+		{
+			Result r = run(format, threaded ? threadCounts[t] : 1, minTime);
+			if (r.files == 0)
+			{
+				fprintf(table, "%-18s skipped (no input)\n", format.name.c_str());
+				skipped.push_back(format.name);
+				break;
+			}
+			fprintf(table, "%-18s %7d %5d %9.1f %9.1f %12ld %13ld\n", r.format.c_str(), r.threads, r.files,
+				r.megabytes / r.seconds, r.megapixels / r.seconds, r.peakRssKb, r.peakHeapKb);
+			results.push_back(r);
+		}
+	}
+
+	if (!jsonPath.empty())
+	{
+		FILE* f = jsonPath == "-" ? stdout : fopen(jsonPath.c_str(), "w");
+		if (!f)
+		{
+			fprintf(stderr, "can't write %s\n", jsonPath.c_str());
+			return 1;
+		}
+		writeJson(f, results, skipped, label, width, height);
+		if (f != stdout)
+			fclose(f);
+	}
+	return 0;
+}
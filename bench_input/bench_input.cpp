@@ -0,0 +1,213 @@
+// bench_input: input-to-frame latency of the application's render loop.
+//
+//	bench_input [--seconds S] [--spike-every N] [--spike-ms MS]
+//
+// A producer thread stands in for the GLFW event thread. It sends cursor
+// events at 1000Hz plus a key press or release every 25ms, through an
+// InputSender as the callbacks do. The consumer stands in for the render
+// thread and follows the application's frame: input, 4ms of simulation steps,
+// the view matrix, then 12ms of rendering and the swap. Every Nth frame the
+// simulation takes an extra spike.
+//
+// "poll after swap" is the loop before the render thread: events pile up in
+// the window system's queue (a locked vector here) and glfwPollEvents hands
+// them over after the swap, for the next frame. "queue, frame start" drains
+// the InputQueue only at the start of the frame. "queue, latched" is what
+// Application.cpp does: it drains the queue at the start of the frame and
+// again just before the view is built, which is as late as an event can still
+// reach that frame.
+//
+// Latency is from an event's timestamp to the end of the swap of the first
+// frame that shows it, over all events. "backlog" is the most events that
+// ever waited in the InputSender for room in the queue, which only happens
+// when a spike is longer than the queue (1024 events, so about a second);
+// "keys lost" must always be 0.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../learnopengl/src/InputQueue.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static Clock::time_point start;
+
+static double now()
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+enum Mode
+{
+	POLL_AFTER_SWAP,
+	QUEUE_FRAME_START,
+	QUEUE_LATCHED
+};
+
+// where the producer's events go, depending on the mode
+static InputQueue queue;
+static std::mutex pendingMutex;
+static std::vector<InputEvent> pending;
+
+struct Run
+{
+	std::vector<double> latencies;
+	int frames = 0, keysSent = 0, keysReceived = 0;
+	size_t maxBacklog = 0;
+};
+
+static std::atomic<bool> stop, producerDone;
+
+static void produce(Mode mode, Run& run)
+{
+	InputSender sender(queue);
+	Clock::time_point next = Clock::now();
+	int n = 0;
+	while (!stop)
+	{
+		next += std::chrono::milliseconds(1);
+		std::this_thread::sleep_until(next);
+		InputEvent events[2] = {
+			{ INPUT_CURSOR, now(), (double)n, 0.0, 0, 0 },
+			{ INPUT_KEY, now(), 0.0, 0.0, 'W', (n / 25) & 1 }
+		};
+		int count = n % 25 == 0 ? 2 : 1;
+		run.keysSent += count - 1;
+		if (mode == POLL_AFTER_SWAP)
+		{
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			pending.insert(pending.end(), events, events + count);
+		}
+		else
+		{
+			// the main loop's retry, then the callbacks
+			sender.flush();
+			for (int i = 0; i < count; ++i)
+				sender.send(events[i]);
+			run.maxBacklog = std::max(run.maxBacklog, sender.backlogSize());
+		}
+		++n;
+	}
+	while (!sender.flush())
+		std::this_thread::yield();
+	producerDone = true;
+}
+
+// Takes what has arrived; its timestamps wait in 'applied' for the next swap
+static void drain(Mode mode, Run& run, std::vector<double>& applied)
+{
+	InputEvent e;
+	if (mode == POLL_AFTER_SWAP)
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		for (const InputEvent& p : pending)
+		{
+			applied.push_back(p.Time);
+			run.keysReceived += p.Type == INPUT_KEY;
+		}
+		pending.clear();
+		return;
+	}
+	while (queue.pop(e))
+	{
+		applied.push_back(e.Time);
+		run.keysReceived += e.Type == INPUT_KEY;
+	}
+}
+
+static Run consume(Mode mode, double seconds, int spikeEvery, int spikeMs)
+{
+	Run run;
+	stop = false;
+	producerDone = false;
+	start = Clock::now();
+	std::thread producer(produce, mode, std::ref(run));
+
+	std::vector<double> applied;	// timestamps of events in the frame being made
+	std::vector<double> nextFrame;	// polled after the swap, for the next frame
+	while (now() < seconds)
+	{
+		applied.swap(nextFrame);
+		nextFrame.clear();
+		if (mode != POLL_AFTER_SWAP)
+			drain(mode, run, applied);
+
+		int simulateMs = 4 + (run.frames % spikeEvery == spikeEvery - 1 ? spikeMs : 0);
+		std::this_thread::sleep_for(std::chrono::milliseconds(simulateMs));
+
+		// build the view
+		if (mode == QUEUE_LATCHED)
+			drain(mode, run, applied);
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(12));
+
+		// swap: everything applied this frame is now on screen
+		double shown = now();
+		for (double eventTime : applied)
+			run.latencies.push_back(shown - eventTime);
+		applied.clear();
+
+		if (mode == POLL_AFTER_SWAP)
+			drain(mode, run, nextFrame);
+		++run.frames;
+	}
+
+	stop = true;
+	std::vector<double> rest;
+	while (!producerDone)
+		drain(mode, run, rest);
+	producer.join();
+	drain(mode, run, rest);
+	return run;
+}
+
+static double percentile(std::vector<double>& v, double p)
+{
+	if (v.empty())
+		return 0.0;
+	std::sort(v.begin(), v.end());
+	return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+int main(int argc, char** argv)
+{
+	double seconds = 3.0;
+	int spikeEvery = 20, spikeMs = 50;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--seconds" && hasValue)
+			seconds = atof(argv[++i]);
+		else if (arg == "--spike-every" && hasValue)
+			spikeEvery = std::max(1, atoi(argv[++i]));
+		else if (arg == "--spike-ms" && hasValue)
+			spikeMs = std::max(0, atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr, "usage: bench_input [--seconds S] [--spike-every N] [--spike-ms MS]\n");
+			return 1;
+		}
+	}
+
+	printf("frames of 4ms + 12ms, %dms spike every %d frames, 1000Hz input\n", spikeMs, spikeEvery);
+	printf("%-20s %7s %8s %9s %9s %9s %8s %10s\n", "mode", "frames", "events", "p50 ms", "p99 ms", "max ms", "backlog", "keys lost");
+	const char* names[] = { "poll after swap", "queue, frame start", "queue, latched" };
+	for (int mode = POLL_AFTER_SWAP; mode <= QUEUE_LATCHED; ++mode)
+	{
+		Run run = consume((Mode)mode, seconds, spikeEvery, spikeMs);
+		size_t events = run.latencies.size();
+		double p50 = percentile(run.latencies, 0.5), p99 = percentile(run.latencies, 0.99);
+		double max = run.latencies.empty() ? 0.0 : run.latencies.back();
+		printf("%-20s %7d %8zu %9.2f %9.2f %9.2f %8zu %10d\n", names[mode], run.frames, events,
+			p50 * 1e3, p99 * 1e3, max * 1e3, run.maxBacklog, run.keysSent - run.keysReceived);
+	}
+	return 0;
+}
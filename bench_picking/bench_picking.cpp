@@ -0,0 +1,114 @@
+// bench_picking: Picker against testing every object's triangles.
+//
+//	bench_picking [--objects N] [--picks P]
+//
+// Scatters N boxes (the 12-triangle cube from Application.cpp, each turned,
+// scaled and placed at random) and picks P times through random window
+// positions of a camera somewhere among them. The brute force version takes
+// every ray into every box's own space and tests all its triangles. Both must
+// find the same box at the same distance. Also times building the Picker.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "../learnopengl/src/Picking.h"
+#include "../learnopengl/src/Primitives.h"
+
+#include "../bench_common/bench_common.h"
+
+// The cube of Application.cpp
+typedef StaticMesh<MESH_POSITION | MESH_UV, CubeShape, 1> CubeMesh;
+
+int main(int argc, char** argv)
+{
+	int count = 1000000, picks = 1000;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--objects" && hasValue)
+			count = std::max(1, atoi(argv[++i]));
+		else if (arg == "--picks" && hasValue)
+			picks = std::max(1, atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr, "usage: bench_picking [--objects N] [--picks P]\n");
+			return 1;
+		}
+	}
+
+	// about one box per 50 cubic units, so rays travel some way before a hit
+	PickMesh cube = PickMesh::fromIndexed(CubeMesh::Vertices.Data, CubeMesh::Stride, CubeMesh::Indices.Data, CubeMesh::IndexCount);
+	float size = std::cbrt(count * 50.0f);
+	std::vector<glm::mat4> models(count), inverses(count);
+	for (int i = 0; i < count; ++i)
+	{
+		glm::vec3 position = (glm::vec3(random01(), random01(), random01()) - 0.5f) * size;
+		glm::vec3 axis = glm::normalize(glm::vec3(random01(), random01(), random01()) + glm::vec3(0.01f));
+		glm::vec3 scale = glm::vec3(random01(), random01(), random01()) * 1.5f + 0.25f;
+		models[i] = glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(glm::angleAxis(random01() * 6.2831853f, axis)) * glm::scale(glm::mat4(1.0f), scale);
+		inverses[i] = glm::inverse(models[i]);
+	}
+
+	Clock::time_point start = Clock::now();
+	Picker picker;
+	for (int i = 0; i < count; ++i)
+		picker.add(cube, models[i]);
+	picker.update();
+	double buildMs = msSince(start);
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+	int bruteEvery = std::max(1, (int)((long long)picks * count / 20000000)); // about 20M box tests in all
+	double pickUs = 0.0, worstUs = 0.0, bruteUs = 0.0;
+	int hits = 0, bruteRuns = 0, mismatches = 0;
+	for (int p = 0; p < picks; ++p)
+	{
+		glm::vec3 eye = (glm::vec3(random01(), random01(), random01()) - 0.5f) * size;
+		glm::vec3 target = eye + glm::vec3(random01() - 0.5f, random01() - 0.5f, random01() - 0.5f) + glm::vec3(0.0f, 0.0f, 0.001f);
+		glm::mat4 view = glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+
+		start = Clock::now();
+		PickRay ray = cursorRay(random01() * 800.0, random01() * 600.0, 800, 600, projection, view);
+		RayHit hit;
+		bool found = picker.pick(ray.Origin, ray.Direction, hit);
+		double us = msSince(start) * 1000.0;
+		pickUs += us;
+		worstUs = std::max(worstUs, us);
+		hits += found;
+
+		if (p % bruteEvery != 0)
+			continue;
+		start = Clock::now();
+		int bruteObject = -1;
+		float bruteDistance = 0.0f;
+		for (int i = 0; i < count; ++i)
+		{
+			float d = cube.raycast(glm::vec3(inverses[i] * glm::vec4(ray.Origin, 1.0f)), glm::vec3(inverses[i] * glm::vec4(ray.Direction, 0.0f)));
+			if (d >= 0.0f && (bruteObject < 0 || d < bruteDistance))
+			{
+				bruteObject = i;
+				bruteDistance = d;
+			}
+		}
+		bruteUs += msSince(start) * 1000.0;
+		++bruteRuns;
+		if (found != (bruteObject >= 0) || (found && std::fabs(hit.Distance - bruteDistance) > 1e-3f * std::max(1.0f, bruteDistance)))
+			++mismatches;
+	}
+
+	printf("%d boxes, %d picks, %d hit something\n", count, picks, hits);
+	printf("Picker build:  %.1f ms\n", buildMs);
+	printf("Picker pick:   %.2f us average, %.2f us worst\n", pickUs / picks, worstUs);
+	printf("brute force:   %.2f us average over %d picks, %.0fx slower\n", bruteUs / bruteRuns, bruteRuns, (bruteUs / bruteRuns) / (pickUs / picks));
+	printf("mismatches:    %d\n", mismatches);
+	return 0;
+}
@@ -0,0 +1,148 @@
+// bench_scene: SceneGraph updates against a pointer tree.
+//
+//	bench_scene [--nodes N] [--dirty PERCENT] [--frames F] [--threads T]
+//
+// Builds a random forest of N nodes: N/1000 roots, then levels three times
+// the size of the one above, each node under a random node of the level above.
+// Each frame changes the rotation of a random PERCENT of the nodes and updates
+// the world matrices. The pointer tree is the naive version: heap-allocated nodes with
+// child pointers, updated recursively from every root, every frame. The
+// SceneGraph only recomputes the changed nodes and what's below them. At the
+// end both trees' world matrices are compared.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../learnopengl/src/SceneGraph.h"
+
+#include "../bench_common/bench_common.h"
+
+struct TreeNode
+{
+	glm::vec3 Position;
+	glm::quat Rotation;
+	glm::mat4 World;
+	std::vector<TreeNode*> Children;
+};
+
+static void updateTree(TreeNode* node, const glm::mat4& parentWorld)
+{
+	glm::mat4 local = glm::translate(glm::mat4(1.0f), node->Position) * glm::mat4_cast(node->Rotation);
+	node->World = parentWorld * local;
+	for (TreeNode* child : node->Children)
+		updateTree(child, node->World);
+}
+
+static glm::quat randomRotation()
+{
+	return glm::angleAxis(random01() * 6.2831853f, glm::normalize(glm::vec3(random01() - 0.5f, random01() - 0.5f, random01() - 0.5f) + glm::vec3(0.0f, 0.01f, 0.0f)));
+}
+
+int main(int argc, char** argv)
+{
+	int nodes = 1000000, frames = 50;
+	double dirtyPercent = 1.0;
+	unsigned threads = std::thread::hardware_concurrency();
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--nodes" && hasValue)
+			nodes = std::max(1, atoi(argv[++i]));
+		else if (arg == "--dirty" && hasValue)
+			dirtyPercent = atof(argv[++i]);
+		else if (arg == "--frames" && hasValue)
+			frames = std::max(1, atoi(argv[++i]));
+		else if (arg == "--threads" && hasValue)
+			threads = std::max(1, atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr, "usage: bench_scene [--nodes N] [--dirty PERCENT] [--frames F] [--threads T]\n");
+			return 1;
+		}
+	}
+
+	// Random parents mean the children of a node aren't next to each other, so
+	// build() has to sort them. The pointer tree mirrors the scene.
+	SceneGraph scene(threads);
+	std::vector<std::unique_ptr<TreeNode> > tree;
+	std::vector<TreeNode*> roots;
+	int levelStart = 0, levelSize = std::max(1, nodes / 1000);
+	for (int i = 0; i < nodes; ++i)
+	{
+		if (i == levelStart + levelSize)
+		{
+			levelStart = i;
+			levelSize *= 3;
+		}
+		int parent = -1;
+		if (levelStart > 0)
+		{
+			int above = levelSize / 3;
+			parent = levelStart - above + (int)(random01() * above) % above;
+		}
+		glm::vec3 position(random01() * 4.0f - 2.0f, random01() * 4.0f - 2.0f, random01() * 4.0f - 2.0f);
+		glm::quat rotation = randomRotation();
+		scene.add(parent, position, rotation);
+
+		tree.push_back(std::unique_ptr<TreeNode>(new TreeNode()));
+		tree.back()->Position = position;
+		tree.back()->Rotation = rotation;
+		if (parent < 0)
+			roots.push_back(tree.back().get());
+		else
+			tree[parent]->Children.push_back(tree.back().get());
+	}
+
+	Clock::time_point start = Clock::now();
+	std::vector<int> newIndex = scene.build();
+	scene.update();
+	double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	int dirty = std::max(1, (int)(nodes * dirtyPercent / 100.0));
+	double sceneMs = 0.0, sceneWorstMs = 0.0, treeMs = 0.0;
+	size_t updated = 0;
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		for (int d = 0; d < dirty; ++d)
+		{
+			int i = (int)(random01() * nodes) % nodes;
+			glm::quat rotation = randomRotation();
+			scene.setRotation(newIndex[i], rotation);
+			tree[i]->Rotation = rotation;
+		}
+
+		start = Clock::now();
+		updated += scene.update();
+		double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		sceneMs += ms;
+		sceneWorstMs = std::max(sceneWorstMs, ms);
+
+		start = Clock::now();
+		for (TreeNode* root : roots)
+			updateTree(root, glm::mat4(1.0f));
+		treeMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	float diff = 0.0f;
+	for (int i = 0; i < nodes; ++i)
+		for (int c = 0; c < 4; ++c)
+			for (int r = 0; r < 4; ++r)
+				diff = std::max(diff, std::fabs(scene.World[newIndex[i]][c][r] - tree[i]->World[c][r]));
+
+	printf("%d nodes, %d changed per frame (%.2f%%), %u threads\n", nodes, dirty, dirtyPercent, threads);
+	printf("build and first full update: %.2f ms\n", buildMs);
+	printf("pointer tree, full update:   %.3f ms/frame\n", treeMs / frames);
+	printf("SceneGraph, dirty update:    %.3f ms/frame (worst %.3f), %zu nodes recomputed per frame, %.1f ns each\n",
+		sceneMs / frames, sceneWorstMs, updated / frames, sceneMs * 1e6 / std::max<size_t>(updated, 1));
+	printf("max difference: %.2g\n", diff);
+	return 0;
+}
@@ -0,0 +1,137 @@
+// bench_transform: model and MVP matrices with glm against TransformBatch.
+//
+//	bench_transform [--repeat N]
+//
+// The glm path is the one the render loop used: an array of positions and
+// rotation angles, glm::translate then glm::rotate for each object, and for
+// MVP one more glm::mat4 multiply. TransformBatch holds the same objects as
+// arrays of quaternion and position components. Both write their matrices to
+// the same kind of buffer, as they would into an instance buffer. Also checks
+// that both produce the same matrices.
+//
+// TransformBatch picks its AVX kernel at run time, so each size is timed with
+// the SSE kernel and, where the CPU supports it, again with the AVX one;
+// "speedup" is glm against the faster of the two.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../learnopengl/src/Transforms.h"
+
+#include "../bench_common/bench_common.h"
+
+struct Object
+{
+	glm::vec3 Position;
+	glm::vec3 Axis;
+	float Angle;
+};
+
+static void glmModels(const std::vector<Object>& objects, float* out)
+{
+	for (size_t i = 0; i < objects.size(); ++i)
+	{
+		glm::mat4 model = glm::mat4(1.0f);
+		model = glm::translate(model, objects[i].Position);
+		model = glm::rotate(model, objects[i].Angle, objects[i].Axis);
+		memcpy(out + i * 16, &model[0][0], sizeof(model));
+	}
+}
+
+static void glmMvps(const std::vector<Object>& objects, const glm::mat4& viewProjection, float* out)
+{
+	for (size_t i = 0; i < objects.size(); ++i)
+	{
+		glm::mat4 model = glm::mat4(1.0f);
+		model = glm::translate(model, objects[i].Position);
+		model = glm::rotate(model, objects[i].Angle, objects[i].Axis);
+		glm::mat4 mvp = viewProjection * model;
+		memcpy(out + i * 16, &mvp[0][0], sizeof(mvp));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int repeat = 5;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--repeat" && i + 1 < argc)
+			repeat = std::max(1, atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr, "usage: bench_transform [--repeat N]\n");
+			return 1;
+		}
+	}
+
+	bool avx = TransformBatch::avxEnabled();
+#if defined(TRANSFORMS_SSE)
+	printf("TransformBatch paths: SSE, 4 per iteration%s\n", avx ? "; AVX, 8 per iteration" : "; AVX not available");
+#else
+	printf("TransformBatch path: scalar\n");
+#endif
+	printf("%-9s %-6s %12s %12s %12s %8s %10s\n", "objects", "kind", "glm ns/obj", "sse ns/obj", "avx ns/obj", "speedup", "max diff");
+
+	glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f)
+		* glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	const size_t counts[] = { 10000, 100000, 1000000 };
+	for (size_t count : counts)
+	{
+		std::vector<Object> objects(count);
+		TransformBatch batch;
+		seed = 1;
+		for (size_t i = 0; i < count; ++i)
+		{
+			Object& o = objects[i];
+			float v[7];
+			for (int k = 0; k < 7; ++k)
+				v[k] = random11();
+			o.Position = glm::vec3(v[0], v[1], v[2]) * 50.0f;
+			o.Axis = glm::normalize(glm::vec3(v[3], v[4], v[5]) + glm::vec3(0.0f, 0.0f, 0.01f));
+			o.Angle = v[6] * 3.14159f;
+			batch.add(o.Position, o.Axis, o.Angle);
+		}
+
+		std::vector<float> a(count * 16), b(count * 16);
+		for (int kind = 0; kind < 2; ++kind)
+		{
+			auto runBatch = [&]()
+			{
+				if (kind == 0)
+					batch.writeModelMatrices(b.data());
+				else
+					batch.writeMvpMatrices(viewProjection, b.data());
+			};
+			double glmNs;
+			if (kind == 0)
+				glmNs = best(repeat, count, [&]() { glmModels(objects, a.data()); });
+			else
+				glmNs = best(repeat, count, [&]() { glmMvps(objects, viewProjection, a.data()); });
+
+			TransformBatch::enableAvx(false);
+			double sseNs = best(repeat, count, runBatch);
+			float diff = maxDiff(a, b);
+			double avxNs = 0.0;
+			if (avx)
+			{
+				TransformBatch::enableAvx(true);
+				avxNs = best(repeat, count, runBatch);
+				diff = std::max(diff, maxDiff(a, b));
+			}
+			double batchNs = avx ? std::min(sseNs, avxNs) : sseNs;
+			printf("%-9zu %-6s %12.2f %12.2f %12.2f %7.1fx %10.2g\n", count, kind == 0 ? "model" : "mvp",
+				glmNs, sseNs, avxNs, glmNs / batchNs, diff);
+		}
+	}
+	return 0;
+}
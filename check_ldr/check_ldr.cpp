@@ -0,0 +1,123 @@
+// check_ldr: error bound of the HDR to LDR conversion against pow().
+//
+//	check_ldr [--stride S]
+//
+// stbi__hdr_to_ldr computes pow(v*scale, 1/gamma) with short polynomials
+// instead of pow(). For a range of gamma and scale settings this feeds it
+// every S-th float in (0, 2) (default 64, about 17M values per setting) and
+// compares each byte with the pow() expression the loader used before. A
+// result may be off by one when the exact value is very close to a rounding
+// boundary, never more. The SSE2 and AVX2 kernels, where the CPU has them,
+// must give exactly the scalar bytes. Returns 1 if either doesn't hold.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../learnopengl/src/stb_image.h"
+
+// The expression stbi__hdr_to_ldr used before, in double as the C build did
+static int powByte(float v, float scale_i, float g)
+{
+	float z = (float)pow((double)(v * scale_i), (double)g) * 255 + 0.5f;
+	if (z < 0) z = 0;
+	if (z > 255) z = 255;
+	return (int)z;
+}
+
+struct Totals
+{
+	long long Values, OffByOne, Worse, SimdDiffers, AvxDiffers;
+};
+
+// One batch of values, all treated as colour (one channel, so no alpha lanes)
+static void checkBatch(const std::vector<float>& in, float scale_i, float g, Totals& t)
+{
+	int count = (int)in.size();
+	std::vector<stbi_uc> scalar(count), simd(count), avx(count);
+	for (int i = 0; i < count; ++i)
+	{
+		scalar[i] = stbi__ldr_color(in[i], scale_i, g);
+		int d = std::abs((int)scalar[i] - powByte(in[i], scale_i, g));
+		t.OffByOne += d == 1;
+		t.Worse += d > 1;
+	}
+	t.Values += count;
+#ifdef STBI_SSE2
+	if (stbi__sse2_available())
+	{
+		stbi__hdr_to_ldr_simd(simd.data(), in.data(), count, scale_i, g, 1);
+		for (int i = 0; i < (count & ~3); ++i)
+			t.SimdDiffers += simd[i] != scalar[i];
+	}
+#endif
+#ifdef STBI_AVX2
+	if (stbi__avx2_available())
+	{
+		stbi__hdr_to_ldr_avx2(avx.data(), in.data(), count, scale_i, g, 1);
+		for (int i = 0; i < (count & ~7); ++i)
+			t.AvxDiffers += avx[i] != scalar[i];
+	}
+#endif
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int stride = 64;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--stride" && i + 1 < argc)
+			stride = std::max(1, atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr, "usage: check_ldr [--stride S]\n");
+			return 1;
+		}
+	}
+
+	bool simd = false, avx = false;
+#ifdef STBI_SSE2
+	simd = stbi__sse2_available() != 0;
+#endif
+#ifdef STBI_AVX2
+	avx = stbi__avx2_available() != 0;
+#endif
+	printf("kernels: scalar%s%s\n", simd ? ", SSE2" : "", avx ? ", AVX2" : "");
+	printf("%-9s %-7s %11s %10s %9s %9s %9s\n", "gamma_i", "scale_i", "values", "off by 1", "worse", "sse2 !=", "avx2 !=");
+
+	const float gammas[] = { 1 / 2.2f, 1 / 1.8f, 1 / 2.4f, 1.0f, 2.2f, 0.1f, 5.0f };
+	const float scales[] = { 1.0f, 4.0f };
+	bool ok = true;
+	std::vector<float> batch;
+	batch.reserve(4096);
+	for (float g : gammas)
+		for (float scale_i : scales)
+		{
+			Totals t = {};
+			// every stride-th float from the smallest denormal up to 2
+			for (unsigned int bits = 1; bits < 0x40000000u; bits += stride)
+			{
+				float v;
+				memcpy(&v, &bits, 4);
+				batch.push_back(v);
+				if (batch.size() == 4096)
+				{
+					checkBatch(batch, scale_i, g, t);
+					batch.clear();
+				}
+			}
+			if (!batch.empty())
+				checkBatch(batch, scale_i, g, t);
+			batch.clear();
+			printf("%-9.4g %-7g %11lld %10lld %9lld %9lld %9lld\n", g, scale_i, t.Values, t.OffByOne, t.Worse, t.SimdDiffers, t.AvxDiffers);
+			ok = ok && t.Worse == 0 && t.SimdDiffers == 0 && t.AvxDiffers == 0;
+		}
+	printf(ok ? "ok\n" : "FAILED\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+// check_png: the SIMD PNG unfilter kernels against the plain C loops.
+//
+//	check_png [--count N] [--seed S]
+//
+// Writes N random PNGs in memory (default 3000): grey, grey-alpha, RGB and
+// RGBA at 8 and 16 bits plus low-bit grey, interlaced or not, random sizes,
+// and every row given a random filter over random bytes. Each one is decoded
+// by stb_image as the application builds it and again with STBI_NO_SIMD, for
+// every req_comp and with both the 8-bit and 16-bit loaders. The two must
+// agree exactly: same success, same size and the same bytes. Returns 1 if any
+// decode differs.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+typedef std::vector<unsigned char> Bytes;
+
+// check_png_simd.cpp and check_png_scalar.cpp
+void* loadSimd(const unsigned char* data, int len, int* w, int* h, int* comp, int reqComp, bool sixteen);
+void freeSimd(void* p);
+void* loadScalar(const unsigned char* data, int len, int* w, int* h, int* comp, int reqComp, bool sixteen);
+void freeScalar(void* p);
+
+static unsigned int seed = 1;
+
+static unsigned int randomInt(unsigned int n)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) % n;
+}
+
+static void put32be(Bytes& b, unsigned v)
+{
+	b.push_back((unsigned char)(v >> 24));
+	b.push_back((unsigned char)(v >> 16));
+	b.push_back((unsigned char)(v >> 8));
+	b.push_back((unsigned char)v);
+}
+
+static unsigned crc32(const unsigned char* p, size_t n)
+{
+	unsigned crc = ~0u;
+	for (size_t i = 0; i < n; ++i)
+	{
+		crc ^= p[i];
+		for (int k = 0; k < 8; ++k)
+			crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+	}
+	return ~crc;
+}
+
+static void pngChunk(Bytes& b, const char* type, const Bytes& data)
+{
+	put32be(b, (unsigned)data.size());
+	size_t start = b.size();
+	b.insert(b.end(), type, type + 4);
+	b.insert(b.end(), data.begin(), data.end());
+	put32be(b, crc32(&b[start], b.size() - start));
+}
+
+// zlib stream of stored blocks: the unfilter is what's being checked, so
+// there's no point compressing
+static Bytes zlibStored(const Bytes& raw)
+{
+	Bytes z;
+	z.push_back(0x78);
+	z.push_back(0x01);
+	size_t pos = 0;
+	do
+	{
+		size_t n = raw.size() - pos < 65535 ? raw.size() - pos : 65535;
+		z.push_back(pos + n == raw.size() ? 1 : 0);
+		z.push_back((unsigned char)n);
+		z.push_back((unsigned char)(n >> 8));
+		z.push_back((unsigned char)~n);
+		z.push_back((unsigned char)(~n >> 8));
+		z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + n);
+		pos += n;
+	} while (pos < raw.size());
+	unsigned a = 1, b = 0;
+	for (unsigned char c : raw)
+	{
+		a = (a + c) % 65521;
+		b = (b + a) % 65521;
+	}
+	put32be(z, (b << 16) | a);
+	return z;
+}
+
+// Filtered scanlines for one image (or one interlace pass): a random filter
+// type per row over random bytes, so every filter sees every kind of input
+static void randomRows(Bytes& raw, int w, int h, int bitsPerPixel)
+{
+	if (w <= 0 || h <= 0)
+		return;
+	size_t rowBytes = ((size_t)w * bitsPerPixel + 7) / 8;
+	for (int y = 0; y < h; ++y)
+	{
+		raw.push_back((unsigned char)randomInt(5));
+		// mostly small values, as real filtered data is
+		bool quiet = randomInt(2) != 0;
+		for (size_t i = 0; i < rowBytes; ++i)
+			raw.push_back((unsigned char)(quiet ? randomInt(8) - 4 : randomInt(256)));
+	}
+}
+
+struct Png
+{
+	int width, height, depth, colorType;
+	bool interlaced;
+	Bytes data;
+};
+
+static Png randomPng()
+{
+	static const int types[4] = { 0, 2, 4, 6 };
+	static const int channels[7] = { 1, 0, 3, 0, 2, 0, 4 };
+	Png p;
+	p.colorType = types[randomInt(4)];
+	// low-bit grey only takes the scalar path, but is cheap to keep covered
+	p.depth = randomInt(2) ? 8 : 16;
+	if (p.colorType == 0 && randomInt(4) == 0)
+		p.depth = 1 << randomInt(3);
+	p.width = 1 + randomInt(randomInt(4) ? 64 : 300);
+	p.height = 1 + randomInt(48);
+	p.interlaced = randomInt(3) == 0;
+	int bitsPerPixel = channels[p.colorType] * p.depth;
+
+	Bytes raw;
+	if (!p.interlaced)
+		randomRows(raw, p.width, p.height, bitsPerPixel);
+	else
+	{
+		static const int x0[7] = { 0,4,0,2,0,1,0 }, y0[7] = { 0,0,4,0,2,0,1 };
+		static const int dx[7] = { 8,8,4,4,2,2,1 }, dy[7] = { 8,8,8,4,4,2,2 };
+		for (int pass = 0; pass < 7; ++pass)
+			randomRows(raw, (p.width - x0[pass] + dx[pass] - 1) / dx[pass], (p.height - y0[pass] + dy[pass] - 1) / dy[pass], bitsPerPixel);
+	}
+
+	const unsigned char signature[8] = { 137,80,78,71,13,10,26,10 };
+	p.data.insert(p.data.end(), signature, signature + 8);
+	Bytes ihdr;
+	put32be(ihdr, p.width);
+	put32be(ihdr, p.height);
+	ihdr.push_back((unsigned char)p.depth);
+	ihdr.push_back((unsigned char)p.colorType);
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	ihdr.push_back(p.interlaced ? 1 : 0);
+	pngChunk(p.data, "IHDR", ihdr);
+	pngChunk(p.data, "IDAT", zlibStored(raw));
+	pngChunk(p.data, "IEND", Bytes());
+	return p;
+}
+
+// Decodes with both builds; true if they agree
+static bool compare(const Png& p, int reqComp, bool sixteen)
+{
+	int w1 = 0, h1 = 0, c1 = 0, w2 = 0, h2 = 0, c2 = 0;
+	void* a = loadSimd(p.data.data(), (int)p.data.size(), &w1, &h1, &c1, reqComp, sixteen);
+	void* b = loadScalar(p.data.data(), (int)p.data.size(), &w2, &h2, &c2, reqComp, sixteen);
+	bool same = !a == !b;
+	if (a && b)
+	{
+		size_t bytes = (size_t)w1 * h1 * (reqComp ? reqComp : c1) * (sixteen ? 2 : 1);
+		same = w1 == w2 && h1 == h2 && c1 == c2 && memcmp(a, b, bytes) == 0;
+	}
+	freeSimd(a);
+	freeScalar(b);
+	return same;
+}
+
+int main(int argc, char** argv)
+{
+	int count = 3000;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--count" && hasValue)
+			count = atoi(argv[++i]);
+		else if (arg == "--seed" && hasValue)
+			seed = (unsigned)strtoul(argv[++i], NULL, 10);
+		else
+		{
+			fprintf(stderr, "usage: check_png [--count N] [--seed S]\n");
+			return 1;
+		}
+	}
+
+	int decodes = 0, failures = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		Png p = randomPng();
+		for (int reqComp = 0; reqComp <= 4; ++reqComp)
+			for (int sixteen = 0; sixteen < 2; ++sixteen)
+			{
+				++decodes;
+				if (compare(p, reqComp, sixteen != 0))
+					continue;
+				if (++failures <= 10)
+					printf("differs: image %d, %dx%d, color type %d, %d bits%s, req_comp %d, %s loader\n",
+						i, p.width, p.height, p.colorType, p.depth, p.interlaced ? ", interlaced" : "",
+						reqComp, sixteen ? "16-bit" : "8-bit");
+			}
+	}
+	printf("%d images, %d decodes, %d differ\n", count, decodes, failures);
+	return failures ? 1 : 0;
+}
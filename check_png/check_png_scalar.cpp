@@ -0,0 +1,18 @@
+// stb_image with STBI_NO_SIMD: the plain C unfilter loops.
+
+#define STBI_NO_SIMD
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include "../learnopengl/src/stb_image.h"
+
+void* loadScalar(const unsigned char* data, int len, int* w, int* h, int* comp, int reqComp, bool sixteen)
+{
+	if (sixteen)
+		return stbi_load_16_from_memory(data, len, w, h, comp, reqComp);
+	return stbi_load_from_memory(data, len, w, h, comp, reqComp);
+}
+
+void freeScalar(void* p)
+{
+	stbi_image_free(p);
+}
@@ -0,0 +1,19 @@
+// stb_image as the application builds it, with the SIMD unfilter kernels.
+// STB_IMAGE_STATIC keeps its functions apart from the copy in
+// check_png_scalar.cpp.
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include "../learnopengl/src/stb_image.h"
+
+void* loadSimd(const unsigned char* data, int len, int* w, int* h, int* comp, int reqComp, bool sixteen)
+{
+	if (sixteen)
+		return stbi_load_16_from_memory(data, len, w, h, comp, reqComp);
+	return stbi_load_from_memory(data, len, w, h, comp, reqComp);
+}
+
+void freeSimd(void* p)
+{
+	stbi_image_free(p);
+}
@@ -0,0 +1,223 @@
+// check_threads: many loads at once on many threads, each with its own settings.
+//
+//	check_threads [--loads N] [--threads T] [directory...]
+//
+// Every image in the directories (learnopengl/textures by default), plus a few
+// damaged copies of each and a buffer that isn't an image at all, is first
+// decoded on the main thread with every combination of flip and req_comp,
+// keeping a hash of the pixels or the failure reason. Then T threads (default
+// 32) share N loads (default 10000) of random inputs and settings, passed as
+// stbi_options, half of them with a per-thread stbi_decoder, while JPEGs are
+// split over up to four threads of their own. Every load must give the same
+// pixels or the same reason as on its own. Returns 1 if any doesn't.
+//
+// On Linux, build it with -fsanitize=thread to have ThreadSanitizer watch for
+// races during the same run:
+//
+//	g++ -std=c++14 -O1 -g -fsanitize=thread check_threads.cpp -pthread
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#define STBI_THREADS
+#define STB_IMAGE_IMPLEMENTATION
+#include "../learnopengl/src/stb_image.h"
+
+typedef std::vector<unsigned char> Bytes;
+
+// What one load gave: a hash of the pixels, or why it failed
+struct Outcome
+{
+	std::uint64_t Hash;
+	std::string Reason;
+};
+
+struct Input
+{
+	std::string Name;
+	Bytes Data;
+	Outcome Expected[2][5];	// by flip, req_comp
+};
+
+static std::vector<std::string> listDirectory(const std::string& dir)
+{
+	std::vector<std::string> files;
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &data);
+	if (h == INVALID_HANDLE_VALUE)
+		return files;
+	do
+		if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			files.push_back(dir + "\\" + data.cFileName);
+	while (FindNextFileA(h, &data));
+	FindClose(h);
+#else
+	DIR* d = opendir(dir.c_str());
+	if (!d)
+		return files;
+	while (struct dirent* e = readdir(d))
+		if (e->d_name[0] != '.')
+			files.push_back(dir + "/" + e->d_name);
+	closedir(d);
+#endif
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+static bool readFile(const std::string& path, Bytes& out)
+{
+	FILE* f = fopen(path.c_str(), "rb");
+	if (!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	out.resize(len > 0 ? len : 0);
+	bool ok = len > 0 && fread(out.data(), 1, len, f) == (size_t)len;
+	fclose(f);
+	return ok;
+}
+
+static Outcome load(const Bytes& data, int flip, int reqComp, stbi_decoder* decoder)
+{
+	stbi_options options;
+	stbi_get_default_options(&options);
+	options.flip_vertically = flip;
+	options.decoder = decoder;
+	int w, h, comp;
+	stbi_uc* p = stbi_load_from_memory_ex(data.data(), (int)data.size(), &w, &h, &comp, reqComp, &options);
+	Outcome o;
+	o.Hash = 0;
+	if (!p)
+	{
+		const char* reason = stbi_failure_reason();
+		o.Reason = reason ? reason : "(none)";
+		return o;
+	}
+	// FNV-1a
+	o.Hash = 14695981039346656037ull;
+	size_t bytes = (size_t)w * h * (reqComp ? reqComp : comp);
+	for (size_t i = 0; i < bytes; ++i)
+		o.Hash = (o.Hash ^ p[i]) * 1099511628211ull;
+	stbi_image_free(p);
+	return o;
+}
+
+int main(int argc, char** argv)
+{
+	int loads = 10000, threadCount = 32;
+	std::vector<std::string> dirs;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--loads" && hasValue)
+			loads = std::max(1, atoi(argv[++i]));
+		else if (arg == "--threads" && hasValue)
+			threadCount = std::max(1, atoi(argv[++i]));
+		else if (arg[0] == '-')
+		{
+			fprintf(stderr, "usage: check_threads [--loads N] [--threads T] [directory...]\n");
+			return 1;
+		}
+		else
+			dirs.push_back(arg);
+	}
+	if (dirs.empty())
+	{
+		// run from the solution directory, or from here as Visual Studio does
+		dirs.push_back("learnopengl/textures");
+		if (listDirectory(dirs[0]).empty())
+			dirs[0] = "../learnopengl/textures";
+	}
+
+	// the inputs: each file, three damaged copies, and something that isn't an image
+	std::vector<Input> inputs;
+	unsigned int seed = 1;
+	for (const std::string& dir : dirs)
+		for (const std::string& path : listDirectory(dir))
+		{
+			Input in;
+			in.Name = path;
+			if (!readFile(path, in.Data))
+				continue;
+			inputs.push_back(in);
+			for (int copy = 1; copy <= 3; ++copy)
+			{
+				Input bad = in;
+				bad.Name = path + " damaged " + std::to_string(copy);
+				for (int k = 0; k < copy * 4; ++k)
+				{
+					seed = seed * 1664525u + 1013904223u;
+					size_t at = in.Data.size() / 8 + (seed >> 8) % (in.Data.size() - in.Data.size() / 8);
+					bad.Data[at] ^= (unsigned char)(1 << (seed >> 29));
+				}
+				inputs.push_back(bad);
+			}
+		}
+	if (inputs.empty())
+	{
+		fprintf(stderr, "no images found\n");
+		return 1;
+	}
+	Input junk;
+	junk.Name = "junk";
+	junk.Data.assign(64, 0x5a);
+	inputs.push_back(junk);
+
+	// JPEGs split their own work too; set before any loads start
+	stbi_set_jpeg_threads(4);
+	int failed = 0;
+	for (Input& in : inputs)
+		for (int flip = 0; flip < 2; ++flip)
+			for (int reqComp = 0; reqComp <= 4; ++reqComp)
+			{
+				in.Expected[flip][reqComp] = load(in.Data, flip, reqComp, NULL);
+				failed += in.Expected[flip][reqComp].Hash == 0;
+			}
+	printf("%d inputs, %d of %d reference loads fail\n", (int)inputs.size(), failed, (int)inputs.size() * 10);
+
+	std::atomic<int> next(0), wrong(0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < threadCount; ++t)
+		threads.emplace_back([&, t]()
+		{
+			stbi_decoder* decoder = stbi_decoder_create();
+			unsigned int r = 7919u * t + 1;
+			for (int i = next++; i < loads; i = next++)
+			{
+				r = r * 1664525u + 1013904223u;
+				const Input& in = inputs[(r >> 8) % inputs.size()];
+				int flip = (r >> 4) & 1, reqComp = (r >> 5) % 5;
+				Outcome o = load(in.Data, flip, reqComp, (r >> 30) & 1 ? decoder : NULL);
+				const Outcome& e = in.Expected[flip][reqComp];
+				if (o.Hash != e.Hash || o.Reason != e.Reason)
+				{
+					if (++wrong <= 10)
+						printf("differs: %s, flip %d, req_comp %d: %s\n", in.Name.c_str(), flip, reqComp,
+							o.Hash ? "pixels" : o.Reason.c_str());
+				}
+			}
+			stbi_decoder_free(decoder);
+		});
+	for (std::thread& t : threads)
+		t.join();
+
+	printf("%d loads on %d threads, %d differ\n", loads, threadCount, (int)wrong);
+	return wrong ? 1 : 0;
+}
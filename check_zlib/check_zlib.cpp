@@ -0,0 +1,518 @@
+// check_zlib: stb_image's inflate against the one it had before.
+//
+//	check_zlib [--count N] [--seed S] [directory...]
+//
+// Writes N random deflate streams (default 2000): one to four blocks each,
+// stored, fixed or dynamic Huffman, where a dynamic block gets random code
+// lengths from 1 to 15 bits, run-length coded, and random literals, lengths
+// and distances over them. Half have a zlib header and trailer, half are raw
+// deflate as the iPhone PNG path uses. Each is inflated by the current code,
+// into a growing buffer and into one of exactly the right size, and by the
+// old inflate from old_inflate.h; all three must give what the generator put
+// in. The IDAT data of every PNG in the directories (learnopengl/textures by
+// default) is inflated by both as well and must come out the same. Returns 1
+// if anything differs.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../learnopengl/src/stb_image.h"
+
+typedef std::vector<unsigned char> Bytes;
+
+// check_zlib_old.cpp
+char* oldInflate(const char* data, int len, int initialSize, int* outLen, bool header, const char** reason);
+
+static unsigned int seed = 1;
+
+static unsigned int randomInt(unsigned int n)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) % n;
+}
+
+/////////////
+// DEFLATE //
+/////////////
+
+struct BitWriter
+{
+	Bytes out;
+	unsigned acc = 0;
+	int bits = 0;
+
+	void putBits(unsigned v, int n)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			acc |= ((v >> i) & 1) << bits;
+			if (++bits == 8)
+			{
+				out.push_back((unsigned char)acc);
+				acc = 0;
+				bits = 0;
+			}
+		}
+	}
+
+	// Huffman codes go out most significant bit first
+	void putCode(unsigned code, int n)
+	{
+		for (int i = n - 1; i >= 0; --i)
+			putBits((code >> i) & 1, 1);
+	}
+
+	void align()
+	{
+		if (bits)
+			putBits(0, 8 - bits);
+	}
+};
+
+// A complete prefix code: split random leaves of a one-node tree until there
+// are 'used' of them, sometimes always the newest, which gives long chains,
+// then hand the depths to 'used' random symbols (the 'forced' ones first)
+static std::vector<int> randomLengths(int symbols, int used, int maxLength, const std::vector<int>& forced)
+{
+	std::vector<int> leaves(1, 0);
+	bool deep = randomInt(2) != 0;
+	while ((int)leaves.size() < used)
+	{
+		int i = deep && leaves.back() < maxLength ? (int)leaves.size() - 1 : (int)randomInt((unsigned)leaves.size());
+		if (leaves[i] == maxLength)
+			continue;
+		int depth = leaves[i] + 1;
+		leaves.erase(leaves.begin() + i);
+		leaves.push_back(depth);
+		leaves.push_back(depth);
+	}
+	std::vector<int> order;
+	for (int s = 0; s < symbols; ++s)
+		if (std::find(forced.begin(), forced.end(), s) == forced.end())
+			order.push_back(s);
+	for (int i = (int)order.size() - 1; i > 0; --i)
+		std::swap(order[i], order[randomInt(i + 1)]);
+	order.insert(order.begin(), forced.begin(), forced.end());
+	std::vector<int> lengths(symbols, 0);
+	for (int i = 0; i < used; ++i)
+		lengths[order[i]] = leaves[i];
+	return lengths;
+}
+
+// Canonical codes for a set of code lengths, as in RFC 1951 3.2.2
+static std::vector<unsigned> canonicalCodes(const std::vector<int>& lengths)
+{
+	int count[16] = {}, next[16] = {};
+	for (int l : lengths)
+		++count[l];
+	count[0] = 0;
+	for (int l = 1, code = 0; l < 16; ++l)
+	{
+		code = (code + count[l - 1]) << 1;
+		next[l] = code;
+	}
+	std::vector<unsigned> codes(lengths.size(), 0);
+	for (size_t s = 0; s < lengths.size(); ++s)
+		if (lengths[s])
+			codes[s] = next[lengths[s]]++;
+	return codes;
+}
+
+static const int lengthBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const int lengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const int distBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const int distExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+// Random symbols over the given codes, appending what they decode to to
+// 'plain'. Lengths only refer back as far as 'plain' goes.
+static void huffmanData(BitWriter& w, Bytes& plain, const std::vector<int>& litLengths, const std::vector<int>& distLengths)
+{
+	std::vector<unsigned> litCodes = canonicalCodes(litLengths), distCodes = canonicalCodes(distLengths);
+	std::vector<int> literals, lengths, dists;
+	for (int s = 0; s < 286; ++s)
+		if (litLengths[s] && s != 256)
+			(s < 256 ? literals : lengths).push_back(s);
+	for (int s = 0; s < 30; ++s)
+		if (distLengths[s])
+			dists.push_back(s);
+
+	int symbols = randomInt(4) ? randomInt(3000) : randomInt(60000);
+	for (int i = 0; i < symbols; ++i)
+	{
+		int s = (int)randomInt(literals.size() + lengths.size());
+		int d = dists.empty() ? -1 : dists[randomInt((unsigned)dists.size())];
+		if (s < (int)literals.size() || d < 0 || distBase[d] > (int)plain.size())
+		{
+			if (literals.empty())
+				continue;
+			int v = literals[randomInt((unsigned)literals.size())];
+			w.putCode(litCodes[v], litLengths[v]);
+			plain.push_back((unsigned char)v);
+			continue;
+		}
+		s = lengths[s - literals.size()];
+		// 284 with all extra bits set would be 258, which has its own code
+		int len = lengthBase[s - 257] + (int)randomInt((1u << lengthExtra[s - 257]) - (s == 284));
+		int most = std::min((int)plain.size() - distBase[d], (1 << distExtra[d]) - 1);
+		int dist = distBase[d] + (int)randomInt(most + 1);
+		w.putCode(litCodes[s], litLengths[s]);
+		w.putBits(len - lengthBase[s - 257], lengthExtra[s - 257]);
+		w.putCode(distCodes[d], distLengths[d]);
+		w.putBits(dist - distBase[d], distExtra[d]);
+		for (int k = 0; k < len; ++k)
+			plain.push_back(plain[plain.size() - dist]);
+	}
+	w.putCode(litCodes[256], litLengths[256]);
+}
+
+static void storedBlock(BitWriter& w, Bytes& plain)
+{
+	int len = randomInt(4) ? randomInt(300) : randomInt(65536);
+	w.align();
+	w.putBits(len, 16);
+	w.putBits(len ^ 0xffff, 16);
+	for (int i = 0; i < len; ++i)
+	{
+		unsigned char v = (unsigned char)randomInt(256);
+		w.out.push_back(v);
+		plain.push_back(v);
+	}
+}
+
+static void fixedBlock(BitWriter& w, Bytes& plain)
+{
+	// 286 and 287 are never used, but take part in giving out the codes
+	std::vector<int> lit(288), dist(30, 5);
+	for (int s = 0; s < 288; ++s)
+		lit[s] = s < 144 ? 8 : s < 256 ? 9 : s < 280 ? 7 : 8;
+	huffmanData(w, plain, lit, dist);
+}
+
+static void dynamicBlock(BitWriter& w, Bytes& plain)
+{
+	// the end-of-block code and a literal always have a length, and a
+	// distance code is only left out when the block is all literals
+	std::vector<int> lit = randomLengths(286, 2 + randomInt(285), 15, { 256, (int)randomInt(256) });
+	std::vector<int> dist = randomInt(8) ? randomLengths(30, 2 + randomInt(29), 15, {}) : std::vector<int>(30, 0);
+
+	// the code lengths, run-length coded where a random choice says so
+	std::vector<int> all(lit);
+	all.insert(all.end(), dist.begin(), dist.end());
+	std::vector<int> cl, clExtra;
+	for (size_t i = 0; i < all.size();)
+	{
+		size_t run = 1;
+		while (i + run < all.size() && all[i + run] == all[i])
+			++run;
+		if (all[i] == 0 && run >= 11 && randomInt(2))
+		{
+			int n = (int)std::min<size_t>(run, 138);
+			cl.push_back(18);
+			clExtra.push_back(n - 11);
+			i += n;
+		}
+		else if (all[i] == 0 && run >= 3 && randomInt(2))
+		{
+			int n = (int)std::min<size_t>(run, 10);
+			cl.push_back(17);
+			clExtra.push_back(n - 3);
+			i += n;
+		}
+		else if (i > 0 && all[i - 1] == all[i] && run >= 3 && randomInt(2))
+		{
+			int n = (int)std::min<size_t>(run, 6);
+			cl.push_back(16);
+			clExtra.push_back(n - 3);
+			i += n;
+		}
+		else
+		{
+			cl.push_back(all[i]);
+			clExtra.push_back(0);
+			++i;
+		}
+	}
+	std::vector<int> clUsed;
+	for (int s : cl)
+		if (std::find(clUsed.begin(), clUsed.end(), s) == clUsed.end())
+			clUsed.push_back(s);
+	if (clUsed.size() < 2)
+		clUsed.push_back(clUsed[0] == 0 ? 1 : 0);
+	std::vector<int> clLengths = randomLengths(19, (int)clUsed.size(), 7, clUsed);
+	std::vector<unsigned> clCodes = canonicalCodes(clLengths);
+
+	static const int order[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+	w.putBits(286 - 257, 5);
+	w.putBits(30 - 1, 5);
+	w.putBits(19 - 4, 4);
+	for (int i = 0; i < 19; ++i)
+		w.putBits(clLengths[order[i]], 3);
+	for (size_t i = 0; i < cl.size(); ++i)
+	{
+		w.putCode(clCodes[cl[i]], clLengths[cl[i]]);
+		if (cl[i] >= 16)
+			w.putBits(clExtra[i], cl[i] == 16 ? 2 : cl[i] == 17 ? 3 : 7);
+	}
+	huffmanData(w, plain, lit, dist);
+}
+
+static void put32be(Bytes& b, unsigned v)
+{
+	b.push_back((unsigned char)(v >> 24));
+	b.push_back((unsigned char)(v >> 16));
+	b.push_back((unsigned char)(v >> 8));
+	b.push_back((unsigned char)v);
+}
+
+struct Stream
+{
+	Bytes data, plain;
+	bool header;
+	std::string blocks;
+};
+
+static Stream randomStream()
+{
+	Stream s;
+	s.header = randomInt(2) != 0;
+	BitWriter w;
+	if (s.header)
+	{
+		w.out.push_back(0x78);
+		w.out.push_back(0x01);
+	}
+	int blocks = 1 + randomInt(4);
+	for (int b = 0; b < blocks; ++b)
+	{
+		int type = randomInt(5);
+		type = type == 0 ? 0 : type == 1 ? 1 : 2;
+		w.putBits(b + 1 == blocks, 1);
+		w.putBits(type, 2);
+		if (type == 0)
+			storedBlock(w, s.plain);
+		else if (type == 1)
+			fixedBlock(w, s.plain);
+		else
+			dynamicBlock(w, s.plain);
+		s.blocks += "sfd"[type];
+	}
+	w.align();
+	s.data = w.out;
+	if (s.header)
+	{
+		unsigned a = 1, b = 0;
+		for (unsigned char c : s.plain)
+		{
+			a = (a + c) % 65521;
+			b = (b + a) % 65521;
+		}
+		put32be(s.data, (b << 16) | a);
+	}
+	return s;
+}
+
+////////////
+// CHECKS //
+////////////
+
+// What one inflate gave
+struct Outcome
+{
+	bool ok;
+	Bytes out;
+	std::string reason;
+};
+
+static Outcome newInflate(const Bytes& data, bool header, int initialSize)
+{
+	Outcome o;
+	int len = 0;
+	char* p = header
+		? stbi_zlib_decode_malloc_guesssize((const char*)data.data(), (int)data.size(), initialSize, &len)
+		: stbi_zlib_decode_malloc_guesssize_headerflag((const char*)data.data(), (int)data.size(), initialSize, &len, 0);
+	o.ok = p != NULL;
+	if (p)
+		o.out.assign(p, p + len);
+	else
+		o.reason = stbi_failure_reason();
+	free(p);
+	return o;
+}
+
+// into a caller buffer of exactly the expected size; the bytes after it
+// must be left alone
+static Outcome newInflateExact(const Bytes& data, bool header, size_t size)
+{
+	Outcome o;
+	std::vector<char> buf(size + 16, 0x55);
+	int len = header
+		? stbi_zlib_decode_buffer(buf.data(), (int)size, (const char*)data.data(), (int)data.size())
+		: stbi_zlib_decode_noheader_buffer(buf.data(), (int)size, (const char*)data.data(), (int)data.size());
+	o.ok = len >= 0;
+	if (o.ok)
+		o.out.assign(buf.begin(), buf.begin() + len);
+	else
+		o.reason = stbi_failure_reason();
+	for (size_t i = size; i < buf.size(); ++i)
+		if (buf[i] != 0x55)
+		{
+			o.ok = false;
+			o.reason = "wrote past the buffer";
+		}
+	return o;
+}
+
+static Outcome oldInflate(const Bytes& data, bool header, int initialSize)
+{
+	Outcome o;
+	int len = 0;
+	const char* reason = NULL;
+	char* p = oldInflate((const char*)data.data(), (int)data.size(), initialSize, &len, header, &reason);
+	o.ok = p != NULL;
+	if (p)
+		o.out.assign(p, p + len);
+	else
+		o.reason = reason ? reason : "(none)";
+	free(p);
+	return o;
+}
+
+static std::vector<std::string> listDirectory(const std::string& dir)
+{
+	std::vector<std::string> files;
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &data);
+	if (h == INVALID_HANDLE_VALUE)
+		return files;
+	do
+		if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			files.push_back(dir + "\\" + data.cFileName);
+	while (FindNextFileA(h, &data));
+	FindClose(h);
+#else
+	DIR* d = opendir(dir.c_str());
+	if (!d)
+		return files;
+	while (struct dirent* e = readdir(d))
+		if (e->d_name[0] != '.')
+			files.push_back(dir + "/" + e->d_name);
+	closedir(d);
+#endif
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+static bool readFile(const std::string& path, Bytes& out)
+{
+	FILE* f = fopen(path.c_str(), "rb");
+	if (!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	out.resize(len > 0 ? len : 0);
+	bool ok = len > 0 && fread(out.data(), 1, len, f) == (size_t)len;
+	fclose(f);
+	return ok;
+}
+
+// The IDAT chunks of a PNG joined up, as stb_image inflates them; empty if
+// it isn't a PNG
+static Bytes pngIdat(const Bytes& png)
+{
+	static const unsigned char signature[8] = { 137,80,78,71,13,10,26,10 };
+	Bytes idat;
+	if (png.size() < 8 || memcmp(png.data(), signature, 8) != 0)
+		return idat;
+	for (size_t at = 8; at + 12 <= png.size();)
+	{
+		size_t len = (size_t)png[at] << 24 | png[at + 1] << 16 | png[at + 2] << 8 | png[at + 3];
+		if (len > png.size() - at - 12)
+			break;
+		if (!memcmp(&png[at + 4], "IDAT", 4))
+			idat.insert(idat.end(), png.begin() + at + 8, png.begin() + at + 8 + len);
+		at += len + 12;
+	}
+	return idat;
+}
+
+int main(int argc, char** argv)
+{
+	int count = 2000;
+	std::vector<std::string> dirs;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--count" && hasValue)
+			count = atoi(argv[++i]);
+		else if (arg == "--seed" && hasValue)
+			seed = (unsigned)strtoul(argv[++i], NULL, 10);
+		else if (arg[0] == '-')
+		{
+			fprintf(stderr, "usage: check_zlib [--count N] [--seed S] [directory...]\n");
+			return 1;
+		}
+		else
+			dirs.push_back(arg);
+	}
+	if (dirs.empty())
+	{
+		// run from the solution directory, or from here as Visual Studio does
+		dirs.push_back("learnopengl/textures");
+		if (listDirectory(dirs[0]).empty())
+			dirs[0] = "../learnopengl/textures";
+	}
+
+	int failures = 0;
+	size_t inflated = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		Stream s = randomStream();
+		// a small first guess, so the growing buffer grows
+		Outcome grown = newInflate(s.data, s.header, 64);
+		Outcome exact = newInflateExact(s.data, s.header, s.plain.size());
+		Outcome old = oldInflate(s.data, s.header, 64);
+		inflated += s.plain.size();
+		const char* which = !grown.ok || grown.out != s.plain ? "growing buffer"
+			: !exact.ok || exact.out != s.plain ? "exact buffer"
+			: !old.ok || old.out != s.plain ? "old inflate" : NULL;
+		if (!which)
+			continue;
+		if (++failures <= 10)
+			printf("differs: stream %d, blocks %s%s, %d bytes: %s %s\n", i, s.blocks.c_str(), s.header ? "" : " (raw)",
+				(int)s.plain.size(), which, grown.ok && exact.ok && old.ok ? "gives other bytes" : "fails");
+	}
+	printf("%d random streams, %.1f MB inflated, %d differ\n", count, inflated / 1e6, failures);
+
+	int files = 0, fileFailures = 0;
+	for (const std::string& dir : dirs)
+		for (const std::string& path : listDirectory(dir))
+		{
+			Bytes png, idat;
+			if (!readFile(path, png) || (idat = pngIdat(png)).empty())
+				continue;
+			++files;
+			Outcome now = newInflate(idat, true, 16384), old = oldInflate(idat, true, 16384);
+			if (now.ok != old.ok || now.out != old.out || (!now.ok && now.reason != old.reason))
+			{
+				++fileFailures;
+				printf("differs: %s: now %s, before %s\n", path.c_str(), now.ok ? "ok" : now.reason.c_str(), old.ok ? "ok" : old.reason.c_str());
+			}
+		}
+	printf("%d PNG files, %d differ\n", files, fileFailures);
+	return failures || fileFailures ? 1 : 0;
+}
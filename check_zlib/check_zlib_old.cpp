@@ -0,0 +1,46 @@
+// The inflate stb_image had before, from old_inflate.h, with just enough of
+// stb_image around it to compile on its own.
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+typedef unsigned char stbi_uc;
+typedef unsigned short stbi__uint16;
+typedef unsigned int stbi__uint32;
+
+#define stbi_inline inline
+#define STBI_ASSERT(x) assert(x)
+#define STBI_NOTUSED(v) (void)sizeof(v)
+#define STBI_REALLOC_SIZED(p, oldsz, newsz) realloc(p, newsz)
+
+static const char* failureReason;
+
+static int stbi__err(const char* str)
+{
+	failureReason = str;
+	return 0;
+}
+#define stbi__err(x, y) stbi__err(x)
+
+#include "old_inflate.h"
+
+// stbi_zlib_decode_malloc_guesssize_headerflag as it was
+char* oldInflate(const char* data, int len, int initialSize, int* outLen, bool header, const char** reason)
+{
+	stbi__zbuf a;
+	char* p = (char*)malloc(initialSize);
+	if (!p)
+		return NULL;
+	a.zbuffer = (stbi_uc*)data;
+	a.zbuffer_end = (stbi_uc*)data + len;
+	failureReason = NULL;
+	if (stbi__do_zlib(&a, p, initialSize, 1, header))
+	{
+		*outLen = (int)(a.zout - a.zout_start);
+		return a.zout_start;
+	}
+	free(a.zout_start);
+	*reason = failureReason;
+	return NULL;
+}
@@ -5,15 +5,33 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <thread>
 #include "src/stb_image.h"
 #include "src/Shader.h"
 #include "src/Camera.h"
+#include "src/InputQueue.h"
+#include "src/FrameTimer.h"
+#include "src/Transforms.h"
+#include "src/Entities.h"
+#include "src/Frustum.h"
+#include "src/Picking.h"
+#include "src/Primitives.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+void render(GLFWwindow* window);
 void processInput(GLFWwindow *window);
+void moveCamera(float step);
+void printFrameStats();
+void animate(float seconds);
+void cull(const glm::mat4& viewProjection);
+void extract(TransformBatch& batch);
 
 // Screen settings
 const unsigned int SCREEN_WIDTH = 800;
@@ -25,9 +43,43 @@ float lastX = (float)SCREEN_WIDTH / 2.0;
 float lastY = (float)SCREEN_HEIGHT / 2.0;
 bool firstMouse = true;
 
-// Timing
-float deltaTime = 0.0f; // time between current frame and last frame
-float lastFrame = 0.0f; // time of last frame
+// Input: the GLFW callbacks run on the main thread and only queue events,
+// the render thread applies them to the camera each frame
+InputQueue input;
+InputSender inputSender(input); // main thread only
+bool keys[GLFW_KEY_LAST + 1]; // keys held down, render thread only
+std::atomic<bool> running(true);
+int renderResult = 0;
+
+// Timing: the camera moves in fixed 60Hz steps, whatever the frame rate
+FrameTimer timer;
+glm::vec3 previousPosition; // camera position at the step before the last
+
+// Scene objects are entities, made of these components; render thread only
+struct Transform
+{
+	glm::vec3 Position;
+	glm::quat Rotation;
+};
+struct Spin
+{
+	glm::vec3 Axis;
+	float Speed; // radians per second
+};
+struct Renderable
+{
+	float Radius; // of the bounding sphere
+	bool Visible; // set by cull()
+};
+struct Pickable
+{
+	std::uint32_t Object; // id in the Picker
+};
+EntityWorld scene;
+bool pickRequested = false; // left click, render thread only
+
+glm::mat4 modelMatrix(const Transform& transform);
+void pickAtCrosshair(const Picker& picker, const glm::mat4& projection, const glm::mat4& view);
 
 int main(void)
 {
@@ -51,23 +103,54 @@ int main(void)
 		return -1;
 	}
 
-	// Make the window's context current
-	glfwMakeContextCurrent(window);
 	// Register setframebuffer callback function for resizing window
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 	// Register mouse callback function with each mouse move
 	glfwSetCursorPosCallback(window, mouse_callback);
 	// Register scroll callback function with each scroll
 	glfwSetScrollCallback(window, scroll_callback);
+	// Register key callback function with each key press and release
+	glfwSetKeyCallback(window, key_callback);
+	// Register mouse button callback function with each click
+	glfwSetMouseButtonCallback(window, mouse_button_callback);
 
 	// Tell GLFW to capture our mouse
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
+	// GLFW only handles window events on the main thread, so rendering gets a
+	// thread of its own and this one just waits for events. A slow frame then
+	// never holds up input, and every event is timestamped as it arrives.
+	std::thread renderThread(render, window);
+	while (!glfwWindowShouldClose(window))
+	{
+		// Events waiting for room in the queue are retried every millisecond,
+		// rather than whenever the next event happens to arrive
+		if (inputSender.flush())
+			glfwWaitEvents();
+		else
+			glfwWaitEventsTimeout(0.001);
+	}
+	running = false;
+	renderThread.join();
+
+	// Clear all previously allocated GLFW resources and terminate
+	glfwTerminate();
+	return renderResult;
+}
+
+void render(GLFWwindow* window)
+{
+	// Make the window's context current on this thread
+	glfwMakeContextCurrent(window);
+
 	// glad: load all OpenGL function pointers
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
 	{
 		std::cerr << "Failed to initialize GLAD" << std::endl;
-		return -1;
+		renderResult = -1;
+		glfwSetWindowShouldClose(window, true);
+		glfwPostEmptyEvent();
+		return;
 	}
 
 	// Global opengl setting
@@ -76,56 +159,8 @@ int main(void)
 	// Build shaders and compile
 	Shader ourShader("shaders/vShader.vs", "shaders/fShader.fs");
 
-	// Vertex Data 
-	float vertices[] = {
-		 // positions          // texture coords
-		-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-		0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-		0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-
-		-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-		0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-		0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-		0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-
-		-0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-		-0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-		-0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-		0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-		0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-		0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-		-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-		0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-		0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-
-		-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-		0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-		0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f, 1.0f
-	};
-
-	unsigned int indices[] = {
-		0, 1, 3, // first triangle
-		1, 2, 3  // second triangle
-	};
+	// Vertex Data: the cube is built while compiling, see Primitives.h
+	typedef StaticMesh<MESH_POSITION | MESH_UV, CubeShape, 1> CubeMesh;
 
 	glm::vec3 cubePositions[] = {
 		glm::vec3(0.0f,  0.0f,  0.0f),
@@ -156,19 +191,51 @@ int main(void)
 	glBindVertexArray(VAO);
 	// Copy vertices array in a buffer for OpenGL to use
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(CubeMesh::Vertices), CubeMesh::Vertices.Data, GL_STATIC_DRAW);
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(CubeMesh::Indices), CubeMesh::Indices.Data, GL_STATIC_DRAW);
 
 	// Set Vertex position Attributes pointers
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, CubeMesh::Stride * sizeof(float), (void*)(meshOffset(CubeMesh::Attributes, MESH_POSITION) * sizeof(float)));
 	glEnableVertexAttribArray(0);
 	
 	// Set Vertex texture coords Attributes pointers
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, CubeMesh::Stride * sizeof(float), (void*)(meshOffset(CubeMesh::Attributes, MESH_UV) * sizeof(float)));
 	glEnableVertexAttribArray(1);
 
+	// One entity per box; every third one turns, as in the tutorial's exercise.
+	// Clicks are tested against the box's triangles.
+	PickMesh cubeMesh = PickMesh::fromIndexed(CubeMesh::Vertices.Data, CubeMesh::Stride, CubeMesh::Indices.Data, CubeMesh::IndexCount);
+	Picker picker;
+	glm::vec3 axis = glm::normalize(glm::vec3(0.5f, 0.7f, 0.0f));
+	for (unsigned int i = 0; i < 10; i++)
+	{
+		Transform transform = { cubePositions[i], glm::angleAxis(glm::radians(20.0f * i), axis) };
+		Renderable renderable = { 0.87f, true }; // half the diagonal of a unit cube
+		Pickable pickable = { picker.add(cubeMesh, modelMatrix(transform)) };
+		Entity box = scene.create(transform, renderable, pickable);
+		if (i % 3 == 0)
+			scene.add(box, Spin{ axis, glm::radians(50.0f) });
+	}
+
+	// Model matrices of the visible boxes, one per instance: gathered into a
+	// batch each frame and written straight into the mapped instance buffer
+	TransformBatch cubes;
+	unsigned int instanceVBO;
+	glGenBuffers(1, &instanceVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	GLsizeiptr instanceSize = scene.size() * sizeof(glm::mat4);
+	glBufferData(GL_ARRAY_BUFFER, instanceSize, NULL, GL_STREAM_DRAW);
+
+	// Set instance model matrix Attributes pointers: a mat4 takes four vec4 locations
+	for (unsigned int column = 0; column < 4; column++)
+	{
+		glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+		glEnableVertexAttribArray(2 + column);
+		glVertexAttribDivisor(2 + column, 1); // next matrix for each instance, not each vertex
+	}
+
 	// Unbind VBO as glVertexAttribPointer registered VBO as vertex attribute's bound vertex
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	// Unbind VAO, so that other VAO calls don't modify this VAO
@@ -233,16 +300,26 @@ int main(void)
 	ourShader.setInt("texture1", 0);
 	ourShader.setInt("texture2", 1);
 	
+	// Start timing here so the loading above doesn't count as a frame
+	timer.reset();
+	previousPosition = camera.Position;
+
 	// Loop until the user closes the window
-	while (!glfwWindowShouldClose(window))
+	while (running)
 	{
 		// Time frame
-		float currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+		timer.beginFrame();
 
-		// Process inputs 
+		// Apply the queued input, then the mouse movement it added
 		processInput(window);
+		camera.Update();
+		// Run the simulation steps that are due
+		while (timer.step())
+		{
+			previousPosition = camera.Position;
+			moveCamera((float)timer.StepSeconds);
+			animate((float)timer.StepSeconds);
+		}
 		// Render here
 		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -259,79 +336,206 @@ int main(void)
 		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 0.1f, 100.0f);
 		ourShader.setMat4("projection", projection);
 
-		glm::mat4 view = camera.GetViewMatrix();
+		// Take the input that arrived during the simulation as well, so the
+		// view has the latest mouse look. Then draw the camera between its
+		// last two steps, by how far this frame is into the next one; the
+		// mouse look isn't delayed by this
+		processInput(window);
+		glm::mat4 view = camera.GetViewMatrix(glm::mix(previousPosition, camera.Position, timer.alpha()));
 		ourShader.setMat4("view", view);
 
-		// Render box
-		glBindVertexArray(VAO); // not required here, because of only single VAO
-
-		for (unsigned int i = 0; i < 10; i++)
+		// Find the boxes in view and upload their matrices
+		scene.each<const Transform, const Spin, const Pickable>([&picker](const Transform& transform, const Spin&, const Pickable& pickable)
+		{
+			picker.setTransform(pickable.Object, modelMatrix(transform));
+		});
+		picker.update();
+		if (pickRequested)
 		{
-			glm::mat4 model = glm::mat4(1.0f);
-			model = glm::translate(model, cubePositions[i]);
-			float angle = 20.0f * i;
-			model = glm::rotate(model, glm::radians(angle), glm::vec3(0.5f, 0.7f, 0.0f));
-			ourShader.setMat4("model", model);
-			
-			glDrawArrays(GL_TRIANGLES, 0, 36);
+			pickAtCrosshair(picker, projection, view);
+			pickRequested = false;
+		}
+		cull(projection * view);
+		cubes.clear();
+		extract(cubes);
+		// Nothing in view: mapping zero bytes is an error, so skip the upload and draw
+		if (cubes.size() > 0)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+			float* instances = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, cubes.size() * sizeof(glm::mat4), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			if (instances)
+			{
+				cubes.writeModelMatrices(instances);
+				glUnmapBuffer(GL_ARRAY_BUFFER);
+			}
+
+			// Render box
+			glBindVertexArray(VAO); // not required here, because of only single VAO
+
+			glDrawElementsInstanced(GL_TRIANGLES, CubeMesh::IndexCount, GL_UNSIGNED_INT, 0, (GLsizei)cubes.size());
 		}
 
 		// Swap front and back buffers
 		glfwSwapBuffers(window);
-		// Poll for and process events
-		glfwPollEvents();
 	}
 
 	// Delete allocated resources
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &instanceVBO);
 	glDeleteBuffers(1, &EBO);
-
-	// Clear all previously allocated GLFW resources and terminate
-	glfwTerminate();
-	return 0;
 }
 
+// The callbacks run on the main thread: queue the event for the render thread.
+// None are dropped; see InputSender for what happens when the queue is full.
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	//	Setframebuffer callback function for resizing window 
-	glViewport(0, 0, width, height);
+	InputEvent e = { INPUT_RESIZE, glfwGetTime(), 0.0, 0.0, width, height };
+	inputSender.send(e);
 }
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 {
-	if (firstMouse) // this bool variable is initially set to true
-	{
-		lastX = xpos;
-		lastY = ypos;
-		firstMouse = false;
-	}
+	InputEvent e = { INPUT_CURSOR, glfwGetTime(), xpos, ypos, 0, 0 };
+	inputSender.send(e);
+}
 
-	float xoffset = xpos - lastX;
-	float yoffset = lastY - ypos; // reversed since y-coords range from bottom to top
-	lastX = xpos;
-	lastY = ypos;
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+	InputEvent e = { INPUT_SCROLL, glfwGetTime(), xoffset, yoffset, 0, 0 };
+	inputSender.send(e);
+}
 
-	camera.ProcessMouseMovement(xoffset, yoffset);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	InputEvent e = { INPUT_KEY, glfwGetTime(), 0.0, 0.0, key, action };
+	inputSender.send(e);
 }
 
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
-	camera.ProcessMouseScroll(yoffset);
+	InputEvent e = { INPUT_MOUSE_BUTTON, glfwGetTime(), 0.0, 0.0, button, action };
+	inputSender.send(e);
 }
 
 void processInput(GLFWwindow *window)
 {
+	//	Apply the events queued since the last call
+	InputEvent e;
+	while (input.pop(e))
+	{
+		switch (e.Type)
+		{
+		case INPUT_CURSOR:
+		{
+			if (firstMouse) // this bool variable is initially set to true
+			{
+				lastX = (float)e.X;
+				lastY = (float)e.Y;
+				firstMouse = false;
+			}
+
+			float xoffset = (float)e.X - lastX;
+			float yoffset = lastY - (float)e.Y; // reversed since y-coords range from bottom to top
+			lastX = (float)e.X;
+			lastY = (float)e.Y;
+
+			camera.ProcessMouseMovement(xoffset, yoffset);
+			break;
+		}
+		case INPUT_SCROLL:
+			camera.ProcessMouseScroll((float)e.Y);
+			break;
+		case INPUT_KEY:
+			if (e.Key >= 0 && e.Key <= GLFW_KEY_LAST)
+				keys[e.Key] = e.Action != GLFW_RELEASE;
+			if (e.Key == GLFW_KEY_F3 && e.Action == GLFW_PRESS)
+				printFrameStats();
+			break;
+		case INPUT_MOUSE_BUTTON:
+			if (e.Key == GLFW_MOUSE_BUTTON_LEFT && e.Action == GLFW_PRESS)
+				pickRequested = true;
+			break;
+		case INPUT_RESIZE:
+			glViewport(0, 0, e.Key, e.Action);
+			break;
+		}
+	}
+
 	//	Process inputs in the window
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+	if (keys[GLFW_KEY_ESCAPE])
+	{
 		glfwSetWindowShouldClose(window, true);
+		glfwPostEmptyEvent(); // wake the main thread so it sees it
+	}
+}
+
+void moveCamera(float step)
+{
+	//	One simulation step of keyboard movement
+	if (keys[GLFW_KEY_W])
+		camera.ProcessKeyboard(FORWARD, step);
+	if (keys[GLFW_KEY_S])
+		camera.ProcessKeyboard(BACKWARD, step);
+	if (keys[GLFW_KEY_A])
+		camera.ProcessKeyboard(LEFT, step);
+	if (keys[GLFW_KEY_D])
+		camera.ProcessKeyboard(RIGHT, step);
+}
 
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-		camera.ProcessKeyboard(FORWARD, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		camera.ProcessKeyboard(BACKWARD, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-		camera.ProcessKeyboard(LEFT, deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-		camera.ProcessKeyboard(RIGHT, deltaTime);
+void printFrameStats()
+{
+	//	F3: frame times over the last few seconds
+	FrameStats stats = timer.stats();
+	std::cout << "frame ms over " << stats.Frames << " frames: min " << stats.MinMs << ", avg " << stats.AvgMs
+		<< ", p99 " << stats.P99Ms << ", max " << stats.MaxMs << std::endl;
+}
+
+void animate(float seconds)
+{
+	//	Turn everything that spins
+	scene.each<Transform, const Spin>([seconds](Transform& transform, const Spin& spin)
+	{
+		transform.Rotation = glm::normalize(glm::angleAxis(spin.Speed * seconds, spin.Axis) * transform.Rotation);
+	});
+}
+
+void cull(const glm::mat4& viewProjection)
+{
+	//	Mark what's at least partly inside the view frustum
+	Frustum frustum(viewProjection);
+	scene.each<const Transform, Renderable>([&frustum](const Transform& transform, Renderable& renderable)
+	{
+		renderable.Visible = frustum.intersectsSphere(transform.Position, renderable.Radius);
+	});
+}
+
+void extract(TransformBatch& batch)
+{
+	//	Copy the visible objects' transforms out for drawing
+	scene.each<const Transform, const Renderable>([&batch](const Transform& transform, const Renderable& renderable)
+	{
+		if (renderable.Visible)
+			batch.add(transform.Position, transform.Rotation);
+	});
+}
+
+glm::mat4 modelMatrix(const Transform& transform)
+{
+	return glm::translate(glm::mat4(1.0f), transform.Position) * glm::mat4_cast(transform.Rotation);
+}
+
+void pickAtCrosshair(const Picker& picker, const glm::mat4& projection, const glm::mat4& view)
+{
+	//	Left click: report the box under the middle of the screen. The cursor
+	//	is captured for mouse look, so the middle is where it points.
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	PickRay ray = cursorRay(SCREEN_WIDTH / 2.0, SCREEN_HEIGHT / 2.0, SCREEN_WIDTH, SCREEN_HEIGHT, projection, view);
+	RayHit hit;
+	bool found = picker.pick(ray.Origin, ray.Direction, hit);
+	double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	if (found)
+		std::cout << "picked box " << hit.Object << " at distance " << hit.Distance << " (" << us << " us)" << std::endl;
+	else
+		std::cout << "nothing picked (" << us << " us)" << std::endl;
 }
\ No newline at end of file
@@ -0,0 +1,772 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "Frustum.h"
+
+// Four bounding boxes are tested at once: with SSE where the compiler may use
+// it (always on x64), otherwise with plain C++ doing the same thing.
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define BVH_SSE
+#include <xmmintrin.h>
+#endif
+
+// An axis-aligned bounding box
+struct Aabb
+{
+	glm::vec3 Min;
+	glm::vec3 Max;
+
+	static Aabb empty()
+	{
+		float inf = std::numeric_limits<float>::infinity();
+		Aabb box = { glm::vec3(inf), glm::vec3(-inf) };
+		return box;
+	}
+
+	void grow(const Aabb& other)
+	{
+		Min = glm::min(Min, other.Min);
+		Max = glm::max(Max, other.Max);
+	}
+
+	bool overlaps(const Aabb& other) const
+	{
+		return Min.x <= other.Max.x && other.Min.x <= Max.x
+			&& Min.y <= other.Max.y && other.Min.y <= Max.y
+			&& Min.z <= other.Max.z && other.Min.z <= Max.z;
+	}
+
+	// Half the surface area, which is all the SAH needs
+	float halfArea() const
+	{
+		glm::vec3 d = glm::max(Max - Min, glm::vec3(0.0f));
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+};
+
+// The nearest hit of a ray cast: which object, and how far along the ray, in
+// multiples of the direction's length
+struct RayHit
+{
+	std::uint32_t Object;
+	float Distance;
+};
+
+// A bounding volume hierarchy over the bounding boxes of objects 0 to n-1,
+// for finding what's in a frustum, under a ray or overlapping a box without
+// testing every object.
+//
+// build() sorts the boxes into a binary tree with the surface area heuristic,
+// then flattens it into nodes of four children whose bounds are stored one
+// array per coordinate, so a node's four boxes are tested together with SIMD.
+// Objects that move get new boxes with setBounds(); refit() then recomputes
+// the bounds of the nodes above them without changing the tree's shape, which
+// is cheap but makes the tree looser as objects wander. update() refits and rebuilds once the
+// tree has got that much worse than a fresh one.
+//
+//	Bvh bvh;
+//	bvh.build(boxes.data(), boxes.size());
+//	bvh.queryFrustum(Frustum(projection * view), [&](std::uint32_t object) { draw(object); });
+//	bvh.setBounds(moved, newBox);
+//	bvh.update();
+class Bvh
+{
+public:
+	Bvh()
+		: builtCost(0.0f), currentCost(0.0f), slotCost(0.0)
+	{
+	}
+
+	std::size_t size() const
+	{
+		return bounds.size();
+	}
+
+	const Aabb& getBounds(std::uint32_t object) const
+	{
+		return bounds[object];
+	}
+
+	// Builds the tree over 'count' boxes; object i is boxes[i]
+	void build(const Aabb* boxes, std::size_t count)
+	{
+		bounds.assign(boxes, boxes + count);
+		rebuild();
+	}
+
+	// Takes effect at the next refit(), update() or build
+	void setBounds(std::uint32_t object, const Aabb& box)
+	{
+		bounds[object] = box;
+		if (object < objectNodes.size())
+			markDirty(objectNodes[object]);
+	}
+
+	// Rebuilds the tree from the current boxes
+	void rebuild()
+	{
+		nodes.clear();
+		parents.clear();
+		objectNodes.resize(bounds.size());
+		objects.resize(bounds.size());
+		for (std::size_t i = 0; i < objects.size(); ++i)
+			objects[i] = (std::uint32_t)i;
+		if (objects.empty())
+		{
+			dirty.clear();
+			nodeDirty.clear();
+			builtCost = currentCost = 0.0f;
+			slotCost = 0.0;
+			return;
+		}
+
+		centroids.resize(bounds.size());
+		for (std::size_t i = 0; i < bounds.size(); ++i)
+			centroids[i] = (bounds[i].Min + bounds[i].Max) * 0.5f;
+		buildNodes.clear();
+		int root = split(0, (std::uint32_t)objects.size(), 0);
+
+		// a root that's a leaf still gets a node, with one child
+		nodes.push_back(Node());
+		parents.push_back(-1);
+		if (buildNodes[root].Left < 0)
+			setLeaf(0, 0, buildNodes[root]);
+		else
+			flatten(0, root);
+		buildNodes.clear();
+
+		nodeCosts.assign(nodes.size(), 0.0f);
+		nodeDirty.assign(nodes.size(), 0);
+		dirty.clear();
+		refitAll();
+		builtCost = currentCost;
+	}
+
+	// Recomputes the bounds of the nodes above objects given new boxes since
+	// the last refit: their leaves' nodes and those nodes' ancestors, deepest
+	// first. When that's a large part of the tree, refits all of it instead.
+	void refit()
+	{
+		if (dirty.empty())
+			return;
+		std::size_t leaves = dirty.size();
+		for (std::size_t d = 0; d < leaves; ++d)
+			for (int p = parents[dirty[d]]; p >= 0 && !nodeDirty[p]; p = parents[p])
+				markDirty(p);
+		if (dirty.size() * 4 > nodes.size())
+		{
+			refitAll();
+			return;
+		}
+
+		// a node's children always come after it, so higher indices are deeper
+		std::sort(dirty.begin(), dirty.end(), std::greater<std::int32_t>());
+		for (std::int32_t i : dirty)
+		{
+			float cost = refitNode(i);
+			slotCost += (double)cost - nodeCosts[i];
+			nodeCosts[i] = cost;
+			nodeDirty[i] = 0;
+		}
+		dirty.clear();
+		setCurrentCost();
+	}
+
+	// Refits, then rebuilds if the tree's SAH cost has grown past 'rebuildRatio'
+	// times what it was when built. Returns true if it rebuilt.
+	bool update(float rebuildRatio = 1.5f)
+	{
+		refit();
+		if (currentCost <= builtCost * rebuildRatio)
+			return false;
+		rebuild();
+		return true;
+	}
+
+	// Expected cost of a query through the tree, relative to testing the root:
+	// the area of every node and object box over the root's, summed
+	float cost() const
+	{
+		return currentCost;
+	}
+
+	// Calls f(object) for every object whose box overlaps 'box'
+	template <typename F>
+	void queryAabb(const Aabb& box, F f) const
+	{
+		if (nodes.empty())
+			return;
+		int stack[STACK_SIZE];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const Node& node = nodes[stack[--top]];
+			unsigned mask = Tests<Lanes>::overlap(node, box);
+			for (int k = 0; k < 4; ++k)
+			{
+				if (!(mask & (1u << k)))
+					continue;
+				if (node.Count[k] == 0)
+					stack[top++] = node.Child[k];
+				else
+					for (int j = 0; j < node.Count[k]; ++j)
+					{
+						std::uint32_t object = objects[node.Child[k] + j];
+						if (bounds[object].overlaps(box))
+							f(object);
+					}
+			}
+		}
+	}
+
+	// Calls f(object) for every object whose box is at least partly inside the
+	// frustum. Subtrees wholly inside are reported without testing further.
+	template <typename F>
+	void queryFrustum(const Frustum& frustum, F f) const
+	{
+		if (nodes.empty())
+			return;
+		int stack[STACK_SIZE];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const Node& node = nodes[stack[--top]];
+			unsigned inside;
+			unsigned mask = Tests<Lanes>::frustum(node, frustum, inside);
+			for (int k = 0; k < 4; ++k)
+			{
+				if (!(mask & (1u << k)))
+					continue;
+				if (inside & (1u << k))
+					reportAll(node, k, f);
+				else if (node.Count[k] == 0)
+					stack[top++] = node.Child[k];
+				else
+					for (int j = 0; j < node.Count[k]; ++j)
+					{
+						std::uint32_t object = objects[node.Child[k] + j];
+						if (boxInFrustum(bounds[object], frustum))
+							f(object);
+					}
+			}
+		}
+	}
+
+	// Finds the nearest object along the ray within maxDistance. hitDistance(object)
+	// is called for objects whose box the ray passes through and returns how far
+	// along the ray the object itself is hit, or a negative number for a miss.
+	template <typename F>
+	bool raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, F hitDistance, RayHit& hit) const
+	{
+		if (nodes.empty())
+			return false;
+		Ray ray(origin, direction);
+		float best = maxDistance;
+		bool found = false;
+
+		// each entry: a node, and how far along the ray its box starts
+		struct Entry
+		{
+			int Node;
+			float Near;
+		};
+		Entry stack[STACK_SIZE];
+		int top = 0;
+		stack[top].Node = 0;
+		stack[top++].Near = 0.0f;
+		while (top > 0)
+		{
+			Entry entry = stack[--top];
+			if (entry.Near > best)
+				continue;
+			const Node& node = nodes[entry.Node];
+			float nearest[4];
+			unsigned mask = Tests<Lanes>::ray(node, ray, best, nearest);
+
+			// push the hit children farthest first, so the nearest comes off next
+			int order[4], hits = 0;
+			for (int k = 0; k < 4; ++k)
+				if (mask & (1u << k))
+				{
+					int at = hits++;
+					for (; at > 0 && nearest[order[at - 1]] < nearest[k]; --at)
+						order[at] = order[at - 1];
+					order[at] = k;
+				}
+			for (int h = 0; h < hits; ++h)
+			{
+				int k = order[h];
+				if (node.Count[k] == 0)
+				{
+					stack[top].Node = node.Child[k];
+					stack[top++].Near = nearest[k];
+					continue;
+				}
+				for (int j = 0; j < node.Count[k]; ++j)
+				{
+					std::uint32_t object = objects[node.Child[k] + j];
+					float boxNear;
+					if (!ray.hits(bounds[object], best, boxNear))
+						continue;
+					float d = hitDistance(object);
+					if (d >= 0.0f && d <= best)
+					{
+						best = d;
+						hit.Object = object;
+						hit.Distance = d;
+						found = true;
+					}
+				}
+			}
+		}
+		return found;
+	}
+
+	// The nearest object box along the ray
+	bool raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, RayHit& hit) const
+	{
+		Ray ray(origin, direction);
+		return raycast(origin, direction, maxDistance, [&](std::uint32_t object)
+		{
+			float d;
+			return ray.hits(bounds[object], maxDistance, d) ? d : -1.0f;
+		}, hit);
+	}
+
+private:
+	enum { LEAF_SIZE = 4, BINS = 16, MAX_SAH_DEPTH = 48, STACK_SIZE = 256 };
+
+	// Four children. Count is -1 for an unused slot, 0 for a child node (Child
+	// is its index) and otherwise the number of objects in a leaf (Child is
+	// the first of them in 'objects'). Unused slots have empty bounds.
+	struct Node
+	{
+		float MinX[4], MinY[4], MinZ[4];
+		float MaxX[4], MaxY[4], MaxZ[4];
+		std::int32_t Child[4];
+		std::int32_t Count[4];
+
+		Node()
+		{
+			for (int k = 0; k < 4; ++k)
+			{
+				setSlot(k, Aabb::empty());
+				Child[k] = 0;
+				Count[k] = -1;
+			}
+		}
+
+		void setSlot(int k, const Aabb& box)
+		{
+			MinX[k] = box.Min.x; MinY[k] = box.Min.y; MinZ[k] = box.Min.z;
+			MaxX[k] = box.Max.x; MaxY[k] = box.Max.y; MaxZ[k] = box.Max.z;
+		}
+
+		Aabb bounds() const
+		{
+			Aabb box = Aabb::empty();
+			for (int k = 0; k < 4; ++k)
+				if (Count[k] >= 0)
+				{
+					Aabb slot = { glm::vec3(MinX[k], MinY[k], MinZ[k]), glm::vec3(MaxX[k], MaxY[k], MaxZ[k]) };
+					box.grow(slot);
+				}
+			return box;
+		}
+	};
+
+	// A binary tree node during the build; Left < 0 for a leaf
+	struct BuildNode
+	{
+		Aabb Box;
+		int Left, Right;
+		std::uint32_t First, Count;
+	};
+
+	// A ray, set up for slab tests: the reciprocal of the direction, and which
+	// side of a box each axis enters through
+	struct Ray
+	{
+		glm::vec3 Origin, Inverse;
+		bool Negative[3];
+
+		Ray(glm::vec3 origin, glm::vec3 direction)
+			: Origin(origin)
+		{
+			for (int a = 0; a < 3; ++a)
+			{
+				// a zero component would give 0 * infinity at the slab planes
+				float d = direction[a] != 0.0f ? direction[a] : 1e-30f;
+				Inverse[a] = 1.0f / d;
+				Negative[a] = d < 0.0f;
+			}
+		}
+
+		bool hits(const Aabb& box, float maxDistance, float& nearDistance) const
+		{
+			float tNear = 0.0f, tFar = maxDistance;
+			for (int a = 0; a < 3; ++a)
+			{
+				float t0 = ((Negative[a] ? box.Max[a] : box.Min[a]) - Origin[a]) * Inverse[a];
+				float t1 = ((Negative[a] ? box.Min[a] : box.Max[a]) - Origin[a]) * Inverse[a];
+				tNear = std::max(tNear, t0);
+				tFar = std::min(tFar, t1);
+			}
+			nearDistance = tNear;
+			return tNear <= tFar;
+		}
+	};
+
+	// Four floats, one per child slot
+	struct Scalar
+	{
+		struct V
+		{
+			float f[4];
+		};
+		static V load(const float* p) { V v = { { p[0], p[1], p[2], p[3] } }; return v; }
+		static V set1(float x) { V v = { { x, x, x, x } }; return v; }
+		static void store(float* p, V a) { for (int k = 0; k < 4; ++k) p[k] = a.f[k]; }
+		static V add(V a, V b) { for (int k = 0; k < 4; ++k) a.f[k] += b.f[k]; return a; }
+		static V sub(V a, V b) { for (int k = 0; k < 4; ++k) a.f[k] -= b.f[k]; return a; }
+		static V mul(V a, V b) { for (int k = 0; k < 4; ++k) a.f[k] *= b.f[k]; return a; }
+		static V min(V a, V b) { for (int k = 0; k < 4; ++k) a.f[k] = b.f[k] < a.f[k] ? b.f[k] : a.f[k]; return a; }
+		static V max(V a, V b) { for (int k = 0; k < 4; ++k) a.f[k] = b.f[k] > a.f[k] ? b.f[k] : a.f[k]; return a; }
+		// bit k set where a <= b
+		static unsigned lessEqual(V a, V b)
+		{
+			unsigned mask = 0;
+			for (int k = 0; k < 4; ++k)
+				mask |= (a.f[k] <= b.f[k] ? 1u : 0u) << k;
+			return mask;
+		}
+	};
+
+#if defined(BVH_SSE)
+	struct Sse
+	{
+		typedef __m128 V;
+		static V load(const float* p) { return _mm_loadu_ps(p); }
+		static V set1(float x) { return _mm_set1_ps(x); }
+		static void store(float* p, V a) { _mm_storeu_ps(p, a); }
+		static V add(V a, V b) { return _mm_add_ps(a, b); }
+		static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+		static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+		static V min(V a, V b) { return _mm_min_ps(a, b); }
+		static V max(V a, V b) { return _mm_max_ps(a, b); }
+		static unsigned lessEqual(V a, V b) { return (unsigned)_mm_movemask_ps(_mm_cmple_ps(a, b)); }
+	};
+	typedef Sse Lanes;
+#else
+	typedef Scalar Lanes;
+#endif
+
+	// The tests of a node's four child boxes; each returns a mask with bit k
+	// set for a hit on child k
+	template <typename S>
+	struct Tests
+	{
+		typedef typename S::V V;
+
+		static unsigned overlap(const Node& n, const Aabb& box)
+		{
+			return S::lessEqual(S::load(n.MinX), S::set1(box.Max.x)) & S::lessEqual(S::set1(box.Min.x), S::load(n.MaxX))
+				& S::lessEqual(S::load(n.MinY), S::set1(box.Max.y)) & S::lessEqual(S::set1(box.Min.y), S::load(n.MaxY))
+				& S::lessEqual(S::load(n.MinZ), S::set1(box.Max.z)) & S::lessEqual(S::set1(box.Min.z), S::load(n.MaxZ));
+		}
+
+		// Per plane, the box corner farthest along the normal decides if the box
+		// is outside and the nearest one if it's inside
+		static unsigned frustum(const Node& n, const Frustum& frustum, unsigned& inside)
+		{
+			V minX = S::load(n.MinX), minY = S::load(n.MinY), minZ = S::load(n.MinZ);
+			V maxX = S::load(n.MaxX), maxY = S::load(n.MaxY), maxZ = S::load(n.MaxZ);
+			V zero = S::set1(0.0f);
+			unsigned mask = S::lessEqual(minX, maxX); // used slots only
+			inside = mask;
+			for (const glm::vec4& p : frustum.Planes)
+			{
+				V x = S::set1(p.x), y = S::set1(p.y), z = S::set1(p.z), w = S::set1(p.w);
+				V ax = S::mul(x, minX), bx = S::mul(x, maxX);
+				V ay = S::mul(y, minY), by = S::mul(y, maxY);
+				V az = S::mul(z, minZ), bz = S::mul(z, maxZ);
+				V farthest = S::add(S::add(S::max(ax, bx), S::max(ay, by)), S::add(S::max(az, bz), w));
+				V nearest = S::add(S::add(S::min(ax, bx), S::min(ay, by)), S::add(S::min(az, bz), w));
+				mask &= S::lessEqual(zero, farthest);
+				inside &= S::lessEqual(zero, nearest);
+			}
+			inside &= mask;
+			return mask;
+		}
+
+		static unsigned ray(const Node& n, const Ray& r, float maxDistance, float nearest[4])
+		{
+			V ox = S::set1(r.Origin.x), oy = S::set1(r.Origin.y), oz = S::set1(r.Origin.z);
+			V ix = S::set1(r.Inverse.x), iy = S::set1(r.Inverse.y), iz = S::set1(r.Inverse.z);
+			V nearX = S::mul(S::sub(S::load(r.Negative[0] ? n.MaxX : n.MinX), ox), ix);
+			V farX = S::mul(S::sub(S::load(r.Negative[0] ? n.MinX : n.MaxX), ox), ix);
+			V nearY = S::mul(S::sub(S::load(r.Negative[1] ? n.MaxY : n.MinY), oy), iy);
+			V farY = S::mul(S::sub(S::load(r.Negative[1] ? n.MinY : n.MaxY), oy), iy);
+			V nearZ = S::mul(S::sub(S::load(r.Negative[2] ? n.MaxZ : n.MinZ), oz), iz);
+			V farZ = S::mul(S::sub(S::load(r.Negative[2] ? n.MinZ : n.MaxZ), oz), iz);
+			V tNear = S::max(S::max(nearX, nearY), S::max(nearZ, S::set1(0.0f)));
+			V tFar = S::min(S::min(farX, farY), S::min(farZ, S::set1(maxDistance)));
+			S::store(nearest, tNear);
+			return S::lessEqual(tNear, tFar);
+		}
+	};
+
+	std::vector<Aabb> bounds;				// by object
+	std::vector<std::uint32_t> objects;		// object ids, leaf by leaf
+	std::vector<Node> nodes;				// root first
+	std::vector<std::int32_t> parents;		// by node, -1 for the root
+	std::vector<std::int32_t> objectNodes;	// by object, the node of its leaf
+	float builtCost, currentCost;
+
+	// refit state: what each node adds to the cost, and the nodes to refit
+	std::vector<float> nodeCosts;
+	double slotCost;						// the sum of nodeCosts
+	std::vector<std::int32_t> dirty;
+	std::vector<std::uint8_t> nodeDirty;
+
+	// build scratch
+	std::vector<glm::vec3> centroids;
+	std::vector<BuildNode> buildNodes;
+
+	void markDirty(std::int32_t node)
+	{
+		if (nodeDirty[node])
+			return;
+		nodeDirty[node] = 1;
+		dirty.push_back(node);
+	}
+
+	// Sets the bounds of a node's slots from what's below them, which must be
+	// up to date, and returns the node's part of the cost
+	float refitNode(std::int32_t i)
+	{
+		Node& node = nodes[i];
+		float cost = 0.0f;
+		for (int k = 0; k < 4; ++k)
+		{
+			if (node.Count[k] < 0)
+				continue;
+			Aabb box = Aabb::empty();
+			if (node.Count[k] > 0)
+			{
+				for (int j = 0; j < node.Count[k]; ++j)
+					box.grow(bounds[objects[node.Child[k] + j]]);
+				cost += box.halfArea() * node.Count[k];
+			}
+			else
+			{
+				box = nodes[node.Child[k]].bounds();
+				cost += box.halfArea();
+			}
+			node.setSlot(k, box);
+		}
+		return cost;
+	}
+
+	// Refits every node, bottom up: the children of a node always come after
+	// it, so one backwards pass does
+	void refitAll()
+	{
+		slotCost = 0.0;
+		for (std::size_t i = nodes.size(); i-- > 0;)
+		{
+			nodeCosts[i] = refitNode((std::int32_t)i);
+			slotCost += nodeCosts[i];
+			nodeDirty[i] = 0;
+		}
+		dirty.clear();
+		setCurrentCost();
+	}
+
+	void setCurrentCost()
+	{
+		float rootArea = nodes.empty() ? 0.0f : nodes[0].bounds().halfArea();
+		currentCost = rootArea > 0.0f ? (float)(slotCost / rootArea) : 0.0f;
+	}
+
+	static bool boxInFrustum(const Aabb& box, const Frustum& frustum)
+	{
+		for (const glm::vec4& p : frustum.Planes)
+		{
+			glm::vec3 n(p);
+			glm::vec3 farthest(n.x >= 0.0f ? box.Max.x : box.Min.x, n.y >= 0.0f ? box.Max.y : box.Min.y, n.z >= 0.0f ? box.Max.z : box.Min.z);
+			if (glm::dot(n, farthest) + p.w < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	// Every object below slot k of the node
+	template <typename F>
+	void reportAll(const Node& node, int k, F& f) const
+	{
+		if (node.Count[k] > 0)
+		{
+			for (int j = 0; j < node.Count[k]; ++j)
+				f(objects[node.Child[k] + j]);
+			return;
+		}
+		const Node& child = nodes[node.Child[k]];
+		for (int c = 0; c < 4; ++c)
+			if (child.Count[c] >= 0)
+				reportAll(child, c, f);
+	}
+
+	// Builds the binary tree over objects[first, first + count) and returns
+	// its root. Splits by binned SAH; past MAX_SAH_DEPTH, at the median, which
+	// bounds the depth and so the traversal stacks.
+	int split(std::uint32_t first, std::uint32_t count, int depth)
+	{
+		BuildNode node;
+		node.Box = Aabb::empty();
+		Aabb centroidBox = Aabb::empty();
+		for (std::uint32_t i = first; i < first + count; ++i)
+		{
+			node.Box.grow(bounds[objects[i]]);
+			Aabb c = { centroids[objects[i]], centroids[objects[i]] };
+			centroidBox.grow(c);
+		}
+		node.Left = node.Right = -1;
+		node.First = first;
+		node.Count = count;
+		int index = (int)buildNodes.size();
+		buildNodes.push_back(node);
+
+		glm::vec3 extent = centroidBox.Max - centroidBox.Min;
+		int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		if (count <= LEAF_SIZE || extent[axis] <= 0.0f)
+			return index;
+
+		std::uint32_t* begin = &objects[first];
+		std::uint32_t* end = begin + count;
+		std::uint32_t* middle = NULL;
+		if (depth < MAX_SAH_DEPTH)
+		{
+			float lo = centroidBox.Min[axis], scale = BINS / extent[axis] * 0.9999f;
+			Aabb binBox[BINS];
+			std::uint32_t binCount[BINS] = {};
+			for (int b = 0; b < BINS; ++b)
+				binBox[b] = Aabb::empty();
+			for (std::uint32_t* o = begin; o != end; ++o)
+			{
+				int b = (int)((centroids[*o][axis] - lo) * scale);
+				binBox[b].grow(bounds[*o]);
+				++binCount[b];
+			}
+
+			// cost of splitting after bin b: left area * count + right area * count
+			float leftCost[BINS];
+			Aabb box = Aabb::empty();
+			std::uint32_t n = 0;
+			for (int b = 0; b < BINS - 1; ++b)
+			{
+				box.grow(binBox[b]);
+				n += binCount[b];
+				leftCost[b] = n ? box.halfArea() * n : 0.0f;
+			}
+			box = Aabb::empty();
+			n = 0;
+			int bestBin = -1;
+			float bestCost = std::numeric_limits<float>::infinity();
+			for (int b = BINS - 1; b > 0; --b)
+			{
+				box.grow(binBox[b]);
+				n += binCount[b];
+				float c = leftCost[b - 1] + (n ? box.halfArea() * n : 0.0f);
+				if (n > 0 && n < count && c < bestCost)
+				{
+					bestCost = c;
+					bestBin = b;
+				}
+			}
+			if (bestBin > 0)
+				middle = std::partition(begin, end, [&](std::uint32_t o)
+				{
+					return (int)((centroids[o][axis] - lo) * scale) < bestBin;
+				});
+		}
+		if (!middle)
+		{
+			middle = begin + count / 2;
+			std::nth_element(begin, middle, end, [&](std::uint32_t a, std::uint32_t b)
+			{
+				return centroids[a][axis] < centroids[b][axis];
+			});
+		}
+
+		std::uint32_t leftCount = (std::uint32_t)(middle - begin);
+		int left = split(first, leftCount, depth + 1);
+		int right = split(first + leftCount, count - leftCount, depth + 1);
+		buildNodes[index].Left = left;
+		buildNodes[index].Right = right;
+		return index;
+	}
+
+	void setLeaf(int node, int k, const BuildNode& leaf)
+	{
+		nodes[node].Child[k] = (std::int32_t)leaf.First;
+		nodes[node].Count[k] = (std::int32_t)leaf.Count;
+		for (std::uint32_t j = 0; j < leaf.Count; ++j)
+			objectNodes[objects[leaf.First + j]] = node;
+	}
+
+	// Fills nodes[node] from binary node 'from', taking up to four of its
+	// descendants as children: the binary children, then opening the largest
+	// inner one until there are four
+	void flatten(int node, int from)
+	{
+		int children[4] = { buildNodes[from].Left, buildNodes[from].Right };
+		int count = 2;
+		while (count < 4)
+		{
+			int open = -1;
+			float largest = -1.0f;
+			for (int c = 0; c < count; ++c)
+			{
+				const BuildNode& b = buildNodes[children[c]];
+				if (b.Left >= 0 && b.Box.halfArea() > largest)
+				{
+					largest = b.Box.halfArea();
+					open = c;
+				}
+			}
+			if (open < 0)
+				break;
+			int opened = children[open];
+			children[open] = buildNodes[opened].Left;
+			children[count++] = buildNodes[opened].Right;
+		}
+
+		for (int k = 0; k < count; ++k)
+		{
+			const BuildNode& child = buildNodes[children[k]];
+			if (child.Left < 0)
+				setLeaf(node, k, child);
+			else
+			{
+				// nodes may reallocate: index, don't hold references
+				int index = (int)nodes.size();
+				nodes.push_back(Node());
+				parents.push_back(node);
+				nodes[node].Child[k] = index;
+				nodes[node].Count[k] = 0;
+				flatten(index, children[k]);
+			}
+		}
+	}
+};
@@ -3,6 +3,7 @@
 #include <glad/glad.h> // to get all opengl headers
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include <vector>
 
@@ -31,6 +32,8 @@ public:
 	glm::vec3 Up;
 	glm::vec3 Right;
 	glm::vec3 WorldUp;
+	// Orientation, rebuilt from the Euler angles once per frame
+	glm::quat Orientation;
 	// Euler Angles
 	float Yaw;
 	float Pitch;
@@ -61,15 +64,42 @@ public:
 		updateCameraVectors();
 	}
 
-	// Returns the view matrix calculated using Eular Angles and the LookAt Matrix
+	// Returns the view matrix: the inverse of the camera's rotation and translation.
+	// Same result as glm::lookAt(Position, Position + Front, Up), but the axes come
+	// straight from the orientation, so there are no cross products or normalizes.
 	glm::mat4 GetViewMatrix()
 	{
-		return glm::lookAt(Position, Position + Front, Up);
+		return GetViewMatrix(Position);
+	}
+
+	// The view matrix from another eye position, such as one interpolated between
+	// two simulation steps
+	glm::mat4 GetViewMatrix(glm::vec3 eye)
+	{
+		Update();
+		glm::mat4 view(1.0f);
+		view[0][0] = Right.x; view[1][0] = Right.y; view[2][0] = Right.z;
+		view[0][1] = Up.x;    view[1][1] = Up.y;    view[2][1] = Up.z;
+		view[0][2] = -Front.x; view[1][2] = -Front.y; view[2][2] = -Front.z;
+		view[3][0] = -glm::dot(Right, eye);
+		view[3][1] = -glm::dot(Up, eye);
+		view[3][2] = glm::dot(Front, eye);
+		return view;
+	}
+
+	// Applies the mouse movement received since the last call. Call once per frame,
+	// after polling events; GetViewMatrix and ProcessKeyboard call it as well, so
+	// the vectors are never stale.
+	void Update()
+	{
+		if (dirty)
+			updateCameraVectors();
 	}
 
 	// Process keyboard movements on input
 	void ProcessKeyboard(Camera_Movement direction, float deltaTime)
 	{
+		Update();
 		float velocity = MovementSpeed * deltaTime;
 		if (direction == FORWARD)
 			Position += Front * velocity;
@@ -81,7 +111,8 @@ public:
 			Position += Right * velocity;
 	}
 
-	// Process mouse movements on input
+	// Process mouse movements on input. Mice can report at 1000Hz or more, so this
+	// only accumulates the angles; the vectors are rebuilt once in Update.
 	void ProcessMouseMovement(float xoffset, float yoffset, GLboolean constrainPitch = true)
 	{
 		xoffset *= MouseSensitivity;
@@ -98,8 +129,8 @@ public:
 			if (Pitch < -89.0f)
 				Pitch = -89.0f;
 		}
-		
-		updateCameraVectors();
+
+		dirty = true;
 	}
 
 	// Process scroll mouse movements on input
@@ -114,15 +145,21 @@ public:
 	}
 
 private:
+	bool dirty;
+
 	void updateCameraVectors()
 	{
-		// Calculate new Front vector using Euler angles
-		glm::vec3 front;
-		front.x = cos(glm::radians(Yaw)) * cos(glm::radians(Pitch));
-		front.y = sin(glm::radians(Pitch));
-		front.z = sin(glm::radians(Yaw)) * cos(glm::radians(Pitch));
-		// Calculate Up and Right vector
-		Right = glm::normalize(glm::cross(Front, WorldUp)); // Normalize the vectors, because their length gets closer to 0 the more you look up or down which results in slower movement.
-		Up = glm::normalize(glm::cross(Right, Front));
+		// Yaw turns about the world up axis and pitch about the camera's own right
+		// axis, starting from a camera looking down -Z (which is a yaw of -90).
+		glm::quat yaw = glm::angleAxis(glm::radians(-90.0f - Yaw), glm::normalize(WorldUp));
+		glm::quat pitch = glm::angleAxis(glm::radians(Pitch), glm::vec3(1.0f, 0.0f, 0.0f));
+		Orientation = yaw * pitch;
+		// The rotated camera axes are the columns of the rotation matrix, and
+		// already unit length
+		glm::mat3 axes = glm::mat3_cast(Orientation);
+		Right = axes[0];
+		Up = axes[1];
+		Front = -axes[2];
+		dirty = false;
 	}
 };
@@ -0,0 +1,444 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "WorkerPool.h"
+
+// A handle to an entity. The generation changes when a destroyed entity's
+// index is reused, so old handles stop being alive() instead of pointing at
+// the new entity.
+struct Entity
+{
+	std::uint32_t Index;
+	std::uint32_t Generation;
+};
+
+// Entities and their components, stored by archetype.
+//
+// An archetype is one combination of component types. Its entities are kept
+// in 16KB chunks, and inside a chunk each component type is a column: all the
+// positions, then all the rotations and so on, plus a column of the entities
+// themselves. A query visits the archetypes that have the components asked for
+// and walks their columns front to back, so it only touches the data it uses,
+// in order. Adding or removing a component moves the entity to another
+// archetype; destroying one moves the last entity of its archetype into the
+// gap, so chunks stay packed.
+//
+// Components are plain structs (copied with memcpy, no constructors run), up
+// to 64 types per program.
+//
+//	EntityWorld world;
+//	Entity e = world.create(Transform{ position, rotation }, Spin{ axis, 1.0f });
+//	world.each<Transform, const Spin>([&](Transform& t, const Spin& s)
+//	{
+//		t.Rotation = glm::angleAxis(s.Speed * dt, s.Axis) * t.Rotation;
+//	});
+//
+// Queries may change component values but not create, destroy, add or remove:
+// that would move entities under the query's feet.
+class EntityWorld
+{
+public:
+	enum { CHUNK_BYTES = 16 * 1024, MAX_COMPONENTS = 64 };
+
+	EntityWorld()
+		: live(0)
+	{
+		findArchetype(0, NULL, 0); // entities without components
+	}
+
+	EntityWorld(const EntityWorld&) = delete;
+	EntityWorld& operator=(const EntityWorld&) = delete;
+
+	// Number of live entities
+	std::size_t size() const
+	{
+		return live;
+	}
+
+	// Creates an entity with the given components (none is fine)
+	template <typename... C>
+	Entity create(const C&... components)
+	{
+		Column columns[] = { Column(), columnFor<C>()... };
+		Archetype& type = findArchetype(maskOf<C...>(), columns + 1, sizeof...(C));
+
+		Entity e;
+		if (freeIndices.empty())
+		{
+			e.Index = (std::uint32_t)records.size();
+			e.Generation = 0;
+			records.push_back(Record());
+		}
+		else
+		{
+			e.Index = freeIndices.back();
+			freeIndices.pop_back();
+			e.Generation = records[e.Index].Generation;
+		}
+		Record& r = records[e.Index];
+		r.Generation = e.Generation;
+		place(e, type);
+		int unused[] = { 0, (*component<C>(r) = components, 0)... };
+		(void)unused;
+		++live;
+		return e;
+	}
+
+	void destroy(Entity e)
+	{
+		if (!alive(e))
+			return;
+		Record& r = records[e.Index];
+		removeRow(*r.Type, r.Chunk, r.Row);
+		r.Type = NULL;
+		++r.Generation;
+		freeIndices.push_back(e.Index);
+		--live;
+	}
+
+	bool alive(Entity e) const
+	{
+		return e.Index < records.size() && records[e.Index].Type && records[e.Index].Generation == e.Generation;
+	}
+
+	template <typename T>
+	bool has(Entity e) const
+	{
+		return alive(e) && (records[e.Index].Type->Mask & bit<T>()) != 0;
+	}
+
+	// The entity's T, or NULL if it has none. Valid until the next structural
+	// change (create, destroy, add, remove).
+	template <typename T>
+	T* get(Entity e)
+	{
+		if (!has<T>(e))
+			return NULL;
+		return component<T>(records[e.Index]);
+	}
+
+	// Adds a T to the entity, or overwrites the one it has
+	template <typename T>
+	void add(Entity e, const T& value)
+	{
+		if (!alive(e))
+			return;
+		Record& r = records[e.Index];
+		if (!(r.Type->Mask & bit<T>()))
+		{
+			std::vector<Column> columns(r.Type->Columns);
+			columns.push_back(columnFor<T>());
+			move(e, findArchetype(r.Type->Mask | bit<T>(), columns.data(), columns.size()));
+		}
+		*component<T>(r) = value;
+	}
+
+	template <typename T>
+	void remove(Entity e)
+	{
+		if (!has<T>(e))
+			return;
+		Record& r = records[e.Index];
+		std::vector<Column> columns;
+		for (const Column& c : r.Type->Columns)
+			if (c.Id != componentId<T>())
+				columns.push_back(c);
+		move(e, findArchetype(r.Type->Mask & ~bit<T>(), columns.data(), columns.size()));
+	}
+
+	// Calls f(count, a, b, ...) for every chunk of entities that have all of
+	// the components C, where a, b, ... point to the chunk's first C of each
+	// type and count is how many follow. Entity works as a (read only)
+	// component too, for the handles. Ask for const C to say a query only reads C.
+	template <typename... C, typename F>
+	void eachChunk(F f)
+	{
+		std::uint64_t mask = maskOf<C...>();
+		for (const std::unique_ptr<Archetype>& type : archetypes)
+			if ((type->Mask & mask) == mask)
+				for (const std::unique_ptr<Chunk>& chunk : type->Chunks)
+					f(chunk->Count, column<C>(*type, *chunk)...);
+	}
+
+	// Calls f(a, b, ...) with references to the components of every entity
+	// that has all of C
+	template <typename... C, typename F>
+	void each(F f)
+	{
+		eachChunk<C...>([&](std::size_t count, C*... columns)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+				f(columns[i]...);
+		});
+	}
+
+	// As eachChunk, with the chunks shared out over the pool's threads. f is
+	// called concurrently, so it may only write to the chunk it was given.
+	template <typename... C, typename F>
+	void parallelEachChunk(WorkerPool& pool, F f)
+	{
+		std::uint64_t mask = maskOf<C...>();
+		std::vector<std::pair<Archetype*, Chunk*> > chunks;
+		for (const std::unique_ptr<Archetype>& type : archetypes)
+			if ((type->Mask & mask) == mask)
+				for (const std::unique_ptr<Chunk>& chunk : type->Chunks)
+					chunks.push_back(std::make_pair(type.get(), chunk.get()));
+		pool.run(chunks.size(), 1, [&](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t i = begin; i < end; ++i)
+				f(chunks[i].second->Count, column<C>(*chunks[i].first, *chunks[i].second)...);
+		});
+	}
+
+	template <typename... C, typename F>
+	void parallelEach(WorkerPool& pool, F f)
+	{
+		parallelEachChunk<C...>(pool, [&](std::size_t count, C*... columns)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+				f(columns[i]...);
+		});
+	}
+
+	// Component type ids, handed out on first use. A type's id is the same
+	// whether it's asked for as T or const T.
+	template <typename T>
+	static unsigned componentId()
+	{
+		typedef typename std::remove_const<T>::type Type;
+		static_assert(std::is_trivially_copyable<Type>::value, "components are copied with memcpy");
+		static_assert(alignof(Type) <= 16 && sizeof(Type) <= CHUNK_BYTES / 16, "component too large for a chunk");
+		return typeId<Type>();
+	}
+
+private:
+	// One component type in an archetype, and where its column starts in a chunk
+	struct Column
+	{
+		unsigned Id;
+		std::size_t Size, Align, Offset;
+	};
+
+	struct Chunk
+	{
+		std::size_t Count;
+		alignas(16) unsigned char Data[CHUNK_BYTES];
+	};
+
+	struct Archetype
+	{
+		std::uint64_t Mask;
+		std::vector<Column> Columns;
+		std::size_t Offset[MAX_COMPONENTS];	// of each column, by component id
+		std::size_t Capacity;				// entities per chunk
+		std::vector<std::unique_ptr<Chunk> > Chunks; // all full but the last
+	};
+
+	// Where an entity lives
+	struct Record
+	{
+		Archetype* Type;
+		std::uint32_t Chunk, Row, Generation;
+
+		Record()
+			: Type(NULL), Chunk(0), Row(0), Generation(0)
+		{
+		}
+	};
+
+	std::vector<std::unique_ptr<Archetype> > archetypes;
+	std::unordered_map<std::uint64_t, Archetype*> byMask;
+	std::vector<Record> records;			// by entity index
+	std::vector<std::uint32_t> freeIndices;
+	std::size_t live;
+
+	template <typename T>
+	static unsigned typeId()
+	{
+		static const unsigned id = nextTypeId();
+		return id;
+	}
+
+	static unsigned nextTypeId()
+	{
+		static std::atomic<unsigned> next(0);
+		unsigned id = next++;
+		// masks are 64 bits, so another type would alias an existing one
+		assert(id < MAX_COMPONENTS && "EntityWorld: too many component types");
+		if (id >= MAX_COMPONENTS)
+		{
+			std::cerr << "EntityWorld: more than " << (int)MAX_COMPONENTS << " component types" << std::endl;
+			std::abort();
+		}
+		return id;
+	}
+
+	template <typename T>
+	static std::uint64_t bit()
+	{
+		return std::uint64_t(1) << componentId<T>();
+	}
+
+	// Entity isn't a real component: every archetype has it, first in the chunk
+	template <typename T>
+	static std::uint64_t maskBit(std::false_type)
+	{
+		return bit<T>();
+	}
+
+	template <typename T>
+	static std::uint64_t maskBit(std::true_type)
+	{
+		return 0;
+	}
+
+	template <typename... C>
+	static std::uint64_t maskOf()
+	{
+		std::uint64_t bits[] = { 0, maskBit<C>(std::is_same<typename std::remove_const<C>::type, Entity>())... };
+		std::uint64_t mask = 0;
+		for (std::uint64_t b : bits)
+			mask |= b;
+		return mask;
+	}
+
+	template <typename T>
+	static std::size_t offsetOf(const Archetype& type, std::false_type)
+	{
+		return type.Offset[componentId<T>()];
+	}
+
+	template <typename T>
+	static std::size_t offsetOf(const Archetype&, std::true_type)
+	{
+		return 0;
+	}
+
+	template <typename T>
+	static T* column(const Archetype& type, Chunk& chunk)
+	{
+		return (T*)(chunk.Data + offsetOf<T>(type, std::is_same<typename std::remove_const<T>::type, Entity>()));
+	}
+
+	template <typename T>
+	T* component(const Record& r)
+	{
+		return column<T>(*r.Type, *r.Type->Chunks[r.Chunk]) + r.Row;
+	}
+
+	template <typename T>
+	static Column columnFor()
+	{
+		Column c = { componentId<T>(), sizeof(T), alignof(T), 0 };
+		return c;
+	}
+
+	static std::size_t alignUp(std::size_t n, std::size_t align)
+	{
+		return (n + align - 1) / align * align;
+	}
+
+	Archetype& findArchetype(std::uint64_t mask, const Column* columns, std::size_t count)
+	{
+		std::unordered_map<std::uint64_t, Archetype*>::iterator found = byMask.find(mask);
+		if (found != byMask.end())
+			return *found->second;
+
+		std::unique_ptr<Archetype> type(new Archetype());
+		type->Mask = mask;
+		type->Columns.assign(columns, columns + count);
+		std::memset(type->Offset, 0, sizeof(type->Offset));
+
+		// as many entities per chunk as fit once every column is aligned
+		std::size_t perEntity = sizeof(Entity);
+		for (const Column& c : type->Columns)
+			perEntity += c.Size;
+		for (type->Capacity = CHUNK_BYTES / perEntity; ; --type->Capacity)
+		{
+			std::size_t end = type->Capacity * sizeof(Entity);
+			for (Column& c : type->Columns)
+			{
+				c.Offset = alignUp(end, c.Align);
+				end = c.Offset + type->Capacity * c.Size;
+			}
+			if (end <= CHUNK_BYTES)
+				break;
+		}
+		// each component fits on its own, but together they may not fit even once,
+		// and place() would then fill chunks that hold nothing
+		assert(type->Capacity > 0 && "EntityWorld: entity too large for a chunk");
+		if (type->Capacity == 0)
+		{
+			std::cerr << "EntityWorld: an entity of " << perEntity << " bytes doesn't fit in a " << (int)CHUNK_BYTES << "-byte chunk" << std::endl;
+			std::abort();
+		}
+		for (const Column& c : type->Columns)
+			type->Offset[c.Id] = c.Offset;
+
+		Archetype* result = type.get();
+		archetypes.push_back(std::move(type));
+		byMask[mask] = result;
+		return *result;
+	}
+
+	// Appends the entity to the archetype's last chunk and points its record there
+	void place(Entity e, Archetype& type)
+	{
+		if (type.Chunks.empty() || type.Chunks.back()->Count == type.Capacity)
+		{
+			type.Chunks.push_back(std::unique_ptr<Chunk>(new Chunk()));
+			type.Chunks.back()->Count = 0;
+		}
+		Chunk& chunk = *type.Chunks.back();
+		Record& r = records[e.Index];
+		r.Type = &type;
+		r.Chunk = (std::uint32_t)(type.Chunks.size() - 1);
+		r.Row = (std::uint32_t)chunk.Count++;
+		column<Entity>(type, chunk)[r.Row] = e;
+	}
+
+	// Moves the archetype's last entity into the row, dropping the row's entity
+	void removeRow(Archetype& type, std::uint32_t chunkIndex, std::uint32_t row)
+	{
+		Chunk& chunk = *type.Chunks[chunkIndex];
+		Chunk& last = *type.Chunks.back();
+		std::size_t lastRow = last.Count - 1;
+		if (&chunk != &last || row != lastRow)
+		{
+			Entity moved = column<Entity>(type, last)[lastRow];
+			column<Entity>(type, chunk)[row] = moved;
+			for (const Column& c : type.Columns)
+				std::memcpy(chunk.Data + c.Offset + row * c.Size, last.Data + c.Offset + lastRow * c.Size, c.Size);
+			records[moved.Index].Chunk = chunkIndex;
+			records[moved.Index].Row = row;
+		}
+		if (--last.Count == 0)
+			type.Chunks.pop_back();
+	}
+
+	// Moves an entity to another archetype, keeping the components both have
+	void move(Entity e, Archetype& to)
+	{
+		Record& r = records[e.Index];
+		Archetype& from = *r.Type;
+		const Chunk& source = *from.Chunks[r.Chunk];
+		std::uint32_t chunkIndex = r.Chunk, row = r.Row;
+		place(e, to);
+		Chunk& target = *to.Chunks[r.Chunk];
+		for (const Column& c : to.Columns)
+			if (from.Mask & (std::uint64_t(1) << c.Id))
+				std::memcpy(target.Data + c.Offset + r.Row * c.Size, source.Data + from.Offset[c.Id] + row * c.Size, c.Size);
+		removeRow(from, chunkIndex, row);
+	}
+};
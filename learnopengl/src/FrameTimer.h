@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+// Frame times over the last FrameTimer::HISTORY frames, in milliseconds.
+struct FrameStats
+{
+	double MinMs;
+	double AvgMs;
+	double P99Ms;
+	double MaxMs;
+	int Frames;
+};
+
+// Frame timing with a fixed simulation step.
+//
+// Time is kept as 64-bit nanosecond counts from the steady (monotonic) clock,
+// so it stays exact however long the program runs; a float of seconds, like
+// glfwGetTime() stored in a float, is already down to millisecond steps after
+// a few hours. Each frame:
+//
+//	timer.beginFrame();
+//	while (timer.step())
+//		simulate(timer.StepSeconds);
+//	render(timer.alpha()); // blend the last two simulated states
+//
+// A frame that takes longer than the spike limit (a breakpoint, a window
+// drag, a slow load) counts as the limit, so the simulation doesn't try to
+// catch up all at once.
+class FrameTimer
+{
+public:
+	static const int HISTORY = 256;
+
+	// Length of one simulation step
+	double StepSeconds;
+
+	FrameTimer(double stepsPerSecond = 60.0, double maxFrameSeconds = 0.25)
+		: StepSeconds(1.0 / stepsPerSecond),
+		  stepNs((int64_t)(1e9 / stepsPerSecond)),
+		  maxFrameNs((int64_t)(maxFrameSeconds * 1e9)),
+		  totalNs(0), historyCount(0), historyNext(0)
+	{
+		reset();
+	}
+
+	// Starts timing from now, e.g. after loading, without a catch-up
+	void reset()
+	{
+		last = Clock::now();
+		accumulatorNs = 0;
+		frameNs = 0;
+	}
+
+	// Call once at the start of every frame
+	void beginFrame()
+	{
+		Clock::time_point now = Clock::now();
+		frameNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+		last = now;
+		totalNs += frameNs;
+		accumulatorNs += std::min(frameNs, maxFrameNs);
+
+		history[historyNext] = frameNs;
+		historyNext = (historyNext + 1) % HISTORY;
+		if (historyCount < HISTORY)
+			++historyCount;
+	}
+
+	// True, once for each simulation step that is due this frame
+	bool step()
+	{
+		if (accumulatorNs < stepNs)
+			return false;
+		accumulatorNs -= stepNs;
+		return true;
+	}
+
+	// How far the frame is between the last simulation step and the next, 0 to 1
+	float alpha() const
+	{
+		return (float)((double)accumulatorNs / (double)stepNs);
+	}
+
+	// Real length of the last frame, before the spike limit
+	double frameSeconds() const
+	{
+		return frameNs * 1e-9;
+	}
+
+	// Time measured by beginFrame since the timer was made
+	double totalSeconds() const
+	{
+		return totalNs * 1e-9;
+	}
+
+	FrameStats stats() const
+	{
+		FrameStats s = { 0.0, 0.0, 0.0, 0.0, historyCount };
+		if (historyCount == 0)
+			return s;
+		int64_t sorted[HISTORY];
+		std::copy(history, history + historyCount, sorted);
+		std::sort(sorted, sorted + historyCount);
+		int64_t sum = 0;
+		for (int i = 0; i < historyCount; ++i)
+			sum += sorted[i];
+		s.MinMs = sorted[0] * 1e-6;
+		s.AvgMs = (double)sum / historyCount * 1e-6;
+		s.P99Ms = sorted[(historyCount * 99 + 99) / 100 - 1] * 1e-6;
+		s.MaxMs = sorted[historyCount - 1] * 1e-6;
+		return s;
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point last;
+	int64_t stepNs;
+	int64_t maxFrameNs;
+	int64_t totalNs;
+	int64_t accumulatorNs;
+	int64_t frameNs;
+
+	// Ring of the last HISTORY frame times
+	int64_t history[HISTORY];
+	int historyCount;
+	int historyNext;
+};
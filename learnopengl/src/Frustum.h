@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// The six planes of a view frustum, taken from a projection * view matrix
+// (Gribb and Hartmann). Each plane is (normal, distance) with the normal
+// pointing inwards, so a point p is inside when dot(normal, p) + distance >= 0
+// for all six.
+struct Frustum
+{
+	glm::vec4 Planes[6]; // left, right, bottom, top, near, far
+
+	explicit Frustum(const glm::mat4& viewProjection)
+	{
+		// rows of the matrix; glm indexes columns first
+		glm::vec4 row[4];
+		for (int r = 0; r < 4; ++r)
+			row[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+		Planes[0] = row[3] + row[0];
+		Planes[1] = row[3] - row[0];
+		Planes[2] = row[3] + row[1];
+		Planes[3] = row[3] - row[1];
+		Planes[4] = row[3] + row[2];
+		Planes[5] = row[3] - row[2];
+		for (glm::vec4& p : Planes)
+			p /= glm::length(glm::vec3(p));
+	}
+
+	// False only if the sphere is wholly outside one of the planes
+	bool intersectsSphere(glm::vec3 center, float radius) const
+	{
+		for (const glm::vec4& p : Planes)
+			if (glm::dot(glm::vec3(p), center) + p.w < -radius)
+				return false;
+		return true;
+	}
+};
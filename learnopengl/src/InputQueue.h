@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+
+// Kinds of window input passed from the event thread to the render thread.
+enum Input_Type
+{
+	INPUT_CURSOR,	// x, y: cursor position in screen coordinates
+	INPUT_SCROLL,	// y: scroll offset
+	INPUT_KEY,		// key, action: GLFW key code and GLFW_PRESS/REPEAT/RELEASE
+	INPUT_MOUSE_BUTTON,	// key, action: GLFW mouse button and GLFW_PRESS/RELEASE
+	INPUT_RESIZE	// key, action: new framebuffer width and height
+};
+
+struct InputEvent
+{
+	Input_Type Type;
+	double Time;	// glfwGetTime() when the event arrived
+	double X, Y;
+	int Key, Action;
+};
+
+// Fixed-size ring buffer for exactly one producer thread and one consumer
+// thread. Neither side ever locks or waits: push fails when the buffer is full
+// and pop fails when it's empty. Each side keeps its own index and a cached copy
+// of the other's on a separate cache line, so they only touch the shared
+// indices when the cached copy says the buffer looks full or empty.
+//
+// The alignment is larger than operator new guarantees in C++14, so declare
+// queues as globals or members of globals rather than allocating them.
+template <typename T, std::size_t Capacity>
+class SpscQueue
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	SpscQueue()
+		: head(0), cachedTail(0), tail(0), cachedHead(0)
+	{
+	}
+
+	// Producer only. Returns false, dropping the item, if the queue is full.
+	bool push(const T& item)
+	{
+		std::size_t t = tail.load(std::memory_order_relaxed);
+		if (t - cachedHead == Capacity)
+		{
+			cachedHead = head.load(std::memory_order_acquire);
+			if (t - cachedHead == Capacity)
+				return false;
+		}
+		items[t & (Capacity - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only. Returns false if there is nothing to take.
+	bool pop(T& item)
+	{
+		std::size_t h = head.load(std::memory_order_relaxed);
+		if (h == cachedTail)
+		{
+			cachedTail = tail.load(std::memory_order_acquire);
+			if (h == cachedTail)
+				return false;
+		}
+		item = items[h & (Capacity - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	// Consumer's line
+	alignas(64) std::atomic<std::size_t> head;
+	std::size_t cachedTail;
+	// Producer's line
+	alignas(64) std::atomic<std::size_t> tail;
+	std::size_t cachedHead;
+
+	alignas(64) T items[Capacity];
+};
+
+typedef SpscQueue<InputEvent, 1024> InputQueue;
+
+// The producer's side of an InputQueue that never loses an event. What the
+// queue has no room for waits in a backlog on the producer's thread and goes
+// in ahead of anything newer, so the order is kept. A cursor or scroll event
+// merges into a backlogged event of the same kind (cursor events carry an
+// absolute position, scroll offsets add up), so a flood of movement can't grow
+// the backlog; keys, buttons and resizes are always kept as they are.
+class InputSender
+{
+public:
+	explicit InputSender(InputQueue& queue)
+		: queue(queue)
+	{
+	}
+
+	void send(const InputEvent& e)
+	{
+		if (flush() && queue.push(e))
+			return;
+		if (!backlog.empty() && backlog.back().Type == e.Type)
+		{
+			// keep the earlier time: the movement started then
+			InputEvent& last = backlog.back();
+			if (e.Type == INPUT_CURSOR)
+			{
+				last.X = e.X;
+				last.Y = e.Y;
+				return;
+			}
+			if (e.Type == INPUT_SCROLL)
+			{
+				last.X += e.X;
+				last.Y += e.Y;
+				return;
+			}
+		}
+		backlog.push_back(e);
+	}
+
+	// Moves what it can of the backlog into the queue. Returns true once the
+	// backlog is empty; until then, call it again soon even if no new events
+	// arrive.
+	bool flush()
+	{
+		while (!backlog.empty() && queue.push(backlog.front()))
+			backlog.pop_front();
+		return backlog.empty();
+	}
+
+	std::size_t backlogSize() const
+	{
+		return backlog.size();
+	}
+
+private:
+	InputQueue& queue;
+	std::deque<InputEvent> backlog;
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstring>
+
+// Which paths the compiler may use: AVX with /arch:AVX or /arch:AVX2 (-mavx),
+// with fused multiply-adds as well under /arch:AVX2 or -mfma; SSE always on x64
+// and on x86 with the default /arch:SSE2.
+#if defined(__AVX__)
+#define MAT4_AVX
+#if defined(__FMA__) || defined(__AVX2__)
+#define MAT4_FMA
+#endif
+#include <immintrin.h>
+#endif
+#if defined(MAT4_AVX) || defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MAT4_SSE
+#include <xmmintrin.h>
+#endif
+
+// 4x4 float matrix products, matrix * vector batches and inverses on column-major
+// arrays of 16 floats, as glm::mat4 stores them. Each path is a struct of the
+// same static functions: Mat4Scalar is plain C++, Mat4Sse does a column per
+// instruction and Mat4Avx two. Mat4Simd is the widest one compiled in, and the
+// mat4Multiply/mat4Transform/mat4Inverse wrappers below use it on glm types.
+//
+// glm itself multiplies matrices one float at a time in this project's GLM
+// (0.9.9.0) whatever the build settings, and only uses its SSE inverse for
+// aligned types; see GlmSimd in learnopengl.vcxproj for turning those on.
+
+struct Mat4Scalar
+{
+	// out = a * b; out may be a or b
+	static void multiply(const float* a, const float* b, float* out)
+	{
+		float r[16];
+		for (int c = 0; c < 4; ++c)
+			for (int row = 0; row < 4; ++row)
+				r[c * 4 + row] = a[row] * b[c * 4] + a[4 + row] * b[c * 4 + 1] + a[8 + row] * b[c * 4 + 2] + a[12 + row] * b[c * 4 + 3];
+		std::memcpy(out, r, sizeof(r));
+	}
+
+	// out[i] = m * in[i] for 'count' vectors of 4 floats; out may be in
+	static void transform(const float* m, const float* in, float* out, std::size_t count)
+	{
+		for (std::size_t i = 0; i < count; ++i, in += 4, out += 4)
+		{
+			float x = in[0], y = in[1], z = in[2], w = in[3];
+			for (int row = 0; row < 4; ++row)
+				out[row] = m[row] * x + m[4 + row] * y + m[8 + row] * z + m[12 + row] * w;
+		}
+	}
+
+	// out = inverse of m, by glm's cofactor expansion; out may be m
+	static void inverse(const float* m, float* out)
+	{
+		glm::mat4 matrix;
+		std::memcpy(&matrix[0][0], m, 16 * sizeof(float));
+		matrix = glm::inverse(matrix);
+		std::memcpy(out, &matrix[0][0], 16 * sizeof(float));
+	}
+};
+
+#if defined(MAT4_SSE)
+struct Mat4Sse
+{
+	// Column c of a * b is a's columns weighted by the elements of b's column c
+	static void multiply(const float* a, const float* b, float* out)
+	{
+		__m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+		__m128 r[4];
+		for (int c = 0; c < 4; ++c)
+		{
+			__m128 bc = _mm_loadu_ps(b + c * 4);
+			r[c] = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(a0, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(0, 0, 0, 0))), _mm_mul_ps(a1, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(1, 1, 1, 1)))),
+				_mm_add_ps(_mm_mul_ps(a2, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(2, 2, 2, 2))), _mm_mul_ps(a3, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(3, 3, 3, 3)))));
+		}
+		for (int c = 0; c < 4; ++c)
+			_mm_storeu_ps(out + c * 4, r[c]);
+	}
+
+	static void transform(const float* m, const float* in, float* out, std::size_t count)
+	{
+		__m128 m0 = _mm_loadu_ps(m), m1 = _mm_loadu_ps(m + 4), m2 = _mm_loadu_ps(m + 8), m3 = _mm_loadu_ps(m + 12);
+		for (std::size_t i = 0; i < count; ++i, in += 4, out += 4)
+		{
+			__m128 v = _mm_loadu_ps(in);
+			_mm_storeu_ps(out, _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(m0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0))), _mm_mul_ps(m1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)))),
+				_mm_add_ps(_mm_mul_ps(m2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))), _mm_mul_ps(m3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))))));
+		}
+	}
+
+	// Block-wise inverse: split the matrix into 2x2 blocks A B / C D, each held
+	// in one register, and build the inverse from their determinants and
+	// adjugates. Inverting the transpose gives the transposed inverse, so this
+	// works the same on columns as on rows. (_MM_SHUFFLE lists lanes last first.)
+	static void inverse(const float* m, float* out)
+	{
+		__m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+		__m128 A = _mm_movelh_ps(c0, c1), B = _mm_movehl_ps(c1, c0);
+		__m128 C = _mm_movelh_ps(c2, c3), D = _mm_movehl_ps(c3, c2);
+
+		// determinants of the four blocks: |A| |B| |C| |D|
+		__m128 detSub = _mm_sub_ps(
+			_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+			_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0))));
+		__m128 detA = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(0, 0, 0, 0)), detB = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 detC = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(2, 2, 2, 2)), detD = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(3, 3, 3, 3));
+
+		// the inverse is 1/|M| * (X Y / Z W); X# = |D|A - B(D#C), and so on
+		__m128 D_C = adjugateMultiply(D, C);
+		__m128 A_B = adjugateMultiply(A, B);
+		__m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), multiply2(B, D_C));
+		__m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), multiply2(C, A_B));
+		__m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), multiplyAdjugate(D, A_B));
+		__m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), multiplyAdjugate(A, D_C));
+
+		// |M| = |A||D| + |B||C| - trace((A#B)(D#C))
+		__m128 tr = _mm_mul_ps(A_B, _mm_shuffle_ps(D_C, D_C, _MM_SHUFFLE(3, 1, 2, 0)));
+		tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(2, 3, 0, 1)));
+		tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 0, 3, 2)));
+		__m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+
+		__m128 scale = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+		X_ = _mm_mul_ps(X_, scale);
+		Y_ = _mm_mul_ps(Y_, scale);
+		Z_ = _mm_mul_ps(Z_, scale);
+		W_ = _mm_mul_ps(W_, scale);
+
+		// the adjugate's swap and the blocks back into columns in one shuffle each
+		_mm_storeu_ps(out, _mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(1, 3, 1, 3)));
+		_mm_storeu_ps(out + 4, _mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(0, 2, 0, 2)));
+		_mm_storeu_ps(out + 8, _mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(1, 3, 1, 3)));
+		_mm_storeu_ps(out + 12, _mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(0, 2, 0, 2)));
+	}
+
+private:
+	// 2x2 blocks, row major in one register: a * b
+	static __m128 multiply2(__m128 a, __m128 b)
+	{
+		return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))), _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+	}
+
+	// adjugate(a) * b
+	static __m128 adjugateMultiply(__m128 a, __m128 b)
+	{
+		return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b), _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+	}
+
+	// a * adjugate(b)
+	static __m128 multiplyAdjugate(__m128 a, __m128 b)
+	{
+		return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))), _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+	}
+};
+#endif
+
+#if defined(MAT4_AVX)
+struct Mat4Avx
+{
+	// Two columns of the result per instruction: each of a's columns sits in
+	// both halves of a register, and b's columns c and c+1 are loaded as one,
+	// then spread element by element within each half
+	static void multiply(const float* a, const float* b, float* out)
+	{
+		__m256 a0 = _mm256_broadcast_ps((const __m128*)a), a1 = _mm256_broadcast_ps((const __m128*)(a + 4));
+		__m256 a2 = _mm256_broadcast_ps((const __m128*)(a + 8)), a3 = _mm256_broadcast_ps((const __m128*)(a + 12));
+		__m256 b01 = _mm256_loadu_ps(b), b23 = _mm256_loadu_ps(b + 8);
+		__m256 r01 = combine(a0, a1, a2, a3, b01);
+		__m256 r23 = combine(a0, a1, a2, a3, b23);
+		_mm256_storeu_ps(out, r01);
+		_mm256_storeu_ps(out + 8, r23);
+	}
+
+	// Two vectors per instruction, and the odd one out with SSE
+	static void transform(const float* m, const float* in, float* out, std::size_t count)
+	{
+		__m256 m0 = _mm256_broadcast_ps((const __m128*)m), m1 = _mm256_broadcast_ps((const __m128*)(m + 4));
+		__m256 m2 = _mm256_broadcast_ps((const __m128*)(m + 8)), m3 = _mm256_broadcast_ps((const __m128*)(m + 12));
+		std::size_t i = 0;
+		for (; i + 2 <= count; i += 2, in += 8, out += 8)
+			_mm256_storeu_ps(out, combine(m0, m1, m2, m3, _mm256_loadu_ps(in)));
+		if (i < count)
+			Mat4Sse::transform(m, in, out, count - i);
+	}
+
+	// Nothing here pairs up into whole 256-bit operations, so the SSE version,
+	// which the compiler encodes with AVX instructions anyway
+	static void inverse(const float* m, float* out)
+	{
+		Mat4Sse::inverse(m, out);
+	}
+
+private:
+	static __m256 multiplyAdd(__m256 a, __m256 b, __m256 c)
+	{
+#if defined(MAT4_FMA)
+		return _mm256_fmadd_ps(a, b, c);
+#else
+		return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+	}
+
+	// m * v for the two 4-float vectors in v's halves
+	static __m256 combine(__m256 m0, __m256 m1, __m256 m2, __m256 m3, __m256 v)
+	{
+		__m256 r = _mm256_mul_ps(m0, _mm256_permute_ps(v, 0x00));
+		r = multiplyAdd(m1, _mm256_permute_ps(v, 0x55), r);
+		r = multiplyAdd(m2, _mm256_permute_ps(v, 0xAA), r);
+		return multiplyAdd(m3, _mm256_permute_ps(v, 0xFF), r);
+	}
+};
+#endif
+
+#if defined(MAT4_AVX)
+typedef Mat4Avx Mat4Simd;
+#elif defined(MAT4_SSE)
+typedef Mat4Sse Mat4Simd;
+#else
+typedef Mat4Scalar Mat4Simd;
+#endif
+
+inline glm::mat4 mat4Multiply(const glm::mat4& a, const glm::mat4& b)
+{
+	glm::mat4 r;
+	Mat4Simd::multiply(&a[0][0], &b[0][0], &r[0][0]);
+	return r;
+}
+
+inline glm::mat4 mat4Inverse(const glm::mat4& m)
+{
+	glm::mat4 r;
+	Mat4Simd::inverse(&m[0][0], &r[0][0]);
+	return r;
+}
+
+// out[i] = m * in[i]
+inline void mat4Transform(const glm::mat4& m, const glm::vec4* in, glm::vec4* out, std::size_t count)
+{
+	Mat4Simd::transform(&m[0][0], &in[0][0], &out[0][0], count);
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Bvh.h"
+#include "Mat4Simd.h"
+
+// A ray from the camera, through a point on the screen
+struct PickRay
+{
+	glm::vec3 Origin;		// on the near plane
+	glm::vec3 Direction;	// unit length
+};
+
+// The ray through window position (x, y), in pixels from the top left as
+// GLFW reports the cursor, for a window of width by height pixels and the
+// projection and view matrices the scene is drawn with
+inline PickRay cursorRay(double x, double y, int width, int height, const glm::mat4& projection, const glm::mat4& view)
+{
+	// window to normalized device coordinates, then back through both matrices
+	// at the near and far planes
+	float ndcX = (float)(2.0 * x / width - 1.0);
+	float ndcY = (float)(1.0 - 2.0 * y / height);
+	glm::mat4 inverse = mat4Inverse(mat4Multiply(projection, view));
+	glm::vec4 nearPoint = inverse * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverse * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+	PickRay ray;
+	ray.Origin = glm::vec3(nearPoint) / nearPoint.w;
+	ray.Direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - ray.Origin);
+	return ray;
+}
+
+// Distance along the ray to triangle abc (Moller-Trumbore), or -1 for a miss.
+// Both sides of the triangle count.
+inline float rayTriangle(glm::vec3 origin, glm::vec3 direction, glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+	glm::vec3 ab = b - a, ac = c - a;
+	glm::vec3 p = glm::cross(direction, ac);
+	float det = glm::dot(ab, p);
+	if (std::fabs(det) < 1e-12f)
+		return -1.0f; // parallel to the triangle
+	float inverseDet = 1.0f / det;
+	glm::vec3 s = origin - a;
+	float u = glm::dot(s, p) * inverseDet;
+	if (u < 0.0f || u > 1.0f)
+		return -1.0f;
+	glm::vec3 q = glm::cross(s, ab);
+	float v = glm::dot(direction, q) * inverseDet;
+	if (v < 0.0f || u + v > 1.0f)
+		return -1.0f;
+	float t = glm::dot(ac, q) * inverseDet;
+	return t >= 0.0f ? t : -1.0f;
+}
+
+// Triangles of a mesh in its own space, for exact hit tests
+struct PickMesh
+{
+	std::vector<glm::vec3> Positions;	// three per triangle
+	Aabb Bounds;
+
+	// From an interleaved vertex array drawn with GL_TRIANGLES: 'stride'
+	// floats per vertex, position first, as the cube in Application.cpp
+	static PickMesh fromVertices(const float* vertices, std::size_t vertexCount, std::size_t stride)
+	{
+		PickMesh mesh;
+		mesh.Bounds = Aabb::empty();
+		for (std::size_t i = 0; i + 2 < vertexCount; i += 3)
+			for (std::size_t k = 0; k < 3; ++k)
+			{
+				const float* v = vertices + (i + k) * stride;
+				glm::vec3 p(v[0], v[1], v[2]);
+				mesh.Positions.push_back(p);
+				Aabb point = { p, p };
+				mesh.Bounds.grow(point);
+			}
+		return mesh;
+	}
+
+	// From indexed triangles, as Primitives.h makes them: 'stride' floats per
+	// vertex, position first, and three indices per triangle
+	static PickMesh fromIndexed(const float* vertices, std::size_t stride, const std::uint32_t* indices, std::size_t indexCount)
+	{
+		PickMesh mesh;
+		mesh.Bounds = Aabb::empty();
+		for (std::size_t i = 0; i < indexCount - indexCount % 3; ++i)
+		{
+			const float* v = vertices + indices[i] * stride;
+			glm::vec3 p(v[0], v[1], v[2]);
+			mesh.Positions.push_back(p);
+			Aabb point = { p, p };
+			mesh.Bounds.grow(point);
+		}
+		return mesh;
+	}
+
+	// Nearest hit along the ray, or -1
+	float raycast(glm::vec3 origin, glm::vec3 direction) const
+	{
+		float nearest = -1.0f;
+		for (std::size_t i = 0; i < Positions.size(); i += 3)
+		{
+			float t = rayTriangle(origin, direction, Positions[i], Positions[i + 1], Positions[i + 2]);
+			if (t >= 0.0f && (nearest < 0.0f || t < nearest))
+				nearest = t;
+		}
+		return nearest;
+	}
+};
+
+// Finds which object a ray hits first. Each object is a mesh placed by a
+// model matrix. A Bvh over the objects' world bounding boxes narrows a pick
+// down to the few objects whose boxes the ray passes through, nearest first,
+// and only those get the exact test: the ray taken into the mesh's own space
+// and tested against its triangles.
+//
+//	Picker picker;
+//	std::uint32_t id = picker.add(cubeMesh, model);
+//	picker.update();
+//	PickRay ray = cursorRay(x, y, width, height, projection, view);
+//	RayHit hit;
+//	if (picker.pick(ray.Origin, ray.Direction, hit))
+//		select(hit.Object);	// hit.Distance along the ray
+class Picker
+{
+public:
+	Picker()
+		: added(false)
+	{
+	}
+
+	std::size_t size() const
+	{
+		return meshes.size();
+	}
+
+	// Adds an object and returns its id, counting from 0. The mesh isn't
+	// copied, so it must outlive the picker.
+	std::uint32_t add(const PickMesh& mesh, const glm::mat4& model)
+	{
+		std::uint32_t object = (std::uint32_t)meshes.size();
+		meshes.push_back(&mesh);
+		inverseModels.push_back(glm::mat4(1.0f));
+		boxes.push_back(Aabb::empty());
+		added = true;
+		setTransform(object, model);
+		return object;
+	}
+
+	// Takes effect at the next update()
+	void setTransform(std::uint32_t object, const glm::mat4& model)
+	{
+		inverseModels[object] = mat4Inverse(model);
+		boxes[object] = worldBounds(meshes[object]->Bounds, model);
+		if (!added)
+			bvh.setBounds(object, boxes[object]);
+	}
+
+	// Brings the hierarchy up to date with the objects: builds it after adds,
+	// otherwise refits it and rebuilds when it has got too loose
+	void update()
+	{
+		if (added)
+			bvh.build(boxes.data(), boxes.size());
+		else
+			bvh.update();
+		added = false;
+	}
+
+	// The first object the ray hits within maxDistance, and how far along
+	// the ray; in world units if the direction is unit length
+	bool pick(glm::vec3 origin, glm::vec3 direction, RayHit& hit, float maxDistance = 1e30f) const
+	{
+		return bvh.raycast(origin, direction, maxDistance, [&](std::uint32_t object)
+		{
+			// an affine transform keeps distances along the ray in proportion,
+			// so the distance in the mesh's space is the one in the world
+			const glm::mat4& inverse = inverseModels[object];
+			return meshes[object]->raycast(glm::vec3(inverse * glm::vec4(origin, 1.0f)), glm::vec3(inverse * glm::vec4(direction, 0.0f)));
+		}, hit);
+	}
+
+private:
+	Bvh bvh;
+	std::vector<const PickMesh*> meshes;
+	std::vector<glm::mat4> inverseModels;
+	std::vector<Aabb> boxes;
+	bool added;	// objects added since the last build
+
+	// The box around a box moved by 'model': the center moves, and each world
+	// axis gets the extents along it of the three rotated and scaled half sizes
+	static Aabb worldBounds(const Aabb& local, const glm::mat4& model)
+	{
+		glm::vec3 center = glm::vec3(model * glm::vec4((local.Min + local.Max) * 0.5f, 1.0f));
+		glm::vec3 half = (local.Max - local.Min) * 0.5f;
+		glm::vec3 extent = glm::abs(glm::vec3(model[0])) * half.x + glm::abs(glm::vec3(model[1])) * half.y + glm::abs(glm::vec3(model[2])) * half.z;
+		Aabb box = { center - extent, center + extent };
+		return box;
+	}
+};
@@ -0,0 +1,568 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Cubes, spheres, planes and cylinders as indexed vertex arrays: each vertex
+// once, with the attributes asked for, packed in the order of this enum.
+//
+// StaticMesh builds a mesh while compiling, into static arrays, so there's
+// nothing to do at startup but upload them:
+//
+//	typedef StaticMesh<MESH_POSITION | MESH_UV, CubeShape, 1> Cube;
+//	glBufferData(GL_ARRAY_BUFFER, sizeof(Cube::Vertices), Cube::Vertices.Data, GL_STATIC_DRAW);
+//	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Cube::Indices), Cube::Indices.Data, GL_STATIC_DRAW);
+//	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, Cube::Stride * sizeof(float), (void*)(meshOffset(Cube::Attributes, MESH_UV) * sizeof(float)));
+//	glDrawElements(GL_TRIANGLES, Cube::IndexCount, GL_UNSIGNED_INT, 0);
+//
+// The compiler's work grows with the square of the vertex count, so keep
+// that to a few hundred; generateMesh() makes the same mesh at run time for
+// anything bigger. Both merge vertices that come out equal: a cube with only
+// positions has 8, with normals as well 24.
+//
+// Everything here is written as C++11 constexpr (one return statement per
+// function), which is all VS2015 supports.
+enum Mesh_Attribute
+{
+	MESH_POSITION = 1,	// x, y, z
+	MESH_UV = 2,		// u, v: texture coordinates
+	MESH_NORMAL = 4,	// x, y, z: unit length
+	MESH_TANGENT = 8	// x, y, z, w: unit length, along increasing u; w = 1 is the handedness of normal x tangent = bitangent
+};
+
+// Floats per vertex
+constexpr std::size_t meshStride(int attributes)
+{
+	return (attributes & MESH_POSITION ? 3 : 0) + (attributes & MESH_UV ? 2 : 0) + (attributes & MESH_NORMAL ? 3 : 0) + (attributes & MESH_TANGENT ? 4 : 0);
+}
+
+// Where 'attribute' starts in a vertex, in floats
+constexpr std::size_t meshOffset(int attributes, Mesh_Attribute attribute)
+{
+	return meshStride(attributes & (attribute - 1));
+}
+
+// One vertex with every attribute
+struct MeshVertex
+{
+	float X, Y, Z;
+	float U, V;
+	float NX, NY, NZ;
+	float TX, TY, TZ, TW;
+
+	// By position in a vertex with every attribute: 0-2 position, 3-4 texture
+	// coordinates, 5-7 normal, 8-11 tangent. Adding 0 turns -0 into 0, so
+	// equal vertices have equal bits.
+	constexpr float operator[](std::size_t component) const
+	{
+		return 0.0f + (component < 6
+			? (component == 0 ? X : component == 1 ? Y : component == 2 ? Z : component == 3 ? U : component == 4 ? V : NX)
+			: (component == 6 ? NY : component == 7 ? NZ : component == 8 ? TX : component == 9 ? TY : component == 10 ? TZ : TW));
+	}
+};
+
+// Component c of a vertex with these attributes, as a position in MeshVertex
+constexpr std::size_t meshComponent(int attributes, std::size_t c)
+{
+	return c < meshStride(attributes & MESH_POSITION) ? c
+		: c < meshStride(attributes & (MESH_POSITION | MESH_UV)) ? 3 + c - meshStride(attributes & MESH_POSITION)
+		: c < meshStride(attributes & (MESH_POSITION | MESH_UV | MESH_NORMAL)) ? 5 + c - meshStride(attributes & (MESH_POSITION | MESH_UV))
+		: 8 + c - meshStride(attributes & (MESH_POSITION | MESH_UV | MESH_NORMAL));
+}
+
+// sin(x) for -pi <= x <= pi: its Taylor series up to x^19 / 19!, nested so
+// that it takes multiplies only; xx is x * x
+constexpr double meshSinSeries(double x, double xx)
+{
+	return x * (1 - xx * (1.0 / 6) * (1 - xx * (1.0 / 20) * (1 - xx * (1.0 / 42) * (1 - xx * (1.0 / 72) * (1 - xx * (1.0 / 110)
+		* (1 - xx * (1.0 / 156) * (1 - xx * (1.0 / 210) * (1 - xx * (1.0 / 272) * (1 - xx * (1.0 / 342))))))))));
+}
+
+constexpr double meshSinAngle(double x)
+{
+	return meshSinSeries(x, x * x);
+}
+
+constexpr double meshSinReduced(int k, int n)
+{
+	return k == 0 || 2 * k == n ? 0.0 : 4 * k == n ? 1.0 : 4 * k == 3 * n ? -1.0
+		: meshSinAngle(6.283185307179586 * (2 * k > n ? k - n : k) / n);
+}
+
+// sin and cos of k n-ths of a turn: exact at quarter turns, and the same at
+// k and k + n, so the ends of a ring of vertices meet exactly
+constexpr double meshSinTurn(int k, int n)
+{
+	return meshSinReduced((k % n + n) % n, n);
+}
+
+constexpr double meshCosTurn(int k, int n)
+{
+	return meshSinTurn(4 * k + n, 4 * n);
+}
+
+// Index i of a grid of quads 'columns' wide, two triangles each, with the
+// vertices numbered row by row from 'first'. Going +column then +row winds
+// counter-clockwise seen from the front.
+constexpr std::size_t meshGridCorner(std::size_t corner, int columns)
+{
+	return corner == 0 || corner == 3 ? 0 : corner == 1 ? 1 : corner == 2 || corner == 4 ? columns + 2 : columns + 1;
+}
+
+constexpr std::uint32_t meshGridIndex(std::size_t i, int columns, std::size_t first)
+{
+	return (std::uint32_t)(first + i / 6 / columns * (columns + 1) + i / 6 % columns + meshGridCorner(i % 6, columns));
+}
+
+// A 1 x 1 square in the xz plane facing +y, 'columns' by 'rows' quads, with
+// texture v running towards -z
+struct PlaneShape
+{
+	int Columns, Rows;
+
+	constexpr PlaneShape(int columns, int rows)
+		: Columns(columns), Rows(rows)
+	{
+	}
+
+	constexpr std::size_t vertexCount() const
+	{
+		return (std::size_t)(Columns + 1) * (Rows + 1);
+	}
+
+	constexpr std::size_t indexCount() const
+	{
+		return (std::size_t)6 * Columns * Rows;
+	}
+
+	constexpr MeshVertex vertex(std::size_t v) const
+	{
+		return at((float)(v % (Columns + 1)) / Columns, (float)(v / (Columns + 1)) / Rows);
+	}
+
+	constexpr std::uint32_t index(std::size_t i) const
+	{
+		return meshGridIndex(i, Columns, 0);
+	}
+
+private:
+	constexpr MeshVertex at(float s, float t) const
+	{
+		return MeshVertex{ s - 0.5f, 0.0f, 0.5f - t, s, t, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f };
+	}
+};
+
+// Each cube face: its normal, then the directions texture u and v run along.
+// v = normal x u, so every face winds counter-clockwise seen from outside.
+constexpr signed char cubeShapeFaces[6][9] = {
+	{ 1, 0, 0,	0, 0, -1,	0, 1, 0 },
+	{ -1, 0, 0,	0, 0, 1,	0, 1, 0 },
+	{ 0, 1, 0,	1, 0, 0,	0, 0, -1 },
+	{ 0, -1, 0,	1, 0, 0,	0, 0, 1 },
+	{ 0, 0, 1,	1, 0, 0,	0, 1, 0 },
+	{ 0, 0, -1,	-1, 0, 0,	0, 1, 0 }
+};
+
+// A 1 x 1 x 1 cube around the origin, each face split into 'divisions' by
+// 'divisions' quads with the whole texture across it
+struct CubeShape
+{
+	int Divisions;
+
+	constexpr explicit CubeShape(int divisions)
+		: Divisions(divisions)
+	{
+	}
+
+	constexpr std::size_t vertexCount() const
+	{
+		return 6 * faceVertices();
+	}
+
+	constexpr std::size_t indexCount() const
+	{
+		return (std::size_t)36 * Divisions * Divisions;
+	}
+
+	constexpr MeshVertex vertex(std::size_t v) const
+	{
+		return at(v / faceVertices(), (float)(v % faceVertices() % (Divisions + 1)) / Divisions, (float)(v % faceVertices() / (Divisions + 1)) / Divisions);
+	}
+
+	constexpr std::uint32_t index(std::size_t i) const
+	{
+		return meshGridIndex(i % (indexCount() / 6), Divisions, i / (indexCount() / 6) * faceVertices());
+	}
+
+private:
+	constexpr std::size_t faceVertices() const
+	{
+		return (std::size_t)(Divisions + 1) * (Divisions + 1);
+	}
+
+	static constexpr float coordinate(std::size_t face, int axis, float s, float t)
+	{
+		return 0.5f * cubeShapeFaces[face][axis] + (s - 0.5f) * cubeShapeFaces[face][3 + axis] + (t - 0.5f) * cubeShapeFaces[face][6 + axis];
+	}
+
+	static constexpr MeshVertex at(std::size_t face, float s, float t)
+	{
+		return MeshVertex{ coordinate(face, 0, s, t), coordinate(face, 1, s, t), coordinate(face, 2, s, t), s, t,
+			(float)cubeShapeFaces[face][0], (float)cubeShapeFaces[face][1], (float)cubeShapeFaces[face][2],
+			(float)cubeShapeFaces[face][3], (float)cubeShapeFaces[face][4], (float)cubeShapeFaces[face][5], 1.0f };
+	}
+};
+
+// A sphere of diameter 1 around the origin: 'stacks' rings of quads from the
+// bottom pole to the top, 'slices' around, with a seam at +z where texture u
+// wraps from 1 to 0. The quads at the poles are single triangles.
+struct SphereShape
+{
+	int Stacks, Slices;
+
+	constexpr SphereShape(int stacks, int slices)
+		: Stacks(stacks), Slices(slices)
+	{
+	}
+
+	constexpr std::size_t vertexCount() const
+	{
+		return (std::size_t)(Stacks + 1) * (Slices + 1);
+	}
+
+	constexpr std::size_t indexCount() const
+	{
+		return (std::size_t)6 * Slices * (Stacks - 1);
+	}
+
+	constexpr MeshVertex vertex(std::size_t v) const
+	{
+		return at((int)(v % (Slices + 1)), (int)(v / (Slices + 1)));
+	}
+
+	constexpr std::uint32_t index(std::size_t i) const
+	{
+		return meshGridIndex(gridTriangle(i / 3) * 3 + i % 3, Slices, 0);
+	}
+
+private:
+	// Triangle number 'triangle' among the grid's two per quad, skipping the
+	// ones squashed to a line at the poles: the first of each quad in the
+	// bottom row and the second in the top row
+	constexpr std::size_t gridTriangle(std::size_t triangle) const
+	{
+		return triangle < (std::size_t)Slices ? triangle * 2 + 1
+			: triangle - Slices < (std::size_t)2 * Slices * (Stacks - 2) ? Slices + triangle
+			: (std::size_t)2 * Slices * (Stacks - 1) + 2 * (triangle - Slices - (std::size_t)2 * Slices * (Stacks - 2));
+	}
+
+	// Slice i and stack j: i slices of a turn around y, and j stacks of half
+	// a turn up from the bottom
+	constexpr MeshVertex at(int i, int j) const
+	{
+		return point((float)meshSinTurn(i, Slices), (float)meshCosTurn(i, Slices), (float)meshSinTurn(j, 2 * Stacks), -(float)meshCosTurn(j, 2 * Stacks),
+			(float)i / Slices, (float)j / Stacks);
+	}
+
+	static constexpr MeshVertex point(float sinAround, float cosAround, float radius, float y, float u, float v)
+	{
+		return MeshVertex{ 0.5f * radius * sinAround, 0.5f * y, 0.5f * radius * cosAround, u, v,
+			radius * sinAround, y, radius * cosAround, cosAround, 0.0f, -sinAround, 1.0f };
+	}
+};
+
+// A cylinder of diameter 1 and height 1 around the y axis, its side 'slices'
+// quads around and 'stacks' high, with the seam at +z, and a fan of
+// 'slices' triangles closing each end. The caps take a disc of the texture.
+struct CylinderShape
+{
+	int Slices, Stacks;
+
+	constexpr CylinderShape(int slices, int stacks)
+		: Slices(slices), Stacks(stacks)
+	{
+	}
+
+	constexpr std::size_t vertexCount() const
+	{
+		return sideVertices() + 2 * (Slices + 1);
+	}
+
+	constexpr std::size_t indexCount() const
+	{
+		return sideIndices() + (std::size_t)6 * Slices;
+	}
+
+	constexpr MeshVertex vertex(std::size_t v) const
+	{
+		return v < sideVertices() ? side((int)(v % (Slices + 1)), (int)(v / (Slices + 1)))
+			: cap((v - sideVertices()) / (Slices + 1) == 0 ? 1.0f : -1.0f, (int)((v - sideVertices()) % (Slices + 1)));
+	}
+
+	constexpr std::uint32_t index(std::size_t i) const
+	{
+		return i < sideIndices() ? meshGridIndex(i, Slices, 0) : capIndex((i - sideIndices()) / (3 * Slices), (i - sideIndices()) % (3 * Slices));
+	}
+
+private:
+	constexpr std::size_t sideVertices() const
+	{
+		return (std::size_t)(Slices + 1) * (Stacks + 1);
+	}
+
+	constexpr std::size_t sideIndices() const
+	{
+		return (std::size_t)6 * Slices * Stacks;
+	}
+
+	constexpr MeshVertex side(int i, int j) const
+	{
+		return sidePoint((float)meshSinTurn(i, Slices), (float)meshCosTurn(i, Slices), (float)i / Slices, (float)j / Stacks);
+	}
+
+	static constexpr MeshVertex sidePoint(float sinAround, float cosAround, float u, float v)
+	{
+		return MeshVertex{ 0.5f * sinAround, v - 0.5f, 0.5f * cosAround, u, v,
+			sinAround, 0.0f, cosAround, cosAround, 0.0f, -sinAround, 1.0f };
+	}
+
+	// Vertex k of the cap facing 'up' (1 for the top, -1 for the bottom): the
+	// center, then the rim
+	constexpr MeshVertex cap(float up, int k) const
+	{
+		return k == 0 ? capPoint(up, 0.0f, 0.0f) : capPoint(up, 0.5f * (float)meshSinTurn(k - 1, Slices), 0.5f * (float)meshCosTurn(k - 1, Slices));
+	}
+
+	static constexpr MeshVertex capPoint(float up, float x, float z)
+	{
+		return MeshVertex{ x, 0.5f * up, z, 0.5f + x, 0.5f - up * z, 0.0f, up, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f };
+	}
+
+	// Corner c of a cap's triangles, counter-clockwise seen from outside
+	constexpr std::uint32_t capIndex(std::size_t cap, std::size_t c) const
+	{
+		return (std::uint32_t)(sideVertices() + cap * (Slices + 1)
+			+ (c % 3 == 0 ? 0 : 1 + (c / 3 + ((c % 3 == 2) != (cap == 1) ? 1 : 0)) % Slices));
+	}
+};
+
+// A constexpr array, as std::array only gets constexpr element access in C++17
+template <typename T, std::size_t N>
+struct MeshArray
+{
+	T Data[N];
+
+	constexpr T operator[](std::size_t i) const
+	{
+		return Data[i];
+	}
+};
+
+template <int Attributes, typename Shape, std::size_t... I>
+constexpr MeshArray<float, sizeof...(I)> meshShapeVertices(const Shape& shape, std::index_sequence<I...>)
+{
+	return MeshArray<float, sizeof...(I)>{ { shape.vertex(I / meshStride(Attributes))[meshComponent(Attributes, I % meshStride(Attributes))]... } };
+}
+
+template <std::size_t Stride, std::size_t N>
+constexpr bool meshSameVertex(const MeshArray<float, N>& vertices, std::size_t a, std::size_t b, std::size_t c = 0)
+{
+	return c == Stride || (vertices[a * Stride + c] == vertices[b * Stride + c] && meshSameVertex<Stride>(vertices, a, b, c + 1));
+}
+
+constexpr std::size_t meshMin(std::size_t a, std::size_t b)
+{
+	return a < b ? a : b;
+}
+
+// The first vertex in [begin, end) equal to v, or v. Halving the range each
+// step keeps the recursion shallow.
+template <std::size_t Stride, std::size_t N>
+constexpr std::size_t meshFirstSame(const MeshArray<float, N>& vertices, std::size_t v, std::size_t begin, std::size_t end)
+{
+	return end - begin == 1 ? (meshSameVertex<Stride>(vertices, begin, v) ? begin : v)
+		: meshMin(meshFirstSame<Stride>(vertices, v, begin, begin + (end - begin) / 2), meshFirstSame<Stride>(vertices, v, begin + (end - begin) / 2, end));
+}
+
+template <std::size_t Stride, std::size_t N, std::size_t... V>
+constexpr MeshArray<std::size_t, sizeof...(V)> meshFirsts(const MeshArray<float, N>& vertices, std::index_sequence<V...>)
+{
+	return MeshArray<std::size_t, sizeof...(V)>{ { meshFirstSame<Stride>(vertices, V, 0, V + 1)... } };
+}
+
+// How many vertices in [begin, end) are the first of their kind
+template <std::size_t N>
+constexpr std::size_t meshCountFirsts(const MeshArray<std::size_t, N>& firsts, std::size_t begin, std::size_t end)
+{
+	return end - begin == 0 ? 0 : end - begin == 1 ? (firsts[begin] == begin ? 1 : 0)
+		: meshCountFirsts(firsts, begin, begin + (end - begin) / 2) + meshCountFirsts(firsts, begin + (end - begin) / 2, end);
+}
+
+template <std::size_t N, std::size_t... V>
+constexpr MeshArray<std::size_t, sizeof...(V)> meshRanks(const MeshArray<std::size_t, N>& firsts, std::index_sequence<V...>)
+{
+	return MeshArray<std::size_t, sizeof...(V)>{ { meshCountFirsts(firsts, 0, V)... } };
+}
+
+// A shape's vertices with the attributes asked for, and for each one the
+// first equal vertex and how many first-of-their-kind vertices come before
+// it: that is its number once the duplicates are gone.
+template <int Attributes, typename Shape, int... Tessellation>
+struct MeshSource
+{
+	enum : std::size_t
+	{
+		Stride = meshStride(Attributes),
+		VertexCount = Shape(Tessellation...).vertexCount(),
+		IndexCount = Shape(Tessellation...).indexCount()
+	};
+
+	static constexpr MeshArray<float, VertexCount * Stride> Vertices = meshShapeVertices<Attributes>(Shape(Tessellation...), std::make_index_sequence<VertexCount * Stride>());
+	static constexpr MeshArray<std::size_t, VertexCount> Firsts = meshFirsts<Stride>(Vertices, std::make_index_sequence<VertexCount>());
+	static constexpr MeshArray<std::size_t, VertexCount> Ranks = meshRanks(Firsts, std::make_index_sequence<VertexCount>());
+
+	enum : std::size_t
+	{
+		UniqueCount = meshCountFirsts(Firsts, 0, VertexCount)
+	};
+};
+
+template <int Attributes, typename Shape, int... Tessellation>
+constexpr MeshArray<float, MeshSource<Attributes, Shape, Tessellation...>::VertexCount * MeshSource<Attributes, Shape, Tessellation...>::Stride> MeshSource<Attributes, Shape, Tessellation...>::Vertices;
+template <int Attributes, typename Shape, int... Tessellation>
+constexpr MeshArray<std::size_t, MeshSource<Attributes, Shape, Tessellation...>::VertexCount> MeshSource<Attributes, Shape, Tessellation...>::Firsts;
+template <int Attributes, typename Shape, int... Tessellation>
+constexpr MeshArray<std::size_t, MeshSource<Attributes, Shape, Tessellation...>::VertexCount> MeshSource<Attributes, Shape, Tessellation...>::Ranks;
+
+// The source vertex that is the k-th first of its kind: the first v in
+// [begin, end) with more than k of them up to and including it
+template <typename Source>
+constexpr std::size_t meshKthFirst(std::size_t k, std::size_t begin, std::size_t end)
+{
+	return end - begin == 1 ? begin
+		: Source::Ranks[begin + (end - begin) / 2] > k ? meshKthFirst<Source>(k, begin, begin + (end - begin) / 2)
+		: meshKthFirst<Source>(k, begin + (end - begin) / 2, end);
+}
+
+template <typename Source, std::size_t... I>
+constexpr MeshArray<float, sizeof...(I)> meshUniqueVertices(std::index_sequence<I...>)
+{
+	return MeshArray<float, sizeof...(I)>{ { Source::Vertices[meshKthFirst<Source>(I / Source::Stride, 0, Source::VertexCount) * Source::Stride + I % Source::Stride]... } };
+}
+
+template <typename Source, typename Shape, std::size_t... I>
+constexpr MeshArray<std::uint32_t, sizeof...(I)> meshUniqueIndices(const Shape& shape, std::index_sequence<I...>)
+{
+	return MeshArray<std::uint32_t, sizeof...(I)>{ { (std::uint32_t)Source::Ranks[Source::Firsts[shape.index(I)]]... } };
+}
+
+// A primitive made while compiling, for example
+// StaticMesh<MESH_POSITION | MESH_NORMAL, SphereShape, 8, 16> for a sphere of
+// 8 stacks and 16 slices with positions and normals. Vertices holds Stride
+// floats for each of VertexCount vertices, and Indices three per triangle,
+// counter-clockwise seen from outside.
+template <int AttributeSet, typename Shape, int... Tessellation>
+struct StaticMesh
+{
+	typedef MeshSource<AttributeSet, Shape, Tessellation...> Source;
+
+	enum : std::size_t
+	{
+		Attributes = AttributeSet,
+		Stride = Source::Stride,
+		VertexCount = Source::UniqueCount,
+		IndexCount = Source::IndexCount
+	};
+
+	static constexpr MeshArray<float, VertexCount * Stride> Vertices = meshUniqueVertices<Source>(std::make_index_sequence<VertexCount * Stride>());
+	static constexpr MeshArray<std::uint32_t, IndexCount> Indices = meshUniqueIndices<Source>(Shape(Tessellation...), std::make_index_sequence<IndexCount>());
+};
+
+template <int AttributeSet, typename Shape, int... Tessellation>
+constexpr MeshArray<float, StaticMesh<AttributeSet, Shape, Tessellation...>::VertexCount * StaticMesh<AttributeSet, Shape, Tessellation...>::Stride> StaticMesh<AttributeSet, Shape, Tessellation...>::Vertices;
+template <int AttributeSet, typename Shape, int... Tessellation>
+constexpr MeshArray<std::uint32_t, StaticMesh<AttributeSet, Shape, Tessellation...>::IndexCount> StaticMesh<AttributeSet, Shape, Tessellation...>::Indices;
+
+// A primitive made at run time, laid out as a StaticMesh
+struct MeshData
+{
+	int Attributes;
+	std::vector<float> Vertices;			// stride() floats per vertex
+	std::vector<std::uint32_t> Indices;	// three per triangle
+
+	std::size_t stride() const
+	{
+		return meshStride(Attributes);
+	}
+
+	std::size_t vertexCount() const
+	{
+		return Vertices.size() / stride();
+	}
+};
+
+// The same mesh as StaticMesh<attributes, Shape, ...> with the same
+// tessellation, for sizes too big to make while compiling:
+//
+//	MeshData sphere = generateMesh(MESH_POSITION | MESH_NORMAL, SphereShape(256, 512));
+//
+// Duplicates are found by hashing each vertex as it's made, so this takes
+// time in proportion to the vertex count.
+template <typename Shape>
+MeshData generateMesh(int attributes, const Shape& shape)
+{
+	MeshData mesh;
+	mesh.Attributes = attributes;
+	std::size_t stride = meshStride(attributes), count = shape.vertexCount();
+	std::size_t components[12];
+	for (std::size_t c = 0; c < stride; ++c)
+		components[c] = meshComponent(attributes, c);
+
+	// Unique vertices are numbered as they are made. A new vertex goes on the
+	// end and stays there unless an equal one is already in the table: open
+	// addressing over vertex numbers, at most half full, hashed with FNV-1a
+	// over the floats' bits.
+	std::size_t mask = 1;
+	while (mask < 2 * count)
+		mask *= 2;
+	mask -= 1;
+	const std::uint32_t empty = 0xFFFFFFFFu;
+	std::vector<std::uint32_t> table(mask + 1, empty);
+	std::vector<std::uint32_t> unique(count);
+	mesh.Vertices.reserve(count * stride);
+	for (std::size_t v = 0; v < count; ++v)
+	{
+		MeshVertex vertex = shape.vertex(v);
+		std::uint32_t next = (std::uint32_t)mesh.vertexCount(), hash = 2166136261u;
+		for (std::size_t c = 0; c < stride; ++c)
+		{
+			float value = vertex[components[c]];
+			std::uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			hash = (hash ^ bits) * 16777619u;
+			mesh.Vertices.push_back(value);
+		}
+
+		const float* added = &mesh.Vertices[next * stride];
+		hash ^= hash >> 15; // the low bits, used for the slot, only saw low mantissa bits so far
+		hash *= 0x2C1B3C6Du;
+		hash ^= hash >> 12;
+		std::size_t slot = hash & mask;
+		while (table[slot] != empty && !std::equal(added, added + stride, &mesh.Vertices[table[slot] * stride]))
+			slot = (slot + 1) & mask;
+		if (table[slot] == empty)
+			table[slot] = next;
+		else
+			mesh.Vertices.resize(next * stride);
+		unique[v] = table[slot];
+	}
+
+	mesh.Indices.resize(shape.indexCount());
+	for (std::size_t i = 0; i < mesh.Indices.size(); ++i)
+		mesh.Indices[i] = unique[shape.index(i)];
+	return mesh;
+}
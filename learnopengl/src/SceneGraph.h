@@ -0,0 +1,260 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "WorkerPool.h"
+
+// A local transform: scale, then rotate, then translate
+struct NodeTransform
+{
+	glm::vec3 Position;
+	glm::quat Rotation;
+	glm::vec3 Scale;
+};
+
+// Parent-child transforms kept in flat arrays instead of a pointer tree.
+//
+// Nodes are stored breadth first: all roots, then all their children, then
+// the grandchildren and so on, with each node's children next to each other.
+// Updating in that order visits every parent before its children and walks the
+// arrays front to back. Changing a node's local transform marks it dirty;
+// update() recomputes the world matrices of the dirty nodes and everything
+// below them, and nothing else. The nodes of one depth level don't depend on
+// each other, so each level is split across the worker threads.
+//
+//	SceneGraph scene;
+//	int sun = scene.add(-1, glm::vec3(0.0f));
+//	int earth = scene.add(sun, glm::vec3(10.0f, 0.0f, 0.0f));
+//	scene.build();			// sort; may renumber, see build()
+//	scene.setRotation(sun, spin);
+//	scene.update();			// World[sun] and World[earth] change
+class SceneGraph
+{
+public:
+	// Per node, in breadth-first order after build()
+	std::vector<int> Parent;			// -1 for roots
+	std::vector<NodeTransform> Local;	// relative to the parent; change with the setters
+	std::vector<glm::mat4> World;		// valid after update()
+
+	explicit SceneGraph(unsigned threads = std::thread::hardware_concurrency())
+		: pool(threads), sorted(true), built(false)
+	{
+	}
+
+	std::size_t size() const
+	{
+		return Parent.size();
+	}
+
+	// Adds a node under 'parent' (-1 for a root), which must already exist.
+	// Returns its index, which stays valid until the next build(). The next
+	// update() is a full one.
+	int add(int parent, glm::vec3 position, glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3 scale = glm::vec3(1.0f))
+	{
+		int i = (int)size();
+		// still breadth first if it goes after its parent's other children and
+		// at least as deep as the node before it
+		int level = parent < 0 ? 0 : depth[parent] + 1;
+		if (i > 0 && (parent < Parent.back() || level < depth.back()))
+			sorted = false;
+		built = false;
+		Parent.push_back(parent);
+		depth.push_back(level);
+		NodeTransform local = { position, rotation, scale };
+		Local.push_back(local);
+		World.push_back(glm::mat4(1.0f));
+		dirty.push_back(0);
+		markDirty(i);
+		return i;
+	}
+
+	// Sorts the nodes breadth first and sets up the level and child ranges. Call
+	// after adding nodes; update() does it if you don't. Returns the new index
+	// of every old one: identity if the nodes were added in breadth-first order,
+	// e.g. level by level.
+	std::vector<int> build()
+	{
+		std::size_t n = size();
+		std::vector<int> order(n), newIndex(n);
+		if (sorted)
+		{
+			for (std::size_t i = 0; i < n; ++i)
+				order[i] = newIndex[i] = (int)i;
+		}
+		else
+		{
+			// children of each node, in index order, then a breadth-first walk
+			std::vector<int> childStart(n + 1, 0), children(n);
+			for (std::size_t i = 0; i < n; ++i)
+				if (Parent[i] >= 0)
+					++childStart[Parent[i] + 1];
+			for (std::size_t i = 0; i < n; ++i)
+				childStart[i + 1] += childStart[i];
+			std::vector<int> fill(childStart.begin(), childStart.end() - 1);
+			std::size_t tail = 0;
+			for (std::size_t i = 0; i < n; ++i)
+				if (Parent[i] >= 0)
+					children[fill[Parent[i]]++] = (int)i;
+				else
+					order[tail++] = (int)i;
+			for (std::size_t head = 0; head < tail; ++head)
+				for (int c = childStart[order[head]]; c < childStart[order[head] + 1]; ++c)
+					order[tail++] = children[c];
+			for (std::size_t i = 0; i < n; ++i)
+				newIndex[order[i]] = (int)i;
+
+			reorder(Local, order);
+			reorder(World, order);
+			std::vector<int> parent(n);
+			for (std::size_t i = 0; i < n; ++i)
+				parent[i] = Parent[order[i]] < 0 ? -1 : newIndex[Parent[order[i]]];
+			Parent.swap(parent);
+			for (std::size_t i = 0; i < n; ++i)
+				depth[i] = Parent[i] < 0 ? 0 : depth[Parent[i]] + 1;
+		}
+
+		// child ranges: in breadth-first order each node's children are together
+		firstChild.assign(n, (int)n);
+		childCount.assign(n, 0);
+		for (std::size_t i = n; i-- > 0;)
+			if (Parent[i] >= 0)
+			{
+				firstChild[Parent[i]] = (int)i;
+				++childCount[Parent[i]];
+			}
+
+		// nodes may have moved, so start from a full update
+		sorted = true;
+		built = true;
+		int levels = n ? depth.back() + 1 : 0;
+		pending.assign(levels, std::vector<int>());
+		std::fill(dirty.begin(), dirty.end(), 0);
+		for (std::size_t i = 0; i < n; ++i)
+			markDirty((int)i);
+		return newIndex;
+	}
+
+	void setPosition(int node, glm::vec3 position)
+	{
+		Local[node].Position = position;
+		markDirty(node);
+	}
+
+	// The quaternion must be unit length
+	void setRotation(int node, glm::quat rotation)
+	{
+		Local[node].Rotation = rotation;
+		markDirty(node);
+	}
+
+	void setScale(int node, glm::vec3 scale)
+	{
+		Local[node].Scale = scale;
+		markDirty(node);
+	}
+
+	// Recomputes World for every dirty node and all nodes below them. Returns
+	// how many that was.
+	std::size_t update()
+	{
+		if (!sorted || !built)
+			build();
+
+		// children of the nodes updated on the level above
+		std::vector<int>& above = updated[0];
+		std::vector<int>& nodes = updated[1];
+		std::size_t total = 0;
+		above.clear();
+		for (std::size_t level = 0; level < pending.size(); ++level)
+		{
+			// this level's nodes to update: the children of every node updated on
+			// the level above, and those changed directly that aren't among them
+			nodes.clear();
+			for (int p : above)
+				for (int c = firstChild[p], end = c + childCount[p]; c < end; ++c)
+					if (!dirty[c])
+					{
+						dirty[c] = 1;
+						nodes.push_back(c);
+					}
+			// both lists ascending, so the arrays are walked front to back
+			std::vector<int>& changed = pending[level];
+			std::sort(changed.begin(), changed.end());
+			std::size_t middle = nodes.size();
+			nodes.insert(nodes.end(), changed.begin(), changed.end());
+			std::inplace_merge(nodes.begin(), nodes.begin() + middle, nodes.end());
+			changed.clear();
+
+			pool.run(nodes.size(), 2048, [&](std::size_t begin, std::size_t end)
+			{
+				for (std::size_t k = begin; k < end; ++k)
+				{
+					int i = nodes[k];
+					glm::mat4 local = localMatrix(i);
+					World[i] = Parent[i] < 0 ? local : affineMultiply(World[Parent[i]], local);
+					dirty[i] = 0;
+				}
+			});
+			total += nodes.size();
+			above.swap(nodes);
+		}
+		return total;
+	}
+
+private:
+	WorkerPool pool;
+	std::vector<int> depth;
+	std::vector<int> firstChild, childCount;
+	std::vector<char> dirty;				// queued for the next update
+	std::vector<std::vector<int> > pending;	// nodes changed directly, by depth
+	std::vector<int> updated[2];
+	bool sorted;	// nodes are in breadth-first order
+	bool built;		// and build() has run since the last add()
+
+	void markDirty(int node)
+	{
+		if (dirty[node])
+			return;
+		dirty[node] = 1;
+		// until build() has run there is only the full update it queues
+		if (built && sorted)
+			pending[depth[node]].push_back(node);
+	}
+
+	template <typename T>
+	static void reorder(std::vector<T>& v, const std::vector<int>& order)
+	{
+		std::vector<T> sortedValues(v.size());
+		for (std::size_t i = 0; i < v.size(); ++i)
+			sortedValues[i] = v[order[i]];
+		v.swap(sortedValues);
+	}
+
+	glm::mat4 localMatrix(int i) const
+	{
+		const NodeTransform& t = Local[i];
+		glm::mat4 m = glm::mat4_cast(t.Rotation);
+		m[0] *= t.Scale.x;
+		m[1] *= t.Scale.y;
+		m[2] *= t.Scale.z;
+		m[3] = glm::vec4(t.Position, 1.0f);
+		return m;
+	}
+
+	// a * b for matrices whose last row is 0 0 0 1: 36 multiplies instead of 64
+	static glm::mat4 affineMultiply(const glm::mat4& a, const glm::mat4& b)
+	{
+		glm::mat4 r;
+		for (int c = 0; c < 4; ++c)
+		{
+			glm::vec4 v = a[0] * b[c].x + a[1] * b[c].y + a[2] * b[c].z;
+			r[c] = c < 3 ? v : v + a[3];
+		}
+		return r;
+	}
+};
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <glad/glad.h> // to get all opengl headers
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "stb_image.h"
+
+// Loads a Radiance .hdr (or any other image stb_image reads) into a
+// GL_RGB16F texture. stbi_loadh converts the RGBE data straight to half
+// floats, so there is no 32-bit float copy of the image and the upload is
+// half the size of a GL_FLOAT one. Returns 0 if the file can't be loaded.
+inline unsigned int loadHdrTexture(const char* path)
+{
+	int width, height, nrComponents;
+	stbi_us* data = stbi_loadh(path, &width, &height, &nrComponents, 3);
+	if (!data)
+	{
+		std::cerr << "Failed to load HDR image: " << path << std::endl;
+		return 0;
+	}
+
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	// Rows are 6 * width bytes, which is only 2-byte aligned for odd widths
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_HALF_FLOAT, data);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	stbi_image_free(data);
+	return texture;
+}
+
+// Decodes every frame of an animated GIF into one layer of a
+// GL_TEXTURE_2D_ARRAY, so a shader can pick the frame by layer index.
+// Layers are whole composited frames, which is what the GIF shows at that
+// time. The delay of each frame in milliseconds goes into delaysMs if it
+// isn't null. Returns 0 if the file can't be loaded.
+inline unsigned int loadGifTextureArray(const char* path, int* frames, std::vector<int>* delaysMs = nullptr)
+{
+	int width, height, count;
+	stbi_gif_anim* anim = stbi_gif_anim_open(path, &width, &height, &count);
+	if (!anim)
+	{
+		std::cerr << "Failed to load GIF: " << path << std::endl;
+		return 0;
+	}
+
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, count, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	if (delaysMs)
+		delaysMs->clear();
+	stbi_gif_frame frame;
+	int layer = 0;
+	while (layer < count && stbi_gif_anim_next(anim, &frame))
+	{
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, frame.pixels);
+		if (delaysMs)
+			delaysMs->push_back(frame.delay_ms);
+		++layer;
+	}
+	stbi_gif_anim_close(anim);
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	*frames = layer;
+	return texture;
+}
+
+// Plays an animated GIF into a single GL_TEXTURE_2D. Only the rectangle a
+// frame changed is uploaded, which for typical UI animations is a small part
+// of the canvas. The animation loops.
+class GifAnimation
+{
+public:
+	unsigned int ID = 0;
+	int Width = 0, Height = 0;
+
+	GifAnimation(const char* path)
+	{
+		int frames;
+		anim = stbi_gif_anim_open(path, &Width, &Height, &frames);
+		if (!anim)
+		{
+			std::cerr << "Failed to load GIF: " << path << std::endl;
+			return;
+		}
+
+		glGenTextures(1, &ID);
+		glBindTexture(GL_TEXTURE_2D, ID);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Width, Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		// the first frame always covers the whole canvas
+		nextFrame();
+	}
+
+	~GifAnimation()
+	{
+		stbi_gif_anim_close(anim);
+		glDeleteTextures(1, &ID);
+	}
+
+	GifAnimation(const GifAnimation&) = delete;
+	GifAnimation& operator=(const GifAnimation&) = delete;
+
+	// Advances the animation by deltaTime seconds, uploading any frames that
+	// come due.
+	void update(float deltaTime)
+	{
+		if (!anim)
+			return;
+		remaining -= deltaTime;
+		while (remaining <= 0.0f)
+			nextFrame();
+	}
+
+private:
+	stbi_gif_anim* anim = nullptr;
+	float remaining = 0.0f;
+
+	void nextFrame()
+	{
+		stbi_gif_frame frame;
+		if (!stbi_gif_anim_next(anim, &frame))
+		{
+			stbi_gif_anim_rewind(anim);
+			if (!stbi_gif_anim_next(anim, &frame))
+			{
+				remaining = 1e30f; // corrupt first frame, stop here
+				return;
+			}
+		}
+		// a frame with no delay shows for 100ms, as browsers do
+		remaining += (frame.delay_ms > 0 ? frame.delay_ms : 100) / 1000.0f;
+		if (frame.w <= 0 || frame.h <= 0)
+			return;
+
+		// upload just the changed rectangle straight out of the canvas
+		glBindTexture(GL_TEXTURE_2D, ID);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, Width);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, frame.x);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, frame.y);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, frame.x, frame.y, frame.w, frame.h, GL_RGBA, GL_UNSIGNED_BYTE, frame.pixels);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	}
+};
+
+// A list of textures that are all created before any of them is decoded.
+// The constructor reads every file's header (in parallel), allocates each
+// texture with its whole mip chain, and starts decoding on background
+// threads. The IDs can be bound straight away, though what they show is
+// undefined until their image arrives. Call update() once a frame on the
+// GL thread to upload the images that have finished decoding.
+class TextureBatch
+{
+public:
+	// one per path, 0 if the file couldn't be read
+	std::vector<unsigned int> IDs;
+
+	TextureBatch(const std::vector<std::string>& paths)
+		: IDs(paths.size(), 0), entries(paths.size()), states(paths.size())
+	{
+		start = std::chrono::steady_clock::now();
+
+		std::vector<const char*> names;
+		for (const std::string& path : paths)
+			names.push_back(path.c_str());
+		std::vector<stbi_info_result> info(paths.size());
+		stbi_info_many(names.data(), (int)names.size(), info.data());
+		probedMs = elapsedMs();
+
+		for (size_t i = 0; i < paths.size(); ++i)
+		{
+			Entry& e = entries[i];
+			e.path = paths[i];
+			if (!info[i].ok)
+			{
+				std::cerr << "Failed to read image header: " << e.path << std::endl;
+				states[i] = Failed;
+				continue;
+			}
+			e.width = info[i].x;
+			e.height = info[i].y;
+			// grey is expanded so shaders can sample .rgb as usual
+			e.channels = (info[i].comp == 2 || info[i].comp == 4) ? 4 : 3;
+			IDs[i] = allocate(e);
+		}
+		allocatedMs = elapsedMs();
+
+		unsigned int threads = std::max(1u, std::min(std::thread::hardware_concurrency(), (unsigned int)paths.size()));
+		for (unsigned int t = 0; t < threads; ++t)
+			workers.emplace_back(&TextureBatch::decode, this);
+	}
+
+	~TextureBatch()
+	{
+		next = entries.size(); // stop handing out work
+		for (std::thread& t : workers)
+			t.join();
+		for (Entry& e : entries)
+			stbi_image_free(e.pixels);
+		glDeleteTextures((GLsizei)IDs.size(), IDs.data());
+	}
+
+	TextureBatch(const TextureBatch&) = delete;
+	TextureBatch& operator=(const TextureBatch&) = delete;
+
+	// Uploads every image that has finished decoding since the last call and
+	// builds its mips. Returns how many are still on their way.
+	int update()
+	{
+		int pending = 0;
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			Entry& e = entries[i];
+			int state = states[i].load(std::memory_order_acquire);
+			if (state == Decoded)
+			{
+				GLenum format = e.channels == 4 ? GL_RGBA : GL_RGB;
+				glBindTexture(GL_TEXTURE_2D, IDs[i]);
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, e.width, e.height, format, GL_UNSIGNED_BYTE, e.pixels);
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+				glGenerateMipmap(GL_TEXTURE_2D);
+				stbi_image_free(e.pixels);
+				e.pixels = nullptr;
+				e.uploadedMs = elapsedMs();
+				states[i] = Uploaded;
+			}
+			else if (state == Failed && IDs[i])
+			{
+				// the header was fine but the image wasn't
+				std::cerr << "Failed to load texture: " << e.path << std::endl;
+				glDeleteTextures(1, &IDs[i]);
+				IDs[i] = 0;
+			}
+			else if (state == Queued)
+				++pending;
+		}
+		return pending;
+	}
+
+	// Prints when the headers were read, the textures allocated and each
+	// image uploaded, in milliseconds since the batch was created.
+	void printTimeline(std::ostream& out) const
+	{
+		out << "headers probed   " << probedMs << " ms" << std::endl;
+		out << "textures created " << allocatedMs << " ms" << std::endl;
+		for (const Entry& e : entries)
+			if (e.uploadedMs >= 0.0)
+				out << "uploaded         " << e.uploadedMs << " ms  " << e.path << std::endl;
+	}
+
+private:
+	enum { Queued, Decoded, Uploaded, Failed };
+
+	struct Entry
+	{
+		std::string path;
+		int width = 0, height = 0, channels = 0;
+		stbi_uc* pixels = nullptr;
+		double uploadedMs = -1.0;
+	};
+
+	std::vector<Entry> entries;
+	std::vector<std::atomic<int>> states;
+	std::atomic<size_t> next{ 0 };
+	std::vector<std::thread> workers;
+	std::chrono::steady_clock::time_point start;
+	double probedMs = 0.0, allocatedMs = 0.0;
+
+	double elapsedMs() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Creates the texture with every mip level allocated, which is what
+	// glTexStorage2D would do; this context is GL 3.3, which doesn't have it.
+	static unsigned int allocate(const Entry& e)
+	{
+		GLenum internalFormat = e.channels == 4 ? GL_RGBA8 : GL_RGB8;
+		GLenum format = e.channels == 4 ? GL_RGBA : GL_RGB;
+		int levels = 1;
+		while ((std::max(e.width, e.height) >> levels) > 0)
+			++levels;
+
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		for (int level = 0; level < levels; ++level)
+			glTexImage2D(GL_TEXTURE_2D, level, internalFormat, std::max(1, e.width >> level), std::max(1, e.height >> level), 0, format, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		return texture;
+	}
+
+	// Worker thread: decodes files until the list runs out.
+	void decode()
+	{
+		for (size_t i = next++; i < entries.size(); i = next++)
+		{
+			Entry& e = entries[i];
+			if (states[i] == Failed)
+				continue;
+			int width, height, channels;
+			e.pixels = stbi_load(e.path.c_str(), &width, &height, &channels, e.channels);
+			if (e.pixels && (width != e.width || height != e.height))
+			{
+				// changed on disk since it was probed
+				stbi_image_free(e.pixels);
+				e.pixels = nullptr;
+			}
+			states[i].store(e.pixels ? Decoded : Failed, std::memory_order_release);
+		}
+	}
+};
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// SSE does 4 objects per iteration; it is always there on x64 and on x86 with
+// the default /arch:SSE2. On those targets there is also an AVX kernel doing 8,
+// in TransformsAvx.cpp: the one file built with /arch:AVX2, so the rest of the
+// program still runs on CPUs without it. write() asks cpuid once and takes the
+// AVX kernel only where the CPU and OS support it. Every project including this
+// header compiles TransformsAvx.cpp, or defines TRANSFORMS_NO_AVX. Elsewhere
+// it's plain C++. Objects left over at the end go through the narrower paths.
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TRANSFORMS_SSE
+#include <xmmintrin.h>
+#if !defined(TRANSFORMS_NO_AVX)
+#define TRANSFORMS_AVX
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+#endif
+
+// Positions, rotations and scales of many objects, stored as one array per
+// component (structure of arrays), and turned into model matrices in bulk.
+//
+// glm::translate followed by glm::rotate costs trig and a full 4x4 multiply
+// per object, every frame. Here rotations are unit quaternions, so the
+// matrices need only a few multiplies each, and eight objects' worth of each
+// component sits side by side for the SIMD kernel. The matrices are written
+// one after the other, column-major like glm::mat4, straight into the
+// destination: typically a mapped instance buffer.
+class TransformBatch
+{
+public:
+	std::vector<float> PositionX, PositionY, PositionZ;
+	std::vector<float> RotationX, RotationY, RotationZ, RotationW;
+	std::vector<float> ScaleX, ScaleY, ScaleZ;
+
+	std::size_t size() const
+	{
+		return PositionX.size();
+	}
+
+	void clear()
+	{
+		resize(0);
+	}
+
+	// Adds an object rotated by 'angle' radians about 'axis', as glm::rotate does.
+	// Returns its index.
+	std::size_t add(glm::vec3 position, glm::vec3 axis, float angle, glm::vec3 scale = glm::vec3(1.0f))
+	{
+		return add(position, glm::angleAxis(angle, glm::normalize(axis)), scale);
+	}
+
+	std::size_t add(glm::vec3 position, glm::quat rotation, glm::vec3 scale = glm::vec3(1.0f))
+	{
+		std::size_t i = size();
+		resize(i + 1);
+		setPosition(i, position);
+		setRotation(i, rotation);
+		setScale(i, scale);
+		return i;
+	}
+
+	void setPosition(std::size_t i, glm::vec3 p)
+	{
+		PositionX[i] = p.x;
+		PositionY[i] = p.y;
+		PositionZ[i] = p.z;
+	}
+
+	// The quaternion must be unit length
+	void setRotation(std::size_t i, glm::quat q)
+	{
+		RotationX[i] = q.x;
+		RotationY[i] = q.y;
+		RotationZ[i] = q.z;
+		RotationW[i] = q.w;
+	}
+
+	void setScale(std::size_t i, glm::vec3 s)
+	{
+		ScaleX[i] = s.x;
+		ScaleY[i] = s.y;
+		ScaleZ[i] = s.z;
+	}
+
+	// Writes size() model matrices (translate * rotate * scale), 16 floats each.
+	void writeModelMatrices(float* out) const
+	{
+		write(out, NULL);
+	}
+
+	// Writes size() matrices of viewProjection * model, ready for gl_Position.
+	void writeMvpMatrices(const glm::mat4& viewProjection, float* out) const
+	{
+		write(out, &viewProjection[0][0]);
+	}
+
+	// Whether the write functions take the AVX kernel. enableAvx(false) makes
+	// them use SSE even where AVX is supported, to compare the two; call it
+	// while no other thread is writing matrices.
+	static bool avxEnabled()
+	{
+		return avxSetting();
+	}
+
+	static void enableAvx(bool enable)
+	{
+		avxSetting() = enable && avxSupported();
+	}
+
+private:
+	void resize(std::size_t n)
+	{
+		PositionX.resize(n); PositionY.resize(n); PositionZ.resize(n);
+		RotationX.resize(n); RotationY.resize(n); RotationZ.resize(n); RotationW.resize(n);
+		ScaleX.resize(n); ScaleY.resize(n); ScaleZ.resize(n);
+	}
+
+	// One lane per object. The kernel below is written once against these and
+	// runs with any of them.
+	struct Scalar
+	{
+		typedef float V;
+		static V load(const float* p) { return *p; }
+		static V set1(float f) { return f; }
+		static V add(V a, V b) { return a + b; }
+		static V sub(V a, V b) { return a - b; }
+		static V mul(V a, V b) { return a * b; }
+		static void storeMatrices(float* out, const V m[16])
+		{
+			for (int i = 0; i < 16; ++i)
+				out[i] = m[i];
+		}
+	};
+
+#if defined(TRANSFORMS_SSE)
+	struct Sse
+	{
+		typedef __m128 V;
+		static V load(const float* p) { return _mm_loadu_ps(p); }
+		static V set1(float f) { return _mm_set1_ps(f); }
+		static V add(V a, V b) { return _mm_add_ps(a, b); }
+		static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+		static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+		// m[k] holds element k of 4 matrices: transpose each group of four
+		// elements into the four matrices
+		static void storeMatrices(float* out, const V m[16])
+		{
+			for (int g = 0; g < 4; ++g)
+			{
+				V r0 = m[g * 4], r1 = m[g * 4 + 1], r2 = m[g * 4 + 2], r3 = m[g * 4 + 3];
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_mm_storeu_ps(out + g * 4, r0);
+				_mm_storeu_ps(out + 16 + g * 4, r1);
+				_mm_storeu_ps(out + 32 + g * 4, r2);
+				_mm_storeu_ps(out + 48 + g * 4, r3);
+			}
+		}
+	};
+#endif
+
+	// The component arrays as plain pointers: the kernel reads only these, so
+	// the AVX file instantiates nothing it might share with the other files
+	struct Arrays
+	{
+		const float *PositionX, *PositionY, *PositionZ;
+		const float *RotationX, *RotationY, *RotationZ, *RotationW;
+		const float *ScaleX, *ScaleY, *ScaleZ;
+	};
+
+	Arrays arrays() const
+	{
+		Arrays a = { PositionX.data(), PositionY.data(), PositionZ.data(),
+			RotationX.data(), RotationY.data(), RotationZ.data(), RotationW.data(),
+			ScaleX.data(), ScaleY.data(), ScaleZ.data() };
+		return a;
+	}
+
+	// Matrices for objects i onwards, as many as S has lanes
+	template <typename S>
+	static void kernel(const Arrays& a, std::size_t i, const float* viewProjection, float* out)
+	{
+		typedef typename S::V V;
+		V x = S::load(a.RotationX + i), y = S::load(a.RotationY + i), z = S::load(a.RotationZ + i), w = S::load(a.RotationW + i);
+		V sx = S::load(a.ScaleX + i), sy = S::load(a.ScaleY + i), sz = S::load(a.ScaleZ + i);
+		V one = S::set1(1.0f), zero = S::set1(0.0f);
+
+		// rotation matrix of a unit quaternion
+		V x2 = S::add(x, x), y2 = S::add(y, y), z2 = S::add(z, z);
+		V xx = S::mul(x, x2), yy = S::mul(y, y2), zz = S::mul(z, z2);
+		V xy = S::mul(x, y2), xz = S::mul(x, z2), yz = S::mul(y, z2);
+		V wx = S::mul(w, x2), wy = S::mul(w, y2), wz = S::mul(w, z2);
+
+		V m[16];
+		m[0] = S::mul(sx, S::sub(one, S::add(yy, zz)));
+		m[1] = S::mul(sx, S::add(xy, wz));
+		m[2] = S::mul(sx, S::sub(xz, wy));
+		m[3] = zero;
+		m[4] = S::mul(sy, S::sub(xy, wz));
+		m[5] = S::mul(sy, S::sub(one, S::add(xx, zz)));
+		m[6] = S::mul(sy, S::add(yz, wx));
+		m[7] = zero;
+		m[8] = S::mul(sz, S::add(xz, wy));
+		m[9] = S::mul(sz, S::sub(yz, wx));
+		m[10] = S::mul(sz, S::sub(one, S::add(xx, yy)));
+		m[11] = zero;
+		m[12] = S::load(a.PositionX + i);
+		m[13] = S::load(a.PositionY + i);
+		m[14] = S::load(a.PositionZ + i);
+		m[15] = one;
+
+		if (viewProjection)
+		{
+			// column c of VP * M is VP times column c of M; the last row of the
+			// model matrix is 0 0 0 1
+			V r[16];
+			for (int c = 0; c < 4; ++c)
+				for (int row = 0; row < 4; ++row)
+				{
+					V sum = S::mul(S::set1(viewProjection[row]), m[c * 4]);
+					sum = S::add(sum, S::mul(S::set1(viewProjection[4 + row]), m[c * 4 + 1]));
+					sum = S::add(sum, S::mul(S::set1(viewProjection[8 + row]), m[c * 4 + 2]));
+					if (c == 3)
+						sum = S::add(sum, S::set1(viewProjection[12 + row]));
+					r[c * 4 + row] = sum;
+				}
+			S::storeMatrices(out + i * 16, r);
+		}
+		else
+			S::storeMatrices(out + i * 16, m);
+	}
+
+#if defined(TRANSFORMS_AVX)
+	struct Avx; // 8 lanes, in TransformsAvx.cpp
+
+	// TransformsAvx.cpp: kernel<Avx> over the first n & ~7 objects; returns
+	// how many it did
+	static std::size_t writeAvx(const Arrays& a, std::size_t n, const float* viewProjection, float* out);
+
+	// AVX2 in the CPU, and ymm state saved by the OS (XGETBV). The kernel
+	// only needs AVX, but /arch:AVX2 lets the compiler use AVX2 and FMA too.
+	static bool probeAvx()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		bool fma = (info[2] & (1 << 12)) != 0;
+		if (!fma || (info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+	}
+#endif
+
+	// cpuid is slow, so it's asked once; C++11 makes the first call thread-safe
+	static bool avxSupported()
+	{
+#if defined(TRANSFORMS_AVX)
+		static const bool supported = probeAvx();
+		return supported;
+#else
+		return false;
+#endif
+	}
+
+	static bool& avxSetting()
+	{
+		static bool enabled = avxSupported();
+		return enabled;
+	}
+
+	void write(float* out, const float* viewProjection) const
+	{
+		Arrays a = arrays();
+		std::size_t n = size(), i = 0;
+#if defined(TRANSFORMS_AVX)
+		if (avxEnabled())
+			i = writeAvx(a, n, viewProjection, out);
+#endif
+#if defined(TRANSFORMS_SSE)
+		for (; i + 4 <= n; i += 4)
+			kernel<Sse>(a, i, viewProjection, out);
+#endif
+		for (; i < n; ++i)
+			kernel<Scalar>(a, i, viewProjection, out);
+	}
+};
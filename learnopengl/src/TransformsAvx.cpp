@@ -0,0 +1,61 @@
+// The AVX kernel of TransformBatch. This is the only file built with
+// /arch:AVX2, and Transforms.h only calls into it once cpuid says the CPU and
+// OS support AVX2. Nothing but the kernel itself is instantiated here, so no
+// inline function compiled with AVX can be merged with the copy the rest of
+// the program uses.
+
+// GCC and Clang take the target from here, with no per-file flags
+#if defined(__GNUC__) && !defined(__AVX2__)
+#pragma GCC target("avx2,fma")
+#endif
+
+#include "Transforms.h"
+
+#include <immintrin.h>
+
+#if defined(TRANSFORMS_AVX)
+
+struct TransformBatch::Avx
+{
+	typedef __m256 V;
+	static V load(const float* p) { return _mm256_loadu_ps(p); }
+	static V set1(float f) { return _mm256_set1_ps(f); }
+	static V add(V a, V b) { return _mm256_add_ps(a, b); }
+	static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+	static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+	// 8x8 transposes of elements 0-7 and 8-15 of 8 matrices
+	static void storeMatrices(float* out, const V m[16])
+	{
+		for (int half = 0; half < 2; ++half)
+		{
+			const V* r = m + half * 8;
+			V t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpackhi_ps(r[0], r[1]);
+			V t2 = _mm256_unpacklo_ps(r[2], r[3]), t3 = _mm256_unpackhi_ps(r[2], r[3]);
+			V t4 = _mm256_unpacklo_ps(r[4], r[5]), t5 = _mm256_unpackhi_ps(r[4], r[5]);
+			V t6 = _mm256_unpacklo_ps(r[6], r[7]), t7 = _mm256_unpackhi_ps(r[6], r[7]);
+			V s0 = _mm256_shuffle_ps(t0, t2, 0x44), s1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+			V s2 = _mm256_shuffle_ps(t1, t3, 0x44), s3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+			V s4 = _mm256_shuffle_ps(t4, t6, 0x44), s5 = _mm256_shuffle_ps(t4, t6, 0xEE);
+			V s6 = _mm256_shuffle_ps(t5, t7, 0x44), s7 = _mm256_shuffle_ps(t5, t7, 0xEE);
+			float* o = out + half * 8;
+			_mm256_storeu_ps(o, _mm256_permute2f128_ps(s0, s4, 0x20));
+			_mm256_storeu_ps(o + 16, _mm256_permute2f128_ps(s1, s5, 0x20));
+			_mm256_storeu_ps(o + 32, _mm256_permute2f128_ps(s2, s6, 0x20));
+			_mm256_storeu_ps(o + 48, _mm256_permute2f128_ps(s3, s7, 0x20));
+			_mm256_storeu_ps(o + 64, _mm256_permute2f128_ps(s0, s4, 0x31));
+			_mm256_storeu_ps(o + 80, _mm256_permute2f128_ps(s1, s5, 0x31));
+			_mm256_storeu_ps(o + 96, _mm256_permute2f128_ps(s2, s6, 0x31));
+			_mm256_storeu_ps(o + 112, _mm256_permute2f128_ps(s3, s7, 0x31));
+		}
+	}
+};
+
+std::size_t TransformBatch::writeAvx(const Arrays& a, std::size_t n, const float* viewProjection, float* out)
+{
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		kernel<Avx>(a, i, viewProjection, out);
+	return i;
+}
+
+#endif
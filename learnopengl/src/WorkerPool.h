@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads for parallel loops.
+//
+// run(count, grain, fn) splits [0, count) into chunks of 'grain' items and calls
+// fn(begin, end) for each chunk, on the workers and on the calling thread, and
+// returns once every chunk is done. The threads are started once and sleep
+// between runs, so a run costs a wake-up rather than a thread start. Loops no
+// bigger than one chunk run inline. Only one thread may call run at a time.
+class WorkerPool
+{
+public:
+	explicit WorkerPool(unsigned threads = std::thread::hardware_concurrency())
+		: job(nullptr), count(0), grain(1), next(0), busy(0), generation(0), stopping(false)
+	{
+		// the calling thread takes chunks too, so start one fewer
+		for (unsigned i = 1; i < threads; ++i)
+			workers.emplace_back(&WorkerPool::work, this);
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& t : workers)
+			t.join();
+	}
+
+	// Threads that work on a run, counting the caller
+	unsigned size() const
+	{
+		return (unsigned)workers.size() + 1;
+	}
+
+	void run(std::size_t itemCount, std::size_t chunkSize, const std::function<void(std::size_t, std::size_t)>& fn)
+	{
+		chunkSize = std::max<std::size_t>(chunkSize, 1);
+		if (workers.empty() || itemCount <= chunkSize)
+		{
+			if (itemCount > 0)
+				fn(0, itemCount);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &fn;
+			count = itemCount;
+			grain = chunkSize;
+			next = 0;
+			busy = workers.size();
+			++generation;
+		}
+		wake.notify_all();
+		doChunks();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return busy == 0; });
+		job = nullptr;
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+
+	// The current run; set under the mutex before the workers are woken
+	const std::function<void(std::size_t, std::size_t)>* job;
+	std::size_t count, grain;
+	std::atomic<std::size_t> next;
+	std::size_t busy;		// workers still in this run
+	unsigned generation;	// bumped for each run
+	bool stopping;
+
+	void doChunks()
+	{
+		for (;;)
+		{
+			std::size_t begin = next.fetch_add(grain);
+			if (begin >= count)
+				return;
+			(*job)(begin, std::min(begin + grain, count));
+		}
+	}
+
+	void work()
+	{
+		unsigned seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return stopping || generation != seen; });
+				if (stopping)
+					return;
+				seen = generation;
+			}
+			doChunks();
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--busy == 0)
+				done.notify_one();
+		}
+	}
+};
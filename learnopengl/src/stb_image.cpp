@@ -1,2 +1,3 @@
+#define STBI_THREADS
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
\ No newline at end of file
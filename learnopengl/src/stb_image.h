@@ -192,6 +192,12 @@ RECENT REVISION HISTORY:
 // The three functions you must define are "read" (reads some bytes of data),
 // "skip" (skips some bytes of data), "eof" (reports if the stream is at the end).
 //
+// The functions that take a filename (stbi_load etc.) don't go through this
+// buffer: where the OS supports it they memory-map the file (or, below 256KB,
+// read it whole) and decode it as if it came from stbi_load_from_memory,
+// which also lets restart-interval JPEGs use the threaded decoder. Define
+// STBI_NO_MMAP to stream files through stdio instead.
+//
 // ===========================================================================
 //
 // SIMD support
@@ -209,12 +215,47 @@ RECENT REVISION HISTORY:
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
 //
+// On x86 builds that use SSE2, AVX2 versions of the JPEG color conversion
+// and chroma upsampling kernels are also compiled, and are selected at
+// run-time with cpuid when the CPU (and OS) support AVX2. They produce
+// bit-identical output to the SSE2 and C paths. Define STBI_NO_AVX2 to
+// leave them out, e.g. if your compiler lacks AVX2 intrinsics.
+//
+// PNG scanline unfiltering also has SSE2 kernels (and a wider AVX2 one for
+// the Up filter) for 8-bit RGB/RGBA and 16-bit RGB/RGBA/grey-alpha images.
+// Other formats and bit depths use the C loops.
+//
+// Converting to a different req_comp (e.g. RGB to RGBA, or to grey) uses
+// pshufb-based kernels for every channel-count pair at 8 and 16 bits, and
+// 16-bit to 8-bit narrowing is vectorized as well. Since pshufb needs SSSE3,
+// which isn't tested for separately, the conversion kernels are only used on
+// AVX2 CPUs. All of these match the C loops bit for bit.
+//
 // If for some reason you do not want to use any of SIMD code, or if
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
 //
 // ===========================================================================
 //
+// Multithreaded JPEG decoding   (enable by defining STBI_THREADS)
+//
+// Baseline JPEGs that use restart intervals (DRI) are split by their RSTn
+// markers into independently decodable segments. With STBI_THREADS defined,
+// those segments are entropy-decoded and IDCT'd on several threads, and the
+// upsampling/color conversion afterwards runs in horizontal strips, also in
+// parallel. The work goes to a pool of Win32 threads or pthreads that is
+// started on first use and kept for later decodes.
+//
+// Only sources that are entirely in memory can be split this way, i.e. the
+// stbi_load_from_memory family and memory-mapped files; progressive JPEGs and files without restart
+// intervals are decoded serially as before. Output is identical either way.
+//
+// stbi_set_jpeg_threads(n) caps the number of threads; 0 (the default)
+// means one per available CPU, 1 disables threading. stbi_options has the
+// same setting per load.
+//
+// ===========================================================================
+//
 // HDR image support   (disable by defining STBI_NO_HDR)
 //
 // stb_image now supports loading HDR images in general, and currently
@@ -230,6 +271,13 @@ RECENT REVISION HISTORY:
 // (note, do not use _inverse_ constants; stbi_image will invert them
 // appropriately).
 //
+// The pow() in that remapping is evaluated with a polynomial approximation
+// (4 or 8 channels at a time with SSE2/AVX2). Its error is far below one
+// output step, but a channel whose exact value sits right at a rounding
+// boundary can come out one higher or lower; in testing that happened about
+// once per 10 million values. LDR images loaded as float (stbi_loadf) go
+// through a 256-entry table and are exact.
+//
 // Additionally, there is a new, parallel interface for loading files as
 // (linear) floats to preserve the full dynamic range:
 //
@@ -360,6 +408,26 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in
 // for stbi_load_from_file, file pointer is left pointing immediately after image
 #endif
 
+////////////////////////////////////
+//
+// 8-bits-per-channel, into memory you provide
+//
+// Decodes into 'out' (e.g. a mapped pixel buffer object) instead of
+// allocating. Get the size with stbi_info first; rows are 'out_stride'
+// bytes apart (0 = packed), so 'out' must hold (y-1)*out_stride +
+// x*channels bytes, where channels is desired_channels or, if that is 0,
+// the channel count stbi_info reports. Returns 1 on success, 0 on failure
+// (including "buffer too small"). JPEG and most 8-bit PNGs are written
+// straight into 'out'; other formats are decoded as usual and copied.
+
+STBIDEF int stbi_load_from_memory_into   (stbi_uc           const *buffer, int len   , stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int stbi_load_from_callbacks_into(stbi_io_callbacks const *clbk  , void *user, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *channels_in_file, int desired_channels);
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_load_into            (char const *filename, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int stbi_load_from_file_into  (FILE *f, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *channels_in_file, int desired_channels);
+#endif
+
 ////////////////////////////////////
 //
 // 16-bits-per-channel interface
@@ -387,6 +455,24 @@ STBIDEF stbi_us *stbi_load_from_file_16(FILE *f, int *x, int *y, int *channels_i
    #endif
 #endif
 
+////////////////////////////////////
+//
+// half-float-per-channel interface
+//
+// same results as the float interface, but each channel is an IEEE half
+// float (rounded to nearest even), e.g. for GL_RGB16F textures uploaded as
+// GL_HALF_FLOAT. Radiance files are converted straight from RGBE, so there
+// is never a 32-bit float copy of the image.
+#ifndef STBI_NO_LINEAR
+   STBIDEF stbi_us *stbi_loadh_from_memory   (stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels);
+   STBIDEF stbi_us *stbi_loadh_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y,  int *channels_in_file, int desired_channels);
+
+   #ifndef STBI_NO_STDIO
+   STBIDEF stbi_us *stbi_loadh          (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
+   STBIDEF stbi_us *stbi_loadh_from_file(FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
+   #endif
+#endif
+
 #ifndef STBI_NO_HDR
    STBIDEF void   stbi_hdr_to_ldr_gamma(float gamma);
    STBIDEF void   stbi_hdr_to_ldr_scale(float scale);
@@ -407,7 +493,8 @@ STBIDEF int      stbi_is_hdr_from_file(FILE *f);
 
 
 // get a VERY brief reason for failure
-// NOT THREADSAFE
+// the reason is kept per thread if the compiler supports thread-local
+// storage (define STBI_NO_THREAD_LOCALS to turn that off); otherwise NOT THREADSAFE
 STBIDEF const char *stbi_failure_reason  (void);
 
 // free the loaded image -- this is just free()
@@ -421,6 +508,17 @@ STBIDEF int      stbi_info_from_callbacks(stbi_io_callbacks const *clbk, void *u
 STBIDEF int      stbi_info            (char const *filename,     int *x, int *y, int *comp);
 STBIDEF int      stbi_info_from_file  (FILE *f,                  int *x, int *y, int *comp);
 
+// probe a whole list of files, e.g. every texture at startup, so they can
+// all be allocated before any is decoded. with STBI_THREADS the files are
+// spread over up to one thread per CPU (or stbi_set_jpeg_threads). returns
+// how many headers were read; the others get ok = 0 and a size of 0.
+typedef struct
+{
+   int x, y, comp;
+   int ok;
+} stbi_info_result;
+
+STBIDEF int      stbi_info_many       (char const * const *filenames, int count, stbi_info_result *results);
 #endif
 
 
@@ -437,6 +535,103 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// maximum number of threads used to decode one JPEG; 0 = number of CPUs.
+// only has an effect if the implementation was compiled with STBI_THREADS
+STBIDEF void stbi_set_jpeg_threads(int num_threads);
+
+// a decoder keeps the JPEG and PNG decoders' scratch memory (the JPEG state,
+// component planes and line buffers, the PNG IDAT data and the inflated
+// scanlines) between loads, so loading many images doesn't malloc and free
+// (and page-fault in) the same large buffers every time. the cached blocks
+// come from STBI_MALLOC/STBI_REALLOC and only grow; stbi_decoder_free gives
+// them back. a decoder must only be used by one load at a time, so keep
+// one per worker thread. the image a load returns is never pooled and is
+// freed with stbi_image_free as usual.
+typedef struct stbi_decoder stbi_decoder;
+
+STBIDEF stbi_decoder *stbi_decoder_create(void);
+STBIDEF void          stbi_decoder_free(stbi_decoder *dec);
+
+// the setters above change the defaults for all loads and aren't meant to
+// be called while other threads are loading. to use different settings on
+// different threads, pass a stbi_options to the *_ex loaders below: fill it
+// in with stbi_get_default_options, then change what you need. passing
+// NULL options is the same as calling the plain loader.
+//
+// jpeg_scale decodes JPEGs straight to 1/2, 1/4 or 1/8 size, for thumbnails,
+// low mips or a placeholder while the full image streams in. it uses a
+// smaller IDCT per block (down to just the DC term at 1/8) and does the
+// upsampling and color conversion at the reduced size, so it is several
+// times faster than a full decode; only the entropy decoding costs the
+// same. the returned size is the scaled one, rounded up. other formats
+// ignore it.
+typedef struct
+{
+   int   flip_vertically;           // stbi_set_flip_vertically_on_load
+   int   unpremultiply;             // stbi_set_unpremultiply_on_load
+   int   convert_iphone_png_to_rgb; // stbi_convert_iphone_png_to_rgb
+   float ldr_to_hdr_gamma, ldr_to_hdr_scale; // stbi_ldr_to_hdr_gamma/scale
+   float hdr_to_ldr_gamma, hdr_to_ldr_scale; // stbi_hdr_to_ldr_gamma/scale
+   stbi_decoder *decoder;           // scratch buffers to reuse, or NULL
+   int   jpeg_scale;                // 1, 2, 4 or 8: decode JPEGs at 1/n size
+   int   jpeg_threads;              // stbi_set_jpeg_threads
+} stbi_options;
+
+STBIDEF void stbi_get_default_options(stbi_options *opt);
+
+STBIDEF stbi_uc *stbi_load_from_memory_ex        (stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+STBIDEF stbi_uc *stbi_load_from_callbacks_ex     (stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+STBIDEF stbi_us *stbi_load_16_from_memory_ex     (stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+STBIDEF stbi_us *stbi_load_16_from_callbacks_ex  (stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+STBIDEF int      stbi_load_from_memory_into_ex   (stbi_uc const *buffer, int len, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+STBIDEF int      stbi_load_from_callbacks_into_ex(stbi_io_callbacks const *clbk, void *user, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+#ifndef STBI_NO_LINEAR
+STBIDEF float   *stbi_loadf_from_memory_ex       (stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+STBIDEF float   *stbi_loadf_from_callbacks_ex    (stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+#endif
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_ex                    (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+STBIDEF stbi_us *stbi_load_16_ex                 (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+STBIDEF int      stbi_load_into_ex               (char const *filename, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+#ifndef STBI_NO_LINEAR
+STBIDEF float   *stbi_loadf_ex                   (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+#endif
+STBIDEF stbi_uc *stbi_load_from_file_ex          (FILE *f, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+STBIDEF stbi_us *stbi_load_from_file_16_ex       (FILE *f, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+STBIDEF int      stbi_load_from_file_into_ex     (FILE *f, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+#ifndef STBI_NO_LINEAR
+STBIDEF float   *stbi_loadf_from_file_ex         (FILE *f, int *x, int *y, int *channels_in_file, int desired_channels, stbi_options const *opt);
+#endif
+#endif
+
+// animated GIFs: the plain loaders only return the first frame. these step
+// through every frame instead, compositing each onto one RGBA canvas the
+// way a browser would (honoring the disposal methods), and report which
+// rectangle of the canvas changed so only that part needs re-uploading.
+// frames come out top row first regardless of the flip setting.
+typedef struct stbi_gif_anim stbi_gif_anim;
+
+typedef struct
+{
+   stbi_uc *pixels;   // the whole w*h RGBA canvas, valid until the next call
+   int delay_ms;      // how long to show this frame
+   int x, y, w, h;    // the part of the canvas this frame changed
+} stbi_gif_frame;
+
+// *frames is counted by skipping over the image data, without decoding it.
+// the buffer passed to _from_memory has to stay around until the close.
+STBIDEF stbi_gif_anim *stbi_gif_anim_open_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *frames);
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_gif_anim *stbi_gif_anim_open(char const *filename, int *x, int *y, int *frames);
+#endif
+// returns 1 and fills in *frame, or 0 after the last frame (or on a corrupt
+// frame, in which case stbi_failure_reason says why)
+STBIDEF int            stbi_gif_anim_next(stbi_gif_anim *anim, stbi_gif_frame *frame);
+// start again from the first frame, e.g. to loop
+STBIDEF void           stbi_gif_anim_rewind(stbi_gif_anim *anim);
+STBIDEF void           stbi_gif_anim_close(stbi_gif_anim *anim);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -527,18 +722,38 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
    #define stbi_inline __forceinline
 #endif
 
+#ifndef STBI_NO_THREAD_LOCALS
+   #if defined(__cplusplus) && __cplusplus >= 201103L
+      #define STBI_THREAD_LOCAL       thread_local
+   #elif defined(__GNUC__) && __GNUC__ < 5
+      #define STBI_THREAD_LOCAL       __thread
+   #elif defined(_MSC_VER)
+      #define STBI_THREAD_LOCAL       __declspec(thread)
+   #elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+      #define STBI_THREAD_LOCAL       _Thread_local
+   #elif defined(__GNUC__)
+      #define STBI_THREAD_LOCAL       __thread
+   #endif
+#endif
+
+#ifndef STBI_THREAD_LOCAL
+#define STBI_THREAD_LOCAL
+#endif
+
 
 #ifdef _MSC_VER
 typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -656,6 +871,79 @@ static int stbi__sse2_available(void)
    return 1;
 }
 #endif
+
+// AVX2 kernels are compiled alongside the SSE2 ones and picked at run-time.
+// Unlike SSE2 we can't assume AVX2 from the compiler flags, so on GCC/Clang
+// the kernels are tagged with a target attribute instead of needing -mavx2.
+#if !defined(STBI_NO_AVX2) && defined(_MSC_VER) && !defined(__clang__) && _MSC_VER >= 1800
+#define STBI_AVX2
+#define STBI__AVX2_TARGET
+#define STBI__AVX2_INLINE __forceinline
+#define STBI__F16C_TARGET
+#include <immintrin.h>
+
+#include <intrin.h>
+
+// cpuid and xgetbv are slow, so the answers are looked up once. both are
+// packed into one word that is only ever written with an interlocked
+// store, so a thread sees either no answers yet (and probes itself) or
+// both of them; threads racing on the first call store the same value.
+#define STBI__CPU_PROBED 1
+#define STBI__CPU_AVX2   2
+#define STBI__CPU_F16C   4
+static volatile long stbi__cpu_flags = 0;
+
+static long stbi__cpu_probe(void)
+{
+   int info[4];
+   long flags = stbi__cpu_flags;
+   if (flags) return flags;
+   flags = STBI__CPU_PROBED;
+   __cpuid(info,1);
+   if ((info[2] >> 29) & 1) flags |= STBI__CPU_F16C;
+   // need AVX + OSXSAVE, and the OS must save the upper halves of ymm
+   if ((info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6) {
+      __cpuidex(info,7,0);
+      if ((info[1] >> 5) & 1) flags |= STBI__CPU_AVX2;
+   }
+   _InterlockedExchange(&stbi__cpu_flags, flags);
+   return flags;
+}
+
+static int stbi__avx2_available(void)
+{
+   return (stbi__cpu_probe() & STBI__CPU_AVX2) != 0;
+}
+
+static int stbi__f16c_available(void)
+{
+   return (stbi__cpu_probe() & STBI__CPU_F16C) != 0;
+}
+#elif !defined(STBI_NO_AVX2) && defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#define STBI_AVX2
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+#define STBI__AVX2_INLINE __inline__ __attribute__((target("avx2"), always_inline))
+#define STBI__F16C_TARGET __attribute__((target("avx2,f16c")))
+#include <immintrin.h>
+
+#include <cpuid.h>
+
+static int stbi__avx2_available(void)
+{
+   // checks both the cpuid bit and that the OS has enabled ymm state;
+   // __builtin_cpu_supports just reads what libgcc probed at startup
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx2") != 0;
+}
+
+// CPUID leaf 1, ECX bit 29. F16C is only used next to AVX2, so the OS
+// check above covers it. asked once per image, so not cached
+static int stbi__f16c_available(void)
+{
+   unsigned int a, b, c, d;
+   return __get_cpuid(1, &a, &b, &c, &d) && ((c >> 29) & 1) != 0;
+}
+#endif
 #endif
 
 // ARM NEON
@@ -673,6 +961,208 @@ static int stbi__sse2_available(void)
 #define STBI_SIMD_ALIGN(type, name) type name
 #endif
 
+// the thread pool and the file mapping below are the only users of
+// windows.h. it's included here once, lean and without the min/max macros,
+// and neither define is left behind for the code that includes us.
+#if defined(_WIN32) && (defined(STBI_THREADS) || (!defined(STBI_NO_MMAP) && !defined(STBI_NO_STDIO)))
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#define STBI__UNDEF_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#define STBI__UNDEF_NOMINMAX
+#endif
+#include <windows.h>
+#ifdef STBI__UNDEF_LEAN_AND_MEAN
+#undef WIN32_LEAN_AND_MEAN
+#undef STBI__UNDEF_LEAN_AND_MEAN
+#endif
+#ifdef STBI__UNDEF_NOMINMAX
+#undef NOMINMAX
+#undef STBI__UNDEF_NOMINMAX
+#endif
+#endif
+
+// minimal thread pool: stbi__parallel_run(func, job, count) calls
+// func(job, i) once for each i in [0,count) and returns when all of them
+// are done. the calling thread takes indices as well, so it never waits on
+// work nobody has picked up. the pool's threads are started the first time
+// they're needed, grow to the largest count asked for and then stay parked
+// until the process exits. if a thread can't be created, the threads that
+// exist do its share, so this never fails.
+#ifdef STBI_THREADS
+#define STBI__MAX_THREADS 64
+
+typedef void (*stbi__thread_func)(void *job, int index);
+
+// one stbi__parallel_run call; the counters are guarded by the pool lock
+typedef struct stbi__pool_job
+{
+   stbi__thread_func func;
+   void *job;
+   int count, next, done;
+   struct stbi__pool_job *link;
+} stbi__pool_job;
+
+static void stbi__pool_serve(void);
+
+#ifdef _WIN32
+typedef CONDITION_VARIABLE stbi__cond;
+
+static SRWLOCK stbi__pool_mutex = SRWLOCK_INIT;
+static stbi__cond stbi__pool_work = CONDITION_VARIABLE_INIT, stbi__pool_done = CONDITION_VARIABLE_INIT;
+
+static void stbi__pool_lock(void)   { AcquireSRWLockExclusive(&stbi__pool_mutex); }
+static void stbi__pool_unlock(void) { ReleaseSRWLockExclusive(&stbi__pool_mutex); }
+static void stbi__pool_wait(stbi__cond *c)   { SleepConditionVariableSRW(c, &stbi__pool_mutex, INFINITE, 0); }
+static void stbi__pool_wake(stbi__cond *c)   { WakeAllConditionVariable(c); }
+
+static DWORD WINAPI stbi__pool_main(LPVOID arg)
+{
+   STBI_NOTUSED(arg);
+   stbi__pool_serve();
+   return 0;
+}
+
+static int stbi__pool_spawn(void)
+{
+   HANDLE th = CreateThread(NULL, 0, stbi__pool_main, NULL, 0, NULL);
+   if (th == NULL) return 0;
+   CloseHandle(th);
+   return 1;
+}
+
+static int stbi__cpu_count(void)
+{
+   SYSTEM_INFO info;
+   GetSystemInfo(&info);
+   return (int) info.dwNumberOfProcessors;
+}
+#else
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_cond_t stbi__cond;
+
+static pthread_mutex_t stbi__pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static stbi__cond stbi__pool_work = PTHREAD_COND_INITIALIZER, stbi__pool_done = PTHREAD_COND_INITIALIZER;
+
+static void stbi__pool_lock(void)   { pthread_mutex_lock(&stbi__pool_mutex); }
+static void stbi__pool_unlock(void) { pthread_mutex_unlock(&stbi__pool_mutex); }
+static void stbi__pool_wait(stbi__cond *c)   { pthread_cond_wait(c, &stbi__pool_mutex); }
+static void stbi__pool_wake(stbi__cond *c)   { pthread_cond_broadcast(c); }
+
+static void *stbi__pool_main(void *arg)
+{
+   STBI_NOTUSED(arg);
+   stbi__pool_serve();
+   return NULL;
+}
+
+static int stbi__pool_spawn(void)
+{
+   pthread_t th;
+   if (pthread_create(&th, NULL, stbi__pool_main, NULL) != 0) return 0;
+   pthread_detach(th);
+   return 1;
+}
+
+static int stbi__cpu_count(void)
+{
+   long n = sysconf(_SC_NPROCESSORS_ONLN);
+   return n > 0 ? (int) n : 1;
+}
+#endif
+
+static stbi__pool_job *stbi__pool_queue; // calls with indices left to hand out
+static int stbi__pool_threads;           // threads started so far
+
+// hands out the next index of j, and takes j off the queue once every
+// index is out. called with the lock held
+static int stbi__pool_take(stbi__pool_job *j)
+{
+   int i = j->next++;
+   if (j->next == j->count) {
+      stbi__pool_job **p = &stbi__pool_queue;
+      while (*p != j) p = &(*p)->link;
+      *p = j->link;
+   }
+   return i;
+}
+
+// runs index i of j outside the lock, then counts it as done
+static void stbi__pool_run(stbi__pool_job *j, int i)
+{
+   stbi__pool_unlock();
+   j->func(j->job, i);
+   stbi__pool_lock();
+   if (++j->done == j->count)
+      stbi__pool_wake(&stbi__pool_done);
+}
+
+static void stbi__pool_serve(void)
+{
+   stbi__pool_lock();
+   for (;;) {
+      stbi__pool_job *j;
+      while (stbi__pool_queue == NULL)
+         stbi__pool_wait(&stbi__pool_work);
+      j = stbi__pool_queue;
+      stbi__pool_run(j, stbi__pool_take(j));
+   }
+}
+
+// how many threads to use for 'work' independent pieces of work, given
+// the load's jpeg_threads setting (0 = one per CPU)
+static int stbi__thread_count(int limit, int work)
+{
+   int n = limit ? limit : stbi__cpu_count();
+   if (n > STBI__MAX_THREADS) n = STBI__MAX_THREADS;
+   if (n > work) n = work;
+   return n < 1 ? 1 : n;
+}
+
+static void stbi__parallel_run(stbi__thread_func func, void *job, int count)
+{
+   stbi__pool_job j, **p;
+   STBI_ASSERT(count >= 1 && count <= STBI__MAX_THREADS);
+   if (count == 1) {
+      func(job, 0);
+      return;
+   }
+   j.func = func;
+   j.job = job;
+   j.count = count;
+   j.next = j.done = 0;
+   j.link = NULL;
+   stbi__pool_lock();
+   while (stbi__pool_threads < count-1 && stbi__pool_spawn())
+      ++stbi__pool_threads;
+   // at the back, so earlier calls from other threads are served first
+   for (p = &stbi__pool_queue; *p; p = &(*p)->link) {}
+   *p = &j;
+   stbi__pool_wake(&stbi__pool_work);
+   while (j.next < j.count)
+      stbi__pool_run(&j, stbi__pool_take(&j));
+   while (j.done < j.count)
+      stbi__pool_wait(&stbi__pool_done);
+   stbi__pool_unlock();
+}
+#endif // STBI_THREADS
+
+///////////////////////////////////////////////
+//
+//  defaults for the per-load settings, changed by the global setters and
+//  copied into each stbi__context when a load starts
+
+static int stbi__vertically_flip_on_load = 0;
+static int stbi__unpremultiply_on_load = 0;
+static int stbi__de_iphone_flag = 0;
+static float stbi__l2h_gamma=2.2f, stbi__l2h_scale=1.0f;
+static float stbi__h2l_gamma_i=1.0f/2.2f, stbi__h2l_scale_i=1.0f;
+static int stbi__jpeg_threads = 0;
+
 ///////////////////////////////////////////////
 //
 //  stbi__context struct and start_xxx functions
@@ -693,16 +1183,73 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   // caller-provided output for the *_into loads; see stbi__dest_rows
+   stbi_uc *dest, *dest_row0;
+   int dest_size, dest_stride;
+
+   // settings for this load; decoders read these, never the globals
+   int flip_vertically, unpremultiply, de_iphone;
+   float l2h_gamma, l2h_scale, h2l_gamma_i, h2l_scale_i;
+   stbi_decoder *decoder;
+   int jpeg_scale; // log2 of stbi_options.jpeg_scale
+   int jpeg_threads;
 } stbi__context;
 
 
 static void stbi__refill_buffer(stbi__context *s);
 
+static void stbi__start_options(stbi__context *s)
+{
+   s->dest = s->dest_row0 = NULL;
+   s->flip_vertically = stbi__vertically_flip_on_load;
+   s->unpremultiply = stbi__unpremultiply_on_load;
+   s->de_iphone = stbi__de_iphone_flag;
+   s->l2h_gamma = stbi__l2h_gamma;
+   s->l2h_scale = stbi__l2h_scale;
+   s->h2l_gamma_i = stbi__h2l_gamma_i;
+   s->h2l_scale_i = stbi__h2l_scale_i;
+   s->decoder = NULL;
+   s->jpeg_scale = 0;
+   s->jpeg_threads = stbi__jpeg_threads;
+}
+
+// override the defaults with the caller's per-load settings, if any
+static void stbi__apply_options(stbi__context *s, stbi_options const *opt)
+{
+   if (!opt) return;
+   s->flip_vertically = opt->flip_vertically;
+   s->unpremultiply = opt->unpremultiply;
+   s->de_iphone = opt->convert_iphone_png_to_rgb;
+   s->l2h_gamma = opt->ldr_to_hdr_gamma;
+   s->l2h_scale = opt->ldr_to_hdr_scale;
+   s->h2l_gamma_i = 1/opt->hdr_to_ldr_gamma;
+   s->h2l_scale_i = 1/opt->hdr_to_ldr_scale;
+   s->decoder = opt->decoder;
+   s->jpeg_scale = opt->jpeg_scale == 8 ? 3 : opt->jpeg_scale == 4 ? 2 : opt->jpeg_scale == 2 ? 1 : 0;
+   s->jpeg_threads = opt->jpeg_threads < 0 ? 0 : opt->jpeg_threads;
+}
+
+STBIDEF void stbi_get_default_options(stbi_options *opt)
+{
+   opt->flip_vertically = stbi__vertically_flip_on_load;
+   opt->unpremultiply = stbi__unpremultiply_on_load;
+   opt->convert_iphone_png_to_rgb = stbi__de_iphone_flag;
+   opt->ldr_to_hdr_gamma = stbi__l2h_gamma;
+   opt->ldr_to_hdr_scale = stbi__l2h_scale;
+   opt->hdr_to_ldr_gamma = 1/stbi__h2l_gamma_i;
+   opt->hdr_to_ldr_scale = 1/stbi__h2l_scale_i;
+   opt->decoder = NULL;
+   opt->jpeg_scale = 1;
+   opt->jpeg_threads = stbi__jpeg_threads;
+}
+
 // initialize a memory-decode context
 static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
 {
    s->io.read = NULL;
    s->read_from_callbacks = 0;
+   stbi__start_options(s);
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
 }
@@ -712,6 +1259,7 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
 {
    s->io = *c;
    s->io_user_data = user;
+   stbi__start_options(s);
    s->buflen = sizeof(s->buffer_start);
    s->read_from_callbacks = 1;
    s->img_buffer_original = s->buffer_start;
@@ -807,6 +1355,7 @@ static int      stbi__psd_info(stbi__context *s, int *x, int *y, int *comp);
 #ifndef STBI_NO_HDR
 static int      stbi__hdr_test(stbi__context *s);
 static float   *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri);
+static void    *stbi__hdr_load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, int half);
 static int      stbi__hdr_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
@@ -828,8 +1377,8 @@ static void    *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int
 static int      stbi__pnm_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
-// this is not threadsafe
-static const char *stbi__g_failure_reason;
+// one per thread where supported, so concurrent loads don't clobber it
+static STBI_THREAD_LOCAL const char *stbi__g_failure_reason;
 
 STBIDEF const char *stbi_failure_reason(void)
 {
@@ -892,12 +1441,14 @@ static int stbi__mad3sizes_valid(int a, int b, int c, int add)
       stbi__addsizes_valid(a*b*c, add);
 }
 
+#if !defined(STBI_NO_LINEAR) || !defined(STBI_NO_HDR)
 // returns 1 if "a*b*c*d + add" has no negative terms/factors and doesn't overflow
 static int stbi__mad4sizes_valid(int a, int b, int c, int d, int add)
 {
    return stbi__mul2sizes_valid(a, b) && stbi__mul2sizes_valid(a*b, c) &&
       stbi__mul2sizes_valid(a*b*c, d) && stbi__addsizes_valid(a*b*c*d, add);
 }
+#endif
 
 // mallocs with size overflow checking
 static void *stbi__malloc_mad2(int a, int b, int add)
@@ -912,11 +1463,115 @@ static void *stbi__malloc_mad3(int a, int b, int c, int add)
    return stbi__malloc(a*b*c + add);
 }
 
-static void *stbi__malloc_mad4(int a, int b, int c, int d, int add)
+//////////////////////////////////////////////////////////////////////////////
+//
+//  stbi_decoder - scratch blocks kept across loads
+//
+//  decoders allocate their temporary buffers with stbi__scratch_* instead
+//  of STBI_MALLOC. with no decoder those are plain STBI_MALLOC/STBI_FREE;
+//  with one, freed blocks stay in the pool and the next request takes the
+//  smallest free block that's big enough. a request nothing fits regrows
+//  the biggest free block, so each slot settles at the size of the buffer
+//  it keeps serving. when every slot is in use it falls back to STBI_MALLOC.
+
+#define STBI__DECODER_SLOTS  16
+
+struct stbi_decoder
+{
+   void  *block[STBI__DECODER_SLOTS];
+   size_t size[STBI__DECODER_SLOTS];
+   int    used[STBI__DECODER_SLOTS];
+};
+
+STBIDEF stbi_decoder *stbi_decoder_create(void)
+{
+   stbi_decoder *d = (stbi_decoder *) stbi__malloc(sizeof(*d));
+   if (d) memset(d, 0, sizeof(*d));
+   return d;
+}
+
+STBIDEF void stbi_decoder_free(stbi_decoder *d)
+{
+   int i;
+   if (!d) return;
+   for (i=0; i < STBI__DECODER_SLOTS; ++i)
+      STBI_FREE(d->block[i]);
+   STBI_FREE(d);
+}
+
+static int stbi__scratch_slot(stbi_decoder *d, void *p)
+{
+   int i;
+   for (i=0; i < STBI__DECODER_SLOTS; ++i)
+      if (d->block[i] == p && d->used[i]) return i;
+   return -1;
+}
+
+static void *stbi__scratch_malloc(stbi_decoder *d, size_t size)
+{
+   int i, fit = -1, big = -1, empty = -1;
+   if (!d) return stbi__malloc(size);
+   for (i=0; i < STBI__DECODER_SLOTS; ++i) {
+      if (d->used[i]) continue;
+      if (!d->block[i]) { if (empty < 0) empty = i; continue; }
+      if (d->size[i] >= size) {
+         if (fit < 0 || d->size[i] < d->size[fit]) fit = i;
+      } else if (big < 0 || d->size[i] > d->size[big])
+         big = i;
+   }
+   if (fit < 0) {
+      fit = big >= 0 ? big : empty;
+      if (fit < 0) return stbi__malloc(size);
+      // the old contents don't matter, so don't let realloc copy them
+      STBI_FREE(d->block[fit]);
+      d->block[fit] = stbi__malloc(size);
+      d->size[fit] = d->block[fit] ? size : 0;
+      if (!d->block[fit]) return NULL;
+   }
+   d->used[fit] = 1;
+   return d->block[fit];
+}
+
+static void stbi__scratch_free(stbi_decoder *d, void *p)
+{
+   int i = d ? stbi__scratch_slot(d, p) : -1;
+   if (i >= 0)
+      d->used[i] = 0;
+   else
+      STBI_FREE(p);
+}
+
+#ifndef STBI_NO_ZLIB
+static void *stbi__scratch_realloc(stbi_decoder *d, void *p, size_t oldsz, size_t newsz)
+{
+   int i;
+   void *q;
+   STBI_NOTUSED(oldsz); // only if STBI_REALLOC_SIZED ignores it
+   if (!p) return stbi__scratch_malloc(d, newsz);
+   i = d ? stbi__scratch_slot(d, p) : -1;
+   if (i < 0) return STBI_REALLOC_SIZED(p, oldsz, newsz);
+   if (d->size[i] >= newsz) return p;
+   q = STBI_REALLOC_SIZED(p, d->size[i], newsz);
+   if (q == NULL) return NULL; // p is still in the slot and freed with it
+   d->block[i] = q;
+   d->size[i] = newsz;
+   return q;
+}
+#endif
+
+#ifndef STBI_NO_JPEG
+static void *stbi__scratch_mad2(stbi_decoder *d, int a, int b, int add)
+{
+   if (!stbi__mad2sizes_valid(a, b, add)) return NULL;
+   return stbi__scratch_malloc(d, a*b + add);
+}
+
+static void *stbi__scratch_mad3(stbi_decoder *d, int a, int b, int c, int add)
 {
-   if (!stbi__mad4sizes_valid(a, b, c, d, add)) return NULL;
-   return stbi__malloc(a*b*c*d + add);
+   if (!stbi__mad3sizes_valid(a, b, c, add)) return NULL;
+   return stbi__scratch_malloc(d, a*b*c + add);
 }
+#endif
 
 // stbi__err - error
 // stbi__errpf - error returning pointer to float
@@ -939,20 +1594,58 @@ STBIDEF void stbi_image_free(void *retval_from_stbi_load)
 }
 
 #ifndef STBI_NO_LINEAR
-static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp);
+static float   *stbi__ldr_to_hdr(stbi__context *s, stbi_uc *data, int x, int y, int comp);
+static stbi__uint16 *stbi__ldr_to_half(stbi__context *s, stbi_uc *data, int x, int y, int comp);
 #endif
 
 #ifndef STBI_NO_HDR
-static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp);
+static stbi_uc *stbi__hdr_to_ldr(stbi__context *s, float   *data, int x, int y, int comp);
 #endif
 
-static int stbi__vertically_flip_on_load = 0;
-
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
 {
     stbi__vertically_flip_on_load = flag_true_if_should_flip;
 }
 
+STBIDEF void stbi_set_jpeg_threads(int num_threads)
+{
+   stbi__jpeg_threads = num_threads < 0 ? 0 : num_threads;
+}
+
+// for the *_into loads: whether a w*h*n image fits the caller's buffer.
+// decoders that know the output size from the header alone check this
+// before decoding, so a buffer that's too small fails straight away
+static int stbi__dest_fits(stbi__context *s, int w, int h, int n)
+{
+   int row_bytes, stride;
+   if (!stbi__mul2sizes_valid(w, n)) return 0;
+   row_bytes = w * n;
+   stride = s->dest_stride ? s->dest_stride : row_bytes;
+   if (stride < row_bytes || row_bytes > s->dest_size) return 0;
+   // the last row only needs its pixels, not a whole stride
+   return h <= 0 || h-1 <= (s->dest_size - row_bytes) / stride;
+}
+
+// for the *_into loads: returns where row 0 of a w*h*n image goes in the
+// caller's buffer, and the signed distance between rows (negative when
+// flipping on load). decoders that can write their final pixels in place
+// call this once they know the output layout; NULL means allocate as usual
+// (no caller buffer, or it's too small, which stbi__load_into_main reports).
+static stbi_uc *stbi__dest_rows(stbi__context *s, int w, int h, int n, int *pitch)
+{
+   int stride;
+   if (!s->dest || !stbi__dest_fits(s, w, h, n)) return NULL;
+   stride = s->dest_stride ? s->dest_stride : w * n;
+   if (s->flip_vertically) {
+      s->dest_row0 = s->dest + (size_t) (h-1) * stride;
+      *pitch = -stride;
+   } else {
+      s->dest_row0 = s->dest;
+      *pitch = stride;
+   }
+   return s->dest_row0;
+}
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -985,7 +1678,7 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
    #ifndef STBI_NO_HDR
    if (stbi__hdr_test(s)) {
       float *hdr = stbi__hdr_load(s, x,y,comp,req_comp, ri);
-      return stbi__hdr_to_ldr(hdr, *x, *y, req_comp ? req_comp : *comp);
+      return stbi__hdr_to_ldr(s, hdr, *x, *y, req_comp ? req_comp : *comp);
    }
    #endif
 
@@ -998,16 +1691,46 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
    return stbi__errpuc("unknown image type", "Image not of any known type, or corrupt");
 }
 
-static stbi_uc *stbi__convert_16_to_8(stbi__uint16 *orig, int w, int h, int channels)
+#ifdef STBI_AVX2
+static STBI__AVX2_TARGET int stbi__narrow_16_to_8_avx2(stbi_uc *out, stbi__uint16 *in, int n)
 {
    int i;
+   for (i=0; i+32 <= n; i += 32) {
+      __m256i a = _mm256_srli_epi16(_mm256_loadu_si256((__m256i *) (in + i     )), 8);
+      __m256i b = _mm256_srli_epi16(_mm256_loadu_si256((__m256i *) (in + i + 16)), 8);
+      // packus works per 128-bit lane, so put the quadwords back in order
+      _mm256_storeu_si256((__m256i *) (out + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+   }
+   return i;
+}
+#endif
+
+static stbi_uc *stbi__convert_16_to_8(stbi__uint16 *orig, int w, int h, int channels)
+{
+   int i = 0;
    int img_len = w * h * channels;
    stbi_uc *reduced;
 
    reduced = (stbi_uc *) stbi__malloc(img_len);
    if (reduced == NULL) return stbi__errpuc("outofmem", "Out of memory");
 
-   for (i = 0; i < img_len; ++i)
+   // the high byte of each channel: a shift and a saturating pack, which
+   // can't saturate once the low byte is gone
+   #ifdef STBI_AVX2
+   if (stbi__avx2_available())
+      i = stbi__narrow_16_to_8_avx2(reduced, orig, img_len);
+   #endif
+   #ifdef STBI_SSE2
+   if (stbi__sse2_available()) {
+      for (; i+16 <= img_len; i += 16) {
+         __m128i a = _mm_srli_epi16(_mm_loadu_si128((__m128i *) (orig + i    )), 8);
+         __m128i b = _mm_srli_epi16(_mm_loadu_si128((__m128i *) (orig + i + 8)), 8);
+         _mm_storeu_si128((__m128i *) (reduced + i), _mm_packus_epi16(a, b));
+      }
+   }
+   #endif
+
+   for (; i < img_len; ++i)
       reduced[i] = (stbi_uc)((orig[i] >> 8) & 0xFF); // top half of each byte is sufficient approx of 16->8 bit scaling
 
    STBI_FREE(orig);
@@ -1070,7 +1793,7 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
 
    // @TODO: move stbi__convert_format to here
 
-   if (stbi__vertically_flip_on_load) {
+   if (s->flip_vertically) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
    }
@@ -1095,7 +1818,7 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
    // @TODO: move stbi__convert_format16 to here
    // @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-   if (stbi__vertically_flip_on_load) {
+   if (s->flip_vertically) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
    }
@@ -1103,10 +1826,47 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
    return (stbi__uint16 *) result;
 }
 
+static int stbi__load_into_main(stbi__context *s, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__result_info ri;
+   stbi_uc *result, *row0;
+   int j, channels, pitch, row_bytes;
+
+   if (!out || out_size <= 0 || out_stride < 0) return stbi__err("bad buffer", "Invalid output buffer");
+   s->dest = out;
+   s->dest_size = out_size;
+   s->dest_stride = out_stride;
+   s->dest_row0 = NULL;
+
+   result = (stbi_uc *) stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+   if (result == NULL)
+      return 0;
+   if (result == s->dest_row0)
+      return 1; // decoder wrote it in place, already flipped if need be
+
+   // otherwise copy the decoded image over, row by row
+   channels = req_comp ? req_comp : *comp;
+   if (ri.bits_per_channel != 8) {
+      STBI_ASSERT(ri.bits_per_channel == 16);
+      result = stbi__convert_16_to_8((stbi__uint16 *) result, *x, *y, channels);
+      if (result == NULL) return 0;
+   }
+   row0 = stbi__dest_rows(s, *x, *y, channels, &pitch);
+   if (row0 == NULL) {
+      STBI_FREE(result);
+      return stbi__err("buffer too small", "Output buffer too small for image");
+   }
+   row_bytes = *x * channels;
+   for (j=0; j < *y; ++j)
+      memcpy(row0 + (ptrdiff_t) j * pitch, result + (size_t) j * row_bytes, row_bytes);
+   STBI_FREE(result);
+   return 1;
+}
+
 #ifndef STBI_NO_HDR
-static void stbi__float_postprocess(float *result, int *x, int *y, int *comp, int req_comp)
+static void stbi__float_postprocess(stbi__context *s, float *result, int *x, int *y, int *comp, int req_comp)
 {
-   if (stbi__vertically_flip_on_load && result != NULL) {
+   if (s->flip_vertically && result != NULL) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(float));
    }
@@ -1127,51 +1887,176 @@ static FILE *stbi__fopen(char const *filename, char const *mode)
    return f;
 }
 
+// the loaders that take a filename decode a regular file through the
+// memory path where the OS allows it (define STBI_NO_MMAP to skip that),
+// rather than through stdio and 128-byte refills. files of at least
+// STBI__MMAP_MIN_SIZE are memory-mapped; smaller ones are read whole with
+// one read on the handle that's already open, since setting up and
+// faulting in a mapping costs more than copying a few pages, most of all
+// when they aren't cached yet. anything else (a pipe, or a platform
+// without mmap) is streamed as before, but with a 64k stdio buffer so the
+// refills don't each cost a small read.
+#define STBI__MMAP_MIN_SIZE (256 << 10)
+
+#if !defined(STBI_NO_MMAP) && defined(_WIN32)
+#define STBI__MMAP_WIN32
+#elif !defined(STBI_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define STBI__MMAP_POSIX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
-STBIDEF stbi_uc *stbi_load(char const *filename, int *x, int *y, int *comp, int req_comp)
+typedef struct
 {
-   FILE *f = stbi__fopen(filename, "rb");
-   unsigned char *result;
-   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
-   result = stbi_load_from_file(f,x,y,comp,req_comp);
-   fclose(f);
-   return result;
+   stbi_uc *data;
+   int size;
+   int mapped;
+   FILE *file; // streaming fallback
+   char *filebuf; // its stdio buffer, or the whole of a small file
+#ifdef STBI__MMAP_WIN32
+   HANDLE mapping;
+#endif
+} stbi__filemap;
+
+// maps or reads the whole file into m->data; 0 to stream it through stdio
+static int stbi__map_file(stbi__filemap *m, char const *filename)
+{
+#if defined(STBI__MMAP_POSIX)
+   struct stat st;
+   int fd;
+   // only open regular files here; opening a fifo just to look at it
+   // would lose its writer before the stdio fallback got to read it
+   if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+   fd = open(filename, O_RDONLY);
+   if (fd < 0) return 0;
+   if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > INT_MAX) {
+      // changed under us, or empty: leave it to stdio
+   } else if (st.st_size < STBI__MMAP_MIN_SIZE) {
+      char *buf = (char *) stbi__malloc((size_t) st.st_size);
+      ssize_t got = 0, r = 0;
+      while (buf && got < st.st_size && (r = read(fd, buf + got, (size_t) (st.st_size - got))) > 0)
+         got += r;
+      if (buf && got == st.st_size) {
+         m->filebuf = buf;
+         m->data = (stbi_uc *) buf;
+         m->size = (int) got;
+      } else
+         STBI_FREE(buf);
+   } else {
+      void *p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+         #ifdef MADV_SEQUENTIAL
+         madvise(p, (size_t) st.st_size, MADV_SEQUENTIAL);
+         #endif
+         m->data = (stbi_uc *) p;
+         m->size = (int) st.st_size;
+         m->mapped = 1;
+      }
+   }
+   close(fd); // the mapping keeps the file alive
+   return m->data != NULL;
+#elif defined(STBI__MMAP_WIN32)
+   LARGE_INTEGER size;
+   HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+   if (file == INVALID_HANDLE_VALUE) return 0;
+   if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) || size.QuadPart <= 0 || size.QuadPart > INT_MAX) {
+      // not a plain file, or empty: leave it to stdio
+   } else if (size.QuadPart < STBI__MMAP_MIN_SIZE) {
+      char *buf = (char *) stbi__malloc((size_t) size.QuadPart);
+      DWORD got = 0;
+      if (buf && ReadFile(file, buf, (DWORD) size.QuadPart, &got, NULL) && got == (DWORD) size.QuadPart) {
+         m->filebuf = buf;
+         m->data = (stbi_uc *) buf;
+         m->size = (int) got;
+      } else
+         STBI_FREE(buf);
+   } else {
+      HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (mapping) {
+         void *p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+         if (p) {
+            m->data = (stbi_uc *) p;
+            m->size = (int) size.QuadPart;
+            m->mapped = 1;
+            m->mapping = mapping;
+         } else
+            CloseHandle(mapping);
+      }
+   }
+   CloseHandle(file); // the mapping keeps the file alive
+   return m->data != NULL;
+#else
+   STBI_NOTUSED(m);
+   STBI_NOTUSED(filename);
+   return 0;
+#endif
 }
 
-STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
+#define STBI__FILEBUF_SIZE (1 << 16)
+
+// starts 's' on the named file; on success, stbi__close_filemap(m) when done
+static int stbi__start_filename(stbi__context *s, stbi__filemap *m, char const *filename)
 {
-   unsigned char *result;
-   stbi__context s;
-   stbi__start_file(&s,f);
-   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
-   if (result) {
-      // need to 'unget' all the characters in the IO buffer
-      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   m->data = NULL;
+   m->size = m->mapped = 0;
+   m->file = NULL;
+   m->filebuf = NULL;
+   if (stbi__map_file(m, filename)) {
+      stbi__start_mem(s, m->data, m->size);
+      return 1;
    }
-   return result;
+   m->file = stbi__fopen(filename, "rb");
+   if (!m->file) return stbi__err("can't fopen", "Unable to open file");
+   m->filebuf = (char *) stbi__malloc(STBI__FILEBUF_SIZE);
+   if (m->filebuf) setvbuf(m->file, m->filebuf, _IOFBF, STBI__FILEBUF_SIZE);
+   stbi__start_file(s, m->file);
+   return 1;
 }
 
-STBIDEF stbi__uint16 *stbi_load_from_file_16(FILE *f, int *x, int *y, int *comp, int req_comp)
+static void stbi__close_filemap(stbi__filemap *m)
 {
-   stbi__uint16 *result;
-   stbi__context s;
-   stbi__start_file(&s,f);
-   result = stbi__load_and_postprocess_16bit(&s,x,y,comp,req_comp);
-   if (result) {
-      // need to 'unget' all the characters in the IO buffer
-      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   if (m->mapped) {
+#if defined(STBI__MMAP_POSIX)
+      munmap(m->data, (size_t) m->size);
+#elif defined(STBI__MMAP_WIN32)
+      UnmapViewOfFile(m->data);
+      CloseHandle(m->mapping);
+#endif
    }
-   return result;
+   if (m->file) fclose(m->file);
+   STBI_FREE(m->filebuf); // after fclose, which may still use it
+}
+
+STBIDEF stbi_uc *stbi_load(char const *filename, int *x, int *y, int *comp, int req_comp)
+{
+   return stbi_load_ex(filename,x,y,comp,req_comp,NULL);
+}
+
+STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
+{
+   return stbi_load_from_file_ex(f,x,y,comp,req_comp,NULL);
+}
+
+STBIDEF stbi__uint16 *stbi_load_from_file_16(FILE *f, int *x, int *y, int *comp, int req_comp)
+{
+   return stbi_load_from_file_16_ex(f,x,y,comp,req_comp,NULL);
 }
 
 STBIDEF stbi_us *stbi_load_16(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
-   FILE *f = stbi__fopen(filename, "rb");
-   stbi__uint16 *result;
-   if (!f) return (stbi_us *) stbi__errpuc("can't fopen", "Unable to open file");
-   result = stbi_load_from_file_16(f,x,y,comp,req_comp);
-   fclose(f);
-   return result;
+   return stbi_load_16_ex(filename,x,y,comp,req_comp,NULL);
+}
+
+STBIDEF int stbi_load_into(char const *filename, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *comp, int req_comp)
+{
+   return stbi_load_into_ex(filename,out,out_size,out_stride,x,y,comp,req_comp,NULL);
+}
+
+STBIDEF int stbi_load_from_file_into(FILE *f, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *comp, int req_comp)
+{
+   return stbi_load_from_file_into_ex(f,out,out_size,out_stride,x,y,comp,req_comp,NULL);
 }
 
 
@@ -1205,6 +2090,20 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF int stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_into_main(&s,out,out_size,out_stride,x,y,comp,req_comp);
+}
+
+STBIDEF int stbi_load_from_callbacks_into(stbi_io_callbacks const *clbk, void *user, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__load_into_main(&s,out,out_size,out_stride,x,y,comp,req_comp);
+}
+
 #ifndef STBI_NO_LINEAR
 static float *stbi__loadf_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
@@ -1214,13 +2113,13 @@ static float *stbi__loadf_main(stbi__context *s, int *x, int *y, int *comp, int
       stbi__result_info ri;
       float *hdr_data = stbi__hdr_load(s,x,y,comp,req_comp, &ri);
       if (hdr_data)
-         stbi__float_postprocess(hdr_data,x,y,comp,req_comp);
+         stbi__float_postprocess(s,hdr_data,x,y,comp,req_comp);
       return hdr_data;
    }
    #endif
    data = stbi__load_and_postprocess_8bit(s, x, y, comp, req_comp);
    if (data)
-      return stbi__ldr_to_hdr(data, *x, *y, req_comp ? req_comp : *comp);
+      return stbi__ldr_to_hdr(s, data, *x, *y, req_comp ? req_comp : *comp);
    return stbi__errpf("unknown image type", "Image not of any known type, or corrupt");
 }
 
@@ -1241,24 +2140,242 @@ STBIDEF float *stbi_loadf_from_callbacks(stbi_io_callbacks const *clbk, void *us
 #ifndef STBI_NO_STDIO
 STBIDEF float *stbi_loadf(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
-   float *result;
-   FILE *f = stbi__fopen(filename, "rb");
-   if (!f) return stbi__errpf("can't fopen", "Unable to open file");
-   result = stbi_loadf_from_file(f,x,y,comp,req_comp);
-   fclose(f);
-   return result;
+   return stbi_loadf_ex(filename,x,y,comp,req_comp,NULL);
 }
 
 STBIDEF float *stbi_loadf_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
+{
+   return stbi_loadf_from_file_ex(f,x,y,comp,req_comp,NULL);
+}
+#endif // !STBI_NO_STDIO
+
+static stbi__uint16 *stbi__loadh_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
+{
+   unsigned char *data;
+   #ifndef STBI_NO_HDR
+   if (stbi__hdr_test(s)) {
+      stbi__uint16 *hdr_data = (stbi__uint16 *) stbi__hdr_load_main(s,x,y,comp,req_comp,1);
+      if (hdr_data && s->flip_vertically) {
+         int channels = req_comp ? req_comp : *comp;
+         stbi__vertical_flip(hdr_data, *x, *y, channels * sizeof(stbi__uint16));
+      }
+      return hdr_data;
+   }
+   #endif
+   data = stbi__load_and_postprocess_8bit(s, x, y, comp, req_comp);
+   if (data)
+      return stbi__ldr_to_half(s, data, *x, *y, req_comp ? req_comp : *comp);
+   return (stbi__uint16 *) stbi__errpuc("unknown image type", "Image not of any known type, or corrupt");
+}
+
+STBIDEF stbi_us *stbi_loadh_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__loadh_main(&s,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_us *stbi_loadh_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__loadh_main(&s,x,y,comp,req_comp);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_us *stbi_loadh(char const *filename, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__filemap m;
+   stbi_us *result;
+   stbi__context s;
+   if (!stbi__start_filename(&s,&m,filename)) return NULL;
+   result = stbi__loadh_main(&s,x,y,comp,req_comp);
+   stbi__close_filemap(&m);
+   return result;
+}
+
+STBIDEF stbi_us *stbi_loadh_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
 {
    stbi__context s;
    stbi__start_file(&s,f);
-   return stbi__loadf_main(&s,x,y,comp,req_comp);
+   return stbi__loadh_main(&s,x,y,comp,req_comp);
 }
 #endif // !STBI_NO_STDIO
 
 #endif // !STBI_NO_LINEAR
 
+// the *_ex loaders: same as the plain ones, with per-load settings
+
+STBIDEF stbi_uc *stbi_load_from_memory_ex(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   stbi__apply_options(&s,opt);
+   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_uc *stbi_load_from_callbacks_ex(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   stbi__apply_options(&s,opt);
+   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_us *stbi_load_16_from_memory_ex(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   stbi__apply_options(&s,opt);
+   return stbi__load_and_postprocess_16bit(&s,x,y,comp,req_comp);
+}
+
+STBIDEF stbi_us *stbi_load_16_from_callbacks_ex(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   stbi__apply_options(&s,opt);
+   return stbi__load_and_postprocess_16bit(&s,x,y,comp,req_comp);
+}
+
+STBIDEF int stbi_load_from_memory_into_ex(stbi_uc const *buffer, int len, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   stbi__apply_options(&s,opt);
+   return stbi__load_into_main(&s,out,out_size,out_stride,x,y,comp,req_comp);
+}
+
+STBIDEF int stbi_load_from_callbacks_into_ex(stbi_io_callbacks const *clbk, void *user, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   stbi__apply_options(&s,opt);
+   return stbi__load_into_main(&s,out,out_size,out_stride,x,y,comp,req_comp);
+}
+
+#ifndef STBI_NO_LINEAR
+STBIDEF float *stbi_loadf_from_memory_ex(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   stbi__apply_options(&s,opt);
+   return stbi__loadf_main(&s,x,y,comp,req_comp);
+}
+
+STBIDEF float *stbi_loadf_from_callbacks_ex(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   stbi__apply_options(&s,opt);
+   return stbi__loadf_main(&s,x,y,comp,req_comp);
+}
+#endif // !STBI_NO_LINEAR
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_ex(char const *filename, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__filemap m;
+   stbi_uc *result;
+   stbi__context s;
+   if (!stbi__start_filename(&s,&m,filename)) return NULL;
+   stbi__apply_options(&s,opt);
+   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+   stbi__close_filemap(&m);
+   return result;
+}
+
+STBIDEF stbi_us *stbi_load_16_ex(char const *filename, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__filemap m;
+   stbi_us *result;
+   stbi__context s;
+   if (!stbi__start_filename(&s,&m,filename)) return NULL;
+   stbi__apply_options(&s,opt);
+   result = stbi__load_and_postprocess_16bit(&s,x,y,comp,req_comp);
+   stbi__close_filemap(&m);
+   return result;
+}
+
+STBIDEF int stbi_load_into_ex(char const *filename, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__filemap m;
+   int result;
+   stbi__context s;
+   if (!stbi__start_filename(&s,&m,filename)) return 0;
+   stbi__apply_options(&s,opt);
+   result = stbi__load_into_main(&s,out,out_size,out_stride,x,y,comp,req_comp);
+   stbi__close_filemap(&m);
+   return result;
+}
+
+#ifndef STBI_NO_LINEAR
+STBIDEF float *stbi_loadf_ex(char const *filename, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__filemap m;
+   float *result;
+   stbi__context s;
+   if (!stbi__start_filename(&s,&m,filename)) return NULL;
+   stbi__apply_options(&s,opt);
+   result = stbi__loadf_main(&s,x,y,comp,req_comp);
+   stbi__close_filemap(&m);
+   return result;
+}
+#endif // !STBI_NO_LINEAR
+
+STBIDEF stbi_uc *stbi_load_from_file_ex(FILE *f, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   unsigned char *result;
+   stbi__context s;
+   stbi__start_file(&s,f);
+   stbi__apply_options(&s,opt);
+   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   return result;
+}
+
+STBIDEF stbi_us *stbi_load_from_file_16_ex(FILE *f, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__uint16 *result;
+   stbi__context s;
+   stbi__start_file(&s,f);
+   stbi__apply_options(&s,opt);
+   result = stbi__load_and_postprocess_16bit(&s,x,y,comp,req_comp);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   return result;
+}
+
+STBIDEF int stbi_load_from_file_into_ex(FILE *f, stbi_uc *out, int out_size, int out_stride, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   int result;
+   stbi__context s;
+   stbi__start_file(&s,f);
+   stbi__apply_options(&s,opt);
+   result = stbi__load_into_main(&s,out,out_size,out_stride,x,y,comp,req_comp);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   return result;
+}
+
+#ifndef STBI_NO_LINEAR
+STBIDEF float *stbi_loadf_from_file_ex(FILE *f, int *x, int *y, int *comp, int req_comp, stbi_options const *opt)
+{
+   stbi__context s;
+   stbi__start_file(&s,f);
+   stbi__apply_options(&s,opt);
+   return stbi__loadf_main(&s,x,y,comp,req_comp);
+}
+#endif // !STBI_NO_LINEAR
+#endif // !STBI_NO_STDIO
+
 // these is-hdr-or-not is defined independent of whether STBI_NO_LINEAR is
 // defined, for API simplicity; if STBI_NO_LINEAR is defined, it always
 // reports false!
@@ -1315,14 +2432,10 @@ STBIDEF int      stbi_is_hdr_from_callbacks(stbi_io_callbacks const *clbk, void
 }
 
 #ifndef STBI_NO_LINEAR
-static float stbi__l2h_gamma=2.2f, stbi__l2h_scale=1.0f;
-
 STBIDEF void   stbi_ldr_to_hdr_gamma(float gamma) { stbi__l2h_gamma = gamma; }
 STBIDEF void   stbi_ldr_to_hdr_scale(float scale) { stbi__l2h_scale = scale; }
 #endif
 
-static float stbi__h2l_gamma_i=1.0f/2.2f, stbi__h2l_scale_i=1.0f;
-
 STBIDEF void   stbi_hdr_to_ldr_gamma(float gamma) { stbi__h2l_gamma_i = 1/gamma; }
 STBIDEF void   stbi_hdr_to_ldr_scale(float scale) { stbi__h2l_scale_i = 1/scale; }
 
@@ -1468,9 +2581,191 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
    return (stbi_uc) (((r*77) + (g*150) +  (29*b)) >> 8);
 }
 
+#ifdef STBI_AVX2
+// SIMD channel conversion. Every (img_n, req_comp) pair is a fixed byte
+// permutation of a block of pixels, so the pshufb masks are generated once
+// per image from img_n, req_comp and the channel size. A block is 16 bytes
+// of channels per component: 16 pixels at 8 bits or 8 pixels at 16 bits,
+// which means img_n vectors in and req_comp vectors out. pshufb is SSSE3,
+// but the only cpu check we have besides SSE2 is AVX2 (which implies it),
+// so these are compiled and dispatched as AVX2 kernels.
+typedef struct
+{
+   STBI_SIMD_ALIGN(signed char, mask[4][2][16]);  // per output vector, from in[lo] and in[lo+1]
+   STBI_SIMD_ALIGN(unsigned char, fill[4][16]);   // alpha bytes that come from nowhere
+   STBI_SIMD_ALIGN(signed char, plane[4][4][16]); // grey: r,g,b,a planes from each input vector
+} stbi__convert_masks;
+
+// first of the (at most) two input vectors that output vector k reads from
+#define STBI__CONVERT_LO(k,img_n,req_comp,size) \
+   ((((16*(k) / (size)) / (req_comp) * (img_n) * (size)) >> 4) > (img_n)-2 ? (img_n)-2 : \
+    (((16*(k) / (size)) / (req_comp) * (img_n) * (size)) >> 4))
+
+static void stbi__convert_build_masks(stbi__convert_masks *m, int img_n, int req_comp, int size)
+{
+   int k,t;
+   memset(m->mask, -128, sizeof(m->mask));
+   memset(m->plane, -128, sizeof(m->plane));
+   memset(m->fill, 0, sizeof(m->fill));
+   if (req_comp <= 2 && img_n >= 3) {
+      // planes for the luma path: lane t holds byte t of the plane
+      for (k=0; k < 4; ++k) {
+         int c = k < 3 ? k : img_n-1;
+         for (t=0; t < 16; ++t) {
+            int s = ((t / size) * img_n + c) * size + t % size;
+            m->plane[k][s >> 4][t] = (signed char) (s & 15);
+         }
+      }
+      return;
+   }
+   for (k=0; k < req_comp; ++k) {
+      int lo = img_n > 1 ? STBI__CONVERT_LO(k, img_n, req_comp, size) : 0;
+      for (t=0; t < 16; ++t) {
+         int o = 16*k + t, ch = o / size, p = ch / req_comp, c = ch % req_comp, sc, s;
+         if (c == req_comp-1 && (req_comp == 2 || req_comp == 4))
+            sc = (img_n == 2 || img_n == 4) ? img_n-1 : -1; // alpha
+         else
+            sc = img_n >= 3 ? c : 0; // colour, or grey replicated
+         if (sc < 0) { m->fill[k][t] = 255; continue; }
+         s = (p * img_n + sc) * size + o % size;
+         STBI_ASSERT((s >> 4) == lo || (s >> 4) == lo+1);
+         m->mask[k][(s >> 4) - lo][t] = (signed char) (s & 15);
+      }
+   }
+}
+
+// img_n and req_comp are constants at every call, and the per-vector steps
+// are spelled out rather than looped so the whole block stays in registers
+static STBI__AVX2_INLINE void stbi__convert_shuffle(unsigned char *out, unsigned char *in, int blocks, stbi__convert_masks *m, int img_n, int req_comp, int size)
+{
+   __m128i v[4], mask0[4], mask1[4], fill[4];
+   int i;
+   #define STBI__LOAD_MASKS(k) \
+      mask0[k] = _mm_load_si128((__m128i *) m->mask[k][0]); \
+      mask1[k] = _mm_load_si128((__m128i *) m->mask[k][1]); \
+      fill[k]  = _mm_load_si128((__m128i *) m->fill[k]);
+   STBI__LOAD_MASKS(0) STBI__LOAD_MASKS(1) STBI__LOAD_MASKS(2) STBI__LOAD_MASKS(3)
+   #undef STBI__LOAD_MASKS
+
+   #define STBI__SHUFFLE_OUT(k) \
+      if (k < req_comp) { \
+         int lo = img_n > 1 ? STBI__CONVERT_LO(k, img_n, req_comp, size) : 0; \
+         __m128i x = _mm_shuffle_epi8(v[lo], mask0[k]); \
+         if (img_n > 1) x = _mm_or_si128(x, _mm_shuffle_epi8(v[lo+1], mask1[k])); \
+         _mm_storeu_si128((__m128i *) out + k, _mm_or_si128(x, fill[k])); \
+      }
+   for (i=0; i < blocks; ++i, in += 16*img_n, out += 16*req_comp) {
+      v[0] = _mm_loadu_si128((__m128i *) in);
+      v[1] = img_n > 1 ? _mm_loadu_si128((__m128i *) in + 1) : v[0];
+      v[2] = img_n > 2 ? _mm_loadu_si128((__m128i *) in + 2) : v[0];
+      v[3] = img_n > 3 ? _mm_loadu_si128((__m128i *) in + 3) : v[0];
+      STBI__SHUFFLE_OUT(0) STBI__SHUFFLE_OUT(1) STBI__SHUFFLE_OUT(2) STBI__SHUFFLE_OUT(3)
+   }
+   #undef STBI__SHUFFLE_OUT
+}
+
+static STBI__AVX2_INLINE void stbi__convert_luma(unsigned char *out, unsigned char *in, int blocks, stbi__convert_masks *m, int img_n, int req_comp, int size)
+{
+   __m128i v[4], p[4][4], c77 = _mm_set1_epi16(77), c150 = _mm_set1_epi16(150), c29 = _mm_set1_epi16(29);
+   int i;
+   #define STBI__LOAD_PLANE(k) \
+      p[k][0] = _mm_load_si128((__m128i *) m->plane[k][0]); \
+      p[k][1] = _mm_load_si128((__m128i *) m->plane[k][1]); \
+      p[k][2] = _mm_load_si128((__m128i *) m->plane[k][2]); \
+      p[k][3] = _mm_load_si128((__m128i *) m->plane[k][3]);
+   STBI__LOAD_PLANE(0) STBI__LOAD_PLANE(1) STBI__LOAD_PLANE(2) STBI__LOAD_PLANE(3)
+   #undef STBI__LOAD_PLANE
+
+   // gather channel k of every pixel in the block from the 3 or 4 input vectors
+   #define STBI__PLANE(k) \
+      (img_n == 4 ? _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v[0],p[k][0]), _mm_shuffle_epi8(v[1],p[k][1])), \
+                                 _mm_or_si128(_mm_shuffle_epi8(v[2],p[k][2]), _mm_shuffle_epi8(v[3],p[k][3]))) \
+                  : _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v[0],p[k][0]), _mm_shuffle_epi8(v[1],p[k][1])), \
+                                 _mm_shuffle_epi8(v[2],p[k][2])))
+   for (i=0; i < blocks; ++i, in += 16*img_n, out += 16*req_comp) {
+      __m128i r,g,b,a,y;
+      v[0] = _mm_loadu_si128((__m128i *) in);
+      v[1] = _mm_loadu_si128((__m128i *) in + 1);
+      v[2] = _mm_loadu_si128((__m128i *) in + 2);
+      v[3] = img_n > 3 ? _mm_loadu_si128((__m128i *) in + 3) : v[0];
+      r = STBI__PLANE(0);
+      g = STBI__PLANE(1);
+      b = STBI__PLANE(2);
+      a = img_n == 4 && req_comp == 2 ? STBI__PLANE(3) : _mm_set1_epi8(-1);
+      if (size == 1) {
+         // (r*77 + g*150 + b*29) >> 8 peaks at 255*256, so 16-bit lanes are exact
+         __m128i zero = _mm_setzero_si128();
+         __m128i ylo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(r,zero),c77),
+                                                   _mm_mullo_epi16(_mm_unpacklo_epi8(g,zero),c150)),
+                                                   _mm_mullo_epi16(_mm_unpacklo_epi8(b,zero),c29));
+         __m128i yhi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(r,zero),c77),
+                                                   _mm_mullo_epi16(_mm_unpackhi_epi8(g,zero),c150)),
+                                                   _mm_mullo_epi16(_mm_unpackhi_epi8(b,zero),c29));
+         y = _mm_packus_epi16(_mm_srli_epi16(ylo, 8), _mm_srli_epi16(yhi, 8));
+         if (req_comp == 1) {
+            _mm_storeu_si128((__m128i *) out, y);
+         } else {
+            _mm_storeu_si128((__m128i *) out    , _mm_unpacklo_epi8(y, a));
+            _mm_storeu_si128((__m128i *) out + 1, _mm_unpackhi_epi8(y, a));
+         }
+      } else {
+         // 16-bit channels need 32-bit sums: build each product from its low and high halves
+         __m128i rl = _mm_mullo_epi16(r,c77),  rh = _mm_mulhi_epu16(r,c77);
+         __m128i gl = _mm_mullo_epi16(g,c150), gh = _mm_mulhi_epu16(g,c150);
+         __m128i bl = _mm_mullo_epi16(b,c29),  bh = _mm_mulhi_epu16(b,c29);
+         __m128i ylo = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(rl,rh), _mm_unpacklo_epi16(gl,gh)), _mm_unpacklo_epi16(bl,bh));
+         __m128i yhi = _mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(rl,rh), _mm_unpackhi_epi16(gl,gh)), _mm_unpackhi_epi16(bl,bh));
+         y = _mm_packus_epi32(_mm_srli_epi32(ylo, 8), _mm_srli_epi32(yhi, 8));
+         if (req_comp == 1) {
+            _mm_storeu_si128((__m128i *) out, y);
+         } else {
+            _mm_storeu_si128((__m128i *) out    , _mm_unpacklo_epi16(y, a));
+            _mm_storeu_si128((__m128i *) out + 1, _mm_unpackhi_epi16(y, a));
+         }
+      }
+   }
+   #undef STBI__PLANE
+}
+
+// returns the number of pixels converted; the caller finishes the rest
+static STBI__AVX2_TARGET int stbi__convert_simd(void *dest, void *src, int img_n, int req_comp, int size, int n)
+{
+   stbi__convert_masks m;
+   unsigned char *in = (unsigned char *) src, *out = (unsigned char *) dest;
+   int blocks = n / (16 / size);
+
+   if (blocks == 0) return 0;
+   stbi__convert_build_masks(&m, img_n, req_comp, size);
+
+   #define STBI__COMBO(a,b)  ((a)*8+(b))
+   #define STBI__SIMD_CASE(a,b,f) \
+      case STBI__COMBO(a,b): \
+         if (size == 1) f(out, in, blocks, &m, a, b, 1); \
+         else           f(out, in, blocks, &m, a, b, 2); \
+         break;
+   switch (STBI__COMBO(img_n, req_comp)) {
+      STBI__SIMD_CASE(1,2, stbi__convert_shuffle)
+      STBI__SIMD_CASE(1,3, stbi__convert_shuffle)
+      STBI__SIMD_CASE(1,4, stbi__convert_shuffle)
+      STBI__SIMD_CASE(2,1, stbi__convert_shuffle)
+      STBI__SIMD_CASE(2,3, stbi__convert_shuffle)
+      STBI__SIMD_CASE(2,4, stbi__convert_shuffle)
+      STBI__SIMD_CASE(3,4, stbi__convert_shuffle)
+      STBI__SIMD_CASE(4,3, stbi__convert_shuffle)
+      STBI__SIMD_CASE(3,1, stbi__convert_luma)
+      STBI__SIMD_CASE(3,2, stbi__convert_luma)
+      STBI__SIMD_CASE(4,1, stbi__convert_luma)
+      STBI__SIMD_CASE(4,2, stbi__convert_luma)
+      default: return 0;
+   }
+   #undef STBI__SIMD_CASE
+   return blocks * (16 / size);
+}
+#endif
+
 static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
-   int i,j;
+   int i, n = 0;
    unsigned char *good;
 
    if (req_comp == img_n) return data;
@@ -1482,12 +2777,19 @@ static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int r
       return stbi__errpuc("outofmem", "Out of memory");
    }
 
-   for (j=0; j < (int) y; ++j) {
-      unsigned char *src  = data + j * x * img_n   ;
-      unsigned char *dest = good + j * x * req_comp;
+   #ifdef STBI_AVX2
+   if (stbi__avx2_available())
+      n = stbi__convert_simd(good, data, img_n, req_comp, 1, (int) (x*y));
+   #endif
+
+   // the rows are packed back to back, so the whole image (or whatever the
+   // SIMD path left over) is converted as a single run of pixels
+   {
+      unsigned char *src  = data + n * img_n   ;
+      unsigned char *dest = good + n * req_comp;
 
       #define STBI__COMBO(a,b)  ((a)*8+(b))
-      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=(int) (x*y)-n-1; i >= 0; --i, src += a, dest += b)
       // convert source image with img_n components to one with req_comp components;
       // avoid switch per pixel, so use switch per scanline and massive macros
       switch (STBI__COMBO(img_n, req_comp)) {
@@ -1519,7 +2821,7 @@ static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
 
 static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
-   int i,j;
+   int i, n = 0;
    stbi__uint16 *good;
 
    if (req_comp == img_n) return data;
@@ -1531,12 +2833,19 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
       return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
    }
 
-   for (j=0; j < (int) y; ++j) {
-      stbi__uint16 *src  = data + j * x * img_n   ;
-      stbi__uint16 *dest = good + j * x * req_comp;
+   #ifdef STBI_AVX2
+   if (stbi__avx2_available())
+      n = stbi__convert_simd(good, data, img_n, req_comp, 2, (int) (x*y));
+   #endif
+
+   // the rows are packed back to back, so the whole image (or whatever the
+   // SIMD path left over) is converted as a single run of pixels
+   {
+      stbi__uint16 *src  = data + n * img_n   ;
+      stbi__uint16 *dest = good + n * req_comp;
 
       #define STBI__COMBO(a,b)  ((a)*8+(b))
-      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=(int) (x*y)-n-1; i >= 0; --i, src += a, dest += b)
       // convert source image with img_n components to one with req_comp components;
       // avoid switch per pixel, so use switch per scanline and massive macros
       switch (STBI__COMBO(img_n, req_comp)) {
@@ -1561,54 +2870,311 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
    return good;
 }
 
-#ifndef STBI_NO_LINEAR
-static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
+#ifndef STBI_NO_LINEAR
+// an 8-bit channel only has 256 possible values, so pow() runs once per
+// value for the current gamma/scale rather than once per channel. the table
+// holds exactly what the per-channel expression would have produced.
+static float   *stbi__ldr_to_hdr(stbi__context *s, stbi_uc *data, int x, int y, int comp)
+{
+   int i,k,n;
+   float *output;
+   float color[256], alpha[256];
+   if (!data) return NULL;
+   // widen the 8-bit buffer in place: growing it lets the allocator extend
+   // the block rather than holding both images, and walking backwards never
+   // overwrites a byte that is still to be read
+   if (!stbi__mad4sizes_valid(x, y, comp, sizeof(float), 0)) { STBI_FREE(data); return stbi__errpf("too large", "Image too large to decode"); }
+   output = (float *) STBI_REALLOC_SIZED(data, x*y*comp, x*y*comp*sizeof(float));
+   if (output == NULL) { STBI_FREE(data); return stbi__errpf("outofmem", "Out of memory"); }
+   data = (stbi_uc *) output;
+   for (i=0; i < 256; ++i) {
+      color[i] = (float) (pow(i/255.0f, s->l2h_gamma) * s->l2h_scale);
+      alpha[i] = i/255.0f;
+   }
+   // compute number of non-alpha components
+   if (comp & 1) n = comp; else n = comp-1;
+   for (i=x*y-1; i >= 0; --i) {
+      stbi_uc *src = data + i*comp;
+      float *dest = output + i*comp;
+      for (k=comp-1; k >= 0; --k)
+         dest[k] = k < n ? color[src[k]] : alpha[src[k]];
+   }
+   return output;
+}
+
+// float to IEEE half, rounding to nearest even like the F16C instructions
+static stbi__uint16 stbi__float_to_half(float f)
+{
+   stbi__uint32 u, sign, o, magic = ((127-15) + (23-10) + 1) << 23;
+   float fmagic;
+   memcpy(&u, &f, 4);
+   sign = u & 0x80000000u;
+   u ^= sign;
+   if (u >= (127+16) << 23) {
+      o = u > 255u << 23 ? 0x7e00 : 0x7c00; // NaN stays NaN, too big is inf
+   } else if (u < (127-14) << 23) {
+      // subnormal or zero: let the FPU do the rounding, by adding a magic
+      // number that puts the result's lowest bit at the float's lowest bit
+      memcpy(&f, &u, 4);
+      memcpy(&fmagic, &magic, 4);
+      f += fmagic;
+      memcpy(&o, &f, 4);
+      o -= magic;
+   } else {
+      o = (u + ((stbi__uint32) (15-127) << 23) + 0xfff + ((u >> 13) & 1)) >> 13;
+   }
+   return (stbi__uint16) (o | (sign >> 16));
+}
+
+// stbi__ldr_to_hdr with half-float output; the buffer only doubles in size
+static stbi__uint16 *stbi__ldr_to_half(stbi__context *s, stbi_uc *data, int x, int y, int comp)
 {
    int i,k,n;
-   float *output;
+   stbi__uint16 *output;
+   stbi__uint16 color[256], alpha[256];
    if (!data) return NULL;
-   output = (float *) stbi__malloc_mad4(x, y, comp, sizeof(float), 0);
-   if (output == NULL) { STBI_FREE(data); return stbi__errpf("outofmem", "Out of memory"); }
+   if (!stbi__mad4sizes_valid(x, y, comp, sizeof(stbi__uint16), 0)) { STBI_FREE(data); return (stbi__uint16 *) stbi__errpuc("too large", "Image too large to decode"); }
+   output = (stbi__uint16 *) STBI_REALLOC_SIZED(data, x*y*comp, x*y*comp*sizeof(stbi__uint16));
+   if (output == NULL) { STBI_FREE(data); return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory"); }
+   data = (stbi_uc *) output;
+   for (i=0; i < 256; ++i) {
+      color[i] = stbi__float_to_half((float) (pow(i/255.0f, s->l2h_gamma) * s->l2h_scale));
+      alpha[i] = stbi__float_to_half(i/255.0f);
+   }
    // compute number of non-alpha components
    if (comp & 1) n = comp; else n = comp-1;
-   for (i=0; i < x*y; ++i) {
-      for (k=0; k < n; ++k) {
-         output[i*comp + k] = (float) (pow(data[i*comp+k]/255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
-      }
-      if (k < comp) output[i*comp + k] = data[i*comp+k]/255.0f;
+   for (i=x*y-1; i >= 0; --i) {
+      stbi_uc *src = data + i*comp;
+      stbi__uint16 *dest = output + i*comp;
+      for (k=comp-1; k >= 0; --k)
+         dest[k] = k < n ? color[src[k]] : alpha[src[k]];
    }
-   STBI_FREE(data);
    return output;
 }
 #endif
 
 #ifndef STBI_NO_HDR
+// HDR->LDR needs pow(v*scale, 1/gamma) for every channel, with only 8 bits
+// of result. that is computed as exp2(g*log2(x)) with short polynomials:
+// relative error is around 1e-6, i.e. well under 0.001 of an output step,
+// so a result can only differ from the pow() version by one, and only when
+// the exact value is that close to a rounding boundary. the same arithmetic
+// runs 4-wide with SSE2, 8-wide with AVX2 and one at a time otherwise.
 #define stbi__float2int(x)   ((int) (x))
-static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
+
+#define STBI__L2_C1 2.885390082f  // 2/ln(2)
+#define STBI__L2_C3 0.961796694f  // 2/(3 ln(2))
+#define STBI__L2_C5 0.577078017f  // 2/(5 ln(2))
+#define STBI__L2_C7 0.412198583f  // 2/(7 ln(2))
+#define STBI__E2_C1 0.693147181f  // ln(2)^k/k!
+#define STBI__E2_C2 0.240226507f
+#define STBI__E2_C3 0.055504109f
+#define STBI__E2_C4 0.009618129f
+#define STBI__E2_C5 0.001333356f
+#define STBI__E2_C6 0.000154035f
+
+// pow(x,g)*255 + 0.5 for 0 < x < 1, g > 0
+static float stbi__ldr_pow(float x, float g)
+{
+   stbi__uint32 b;
+   float m, t, t2, l, f, r, p;
+   int e, n;
+   if (x < 1.1754944e-38f) x = 1.1754944e-38f; // no denormals
+   // log2(x) = e + log2(m), with m in [sqrt(1/2), sqrt(2)) and
+   // log2(m) = 2/ln(2) * atanh(t), t = (m-1)/(m+1)
+   memcpy(&b, &x, 4);
+   e = (int) (b >> 23) - 127;
+   b = (b & 0x7fffff) | 0x3f800000;
+   memcpy(&m, &b, 4);
+   if (m > 1.41421356f) { m *= 0.5f; e += 1; }
+   t = (m - 1.0f) / (m + 1.0f);
+   t2 = t*t;
+   l = (float) e + t * (STBI__L2_C1 + t2*(STBI__L2_C3 + t2*(STBI__L2_C5 + t2*STBI__L2_C7)));
+   // exp2(f) = 2^n * exp2(r), r in [-1/2, 1/2]
+   f = g * l;
+   if (f < -126.0f) f = -126.0f;
+   n = (int) (f - 0.5f); // f <= 0, so this truncation rounds
+   r = f - (float) n;
+   p = 1.0f + r*(STBI__E2_C1 + r*(STBI__E2_C2 + r*(STBI__E2_C3 + r*(STBI__E2_C4 + r*(STBI__E2_C5 + r*STBI__E2_C6)))));
+   b = (stbi__uint32) (n + 127) << 23;
+   memcpy(&t, &b, 4);
+   return p * t * 255.0f + 0.5f;
+}
+
+static stbi_uc stbi__ldr_color(float v, float scale_i, float g)
+{
+   float x = v * scale_i;
+   if (!(x > 0)) return 0;
+   if (x >= 1) return 255;
+   return (stbi_uc) stbi__float2int(stbi__ldr_pow(x, g));
+}
+
+static stbi_uc stbi__ldr_alpha(float v)
+{
+   float z = v * 255 + 0.5f;
+   if (z < 0) z = 0;
+   if (z > 255) z = 255;
+   return (stbi_uc) stbi__float2int(z);
+}
+
+#ifdef STBI_SSE2
+// 4 channels at a time. with 1, 2 or 4 channels the alpha lanes are the
+// same in every vector, and 3-channel images have none
+static void stbi__hdr_to_ldr_simd(stbi_uc *out, float const *in, int count, float scale_i, float g, int comp)
+{
+   __m128i amask = comp == 4 ? _mm_setr_epi32(0,0,0,-1) : comp == 2 ? _mm_setr_epi32(0,-1,0,-1) : _mm_setzero_si128();
+   __m128 scale = _mm_set1_ps(scale_i), gv = _mm_set1_ps(g);
+   __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f), c255 = _mm_set1_ps(255.0f);
+   __m128 sqrt2 = _mm_set1_ps(1.41421356f), tiny = _mm_set1_ps(1.1754944e-38f);
+   __m128i mant = _mm_set1_epi32(0x7fffff), exp0 = _mm_set1_epi32(0x3f800000);
+   int i, packed;
+   for (i=0; i+4 <= count; i += 4) {
+      __m128 v = _mm_loadu_ps(in + i);
+      __m128 x = _mm_mul_ps(v, scale);
+      __m128 pos = _mm_cmpgt_ps(x, _mm_setzero_ps());
+      __m128 big = _mm_cmpge_ps(x, one);
+      __m128 m, t, t2, l, f, r, p, z, a;
+      __m128i b, e, n, big_hi, q;
+      x = _mm_max_ps(x, tiny);
+      b = _mm_castps_si128(x);
+      e = _mm_sub_epi32(_mm_srli_epi32(b, 23), _mm_set1_epi32(127));
+      m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(b, mant), exp0));
+      big_hi = _mm_castps_si128(_mm_cmpgt_ps(m, sqrt2));
+      m = _mm_mul_ps(m, _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(big_hi), half), _mm_andnot_ps(_mm_castsi128_ps(big_hi), one)));
+      e = _mm_sub_epi32(e, big_hi); // big_hi is -1 where m was halved
+      t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+      t2 = _mm_mul_ps(t, t);
+      l = _mm_add_ps(_mm_set1_ps(STBI__L2_C5), _mm_mul_ps(t2, _mm_set1_ps(STBI__L2_C7)));
+      l = _mm_add_ps(_mm_set1_ps(STBI__L2_C3), _mm_mul_ps(t2, l));
+      l = _mm_add_ps(_mm_set1_ps(STBI__L2_C1), _mm_mul_ps(t2, l));
+      l = _mm_add_ps(_mm_cvtepi32_ps(e), _mm_mul_ps(t, l));
+      f = _mm_max_ps(_mm_mul_ps(gv, l), _mm_set1_ps(-126.0f));
+      n = _mm_cvttps_epi32(_mm_sub_ps(f, half));
+      r = _mm_sub_ps(f, _mm_cvtepi32_ps(n));
+      p = _mm_add_ps(_mm_set1_ps(STBI__E2_C5), _mm_mul_ps(r, _mm_set1_ps(STBI__E2_C6)));
+      p = _mm_add_ps(_mm_set1_ps(STBI__E2_C4), _mm_mul_ps(r, p));
+      p = _mm_add_ps(_mm_set1_ps(STBI__E2_C3), _mm_mul_ps(r, p));
+      p = _mm_add_ps(_mm_set1_ps(STBI__E2_C2), _mm_mul_ps(r, p));
+      p = _mm_add_ps(_mm_set1_ps(STBI__E2_C1), _mm_mul_ps(r, p));
+      p = _mm_add_ps(one, _mm_mul_ps(r, p));
+      z = _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23)));
+      z = _mm_add_ps(_mm_mul_ps(z, c255), half);
+      z = _mm_or_ps(_mm_and_ps(big, c255), _mm_andnot_ps(big, _mm_and_ps(pos, z)));
+      // alpha lanes: v*255 + 0.5, clamped
+      a = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(v, c255), half), _mm_setzero_ps()), c255);
+      z = _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(amask), a), _mm_andnot_ps(_mm_castsi128_ps(amask), z));
+      q = _mm_cvttps_epi32(z);
+      q = _mm_packs_epi32(q, q);
+      q = _mm_packus_epi16(q, q);
+      // in place is fine: bytes i..i+3 lie within floats already loaded
+      packed = _mm_cvtsi128_si32(q);
+      memcpy(out + i, &packed, 4);
+   }
+}
+#endif
+
+#ifdef STBI_AVX2
+// same steps as stbi__hdr_to_ldr_simd, 8 at a time (no FMA, so the results
+// are identical)
+STBI__AVX2_TARGET
+static void stbi__hdr_to_ldr_avx2(stbi_uc *out, float const *in, int count, float scale_i, float g, int comp)
+{
+   __m256i amask = comp == 4 ? _mm256_setr_epi32(0,0,0,-1,0,0,0,-1) : comp == 2 ? _mm256_setr_epi32(0,-1,0,-1,0,-1,0,-1) : _mm256_setzero_si256();
+   __m256 scale = _mm256_set1_ps(scale_i), gv = _mm256_set1_ps(g);
+   __m256 one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f), c255 = _mm256_set1_ps(255.0f);
+   __m256 sqrt2 = _mm256_set1_ps(1.41421356f), tiny = _mm256_set1_ps(1.1754944e-38f);
+   __m256i mant = _mm256_set1_epi32(0x7fffff), exp0 = _mm256_set1_epi32(0x3f800000);
+   int i;
+   for (i=0; i+8 <= count; i += 8) {
+      __m256 v = _mm256_loadu_ps(in + i);
+      __m256 x = _mm256_mul_ps(v, scale);
+      __m256 pos = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ);
+      __m256 big = _mm256_cmp_ps(x, one, _CMP_GE_OQ);
+      __m256 m, t, t2, l, f, r, p, z, a, big_hi;
+      __m256i b, e, n, q;
+      __m128i q8;
+      x = _mm256_max_ps(x, tiny);
+      b = _mm256_castps_si256(x);
+      e = _mm256_sub_epi32(_mm256_srli_epi32(b, 23), _mm256_set1_epi32(127));
+      m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(b, mant), exp0));
+      big_hi = _mm256_cmp_ps(m, sqrt2, _CMP_GT_OQ);
+      m = _mm256_mul_ps(m, _mm256_blendv_ps(one, half, big_hi));
+      e = _mm256_sub_epi32(e, _mm256_castps_si256(big_hi));
+      t = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+      t2 = _mm256_mul_ps(t, t);
+      l = _mm256_add_ps(_mm256_set1_ps(STBI__L2_C5), _mm256_mul_ps(t2, _mm256_set1_ps(STBI__L2_C7)));
+      l = _mm256_add_ps(_mm256_set1_ps(STBI__L2_C3), _mm256_mul_ps(t2, l));
+      l = _mm256_add_ps(_mm256_set1_ps(STBI__L2_C1), _mm256_mul_ps(t2, l));
+      l = _mm256_add_ps(_mm256_cvtepi32_ps(e), _mm256_mul_ps(t, l));
+      f = _mm256_max_ps(_mm256_mul_ps(gv, l), _mm256_set1_ps(-126.0f));
+      n = _mm256_cvttps_epi32(_mm256_sub_ps(f, half));
+      r = _mm256_sub_ps(f, _mm256_cvtepi32_ps(n));
+      p = _mm256_add_ps(_mm256_set1_ps(STBI__E2_C5), _mm256_mul_ps(r, _mm256_set1_ps(STBI__E2_C6)));
+      p = _mm256_add_ps(_mm256_set1_ps(STBI__E2_C4), _mm256_mul_ps(r, p));
+      p = _mm256_add_ps(_mm256_set1_ps(STBI__E2_C3), _mm256_mul_ps(r, p));
+      p = _mm256_add_ps(_mm256_set1_ps(STBI__E2_C2), _mm256_mul_ps(r, p));
+      p = _mm256_add_ps(_mm256_set1_ps(STBI__E2_C1), _mm256_mul_ps(r, p));
+      p = _mm256_add_ps(one, _mm256_mul_ps(r, p));
+      z = _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23)));
+      z = _mm256_add_ps(_mm256_mul_ps(z, c255), half);
+      z = _mm256_blendv_ps(_mm256_and_ps(pos, z), c255, big);
+      a = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(v, c255), half), _mm256_setzero_ps()), c255);
+      z = _mm256_blendv_ps(z, a, _mm256_castsi256_ps(amask));
+      q = _mm256_cvttps_epi32(z);
+      q8 = _mm_packs_epi32(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1));
+      _mm_storel_epi64((__m128i *) (out + i), _mm_packus_epi16(q8, q8));
+   }
+}
+#endif
+
+static stbi_uc *stbi__hdr_to_ldr(stbi__context *s, float   *data, int x, int y, int comp)
 {
-   int i,k,n;
+   int i,k,n,done=0,total;
    stbi_uc *output;
+   float g = s->h2l_gamma_i, scale_i = s->h2l_scale_i;
    if (!data) return NULL;
-   output = (stbi_uc *) stbi__malloc_mad3(x, y, comp, 0);
-   if (output == NULL) { STBI_FREE(data); return stbi__errpuc("outofmem", "Out of memory"); }
+   // convert in place; byte i is always inside a float that has been read
+   output = (stbi_uc *) data;
+   total = x*y*comp;
    // compute number of non-alpha components
    if (comp & 1) n = comp; else n = comp-1;
-   for (i=0; i < x*y; ++i) {
-      for (k=0; k < n; ++k) {
-         float z = (float) pow(data[i*comp+k]*stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
-         if (z < 0) z = 0;
-         if (z > 255) z = 255;
-         output[i*comp + k] = (stbi_uc) stbi__float2int(z);
+   if (!(g > 0)) {
+      // the approximation assumes pow() is increasing; keep the original
+      // expression for odd settings
+      for (i=0; i < total; i += comp) {
+         for (k=0; k < n; ++k) {
+            float z = (float) pow(data[i+k]*scale_i, g) * 255 + 0.5f;
+            if (z < 0) z = 0;
+            if (z > 255) z = 255;
+            output[i+k] = (stbi_uc) stbi__float2int(z);
+         }
+         if (k < comp) output[i+k] = stbi__ldr_alpha(data[i+k]);
+      }
+   } else {
+#ifdef STBI_SSE2
+      if (stbi__sse2_available()) {
+#ifdef STBI_AVX2
+         if (stbi__avx2_available()) {
+            stbi__hdr_to_ldr_avx2(output, data, total, scale_i, g, comp);
+            done = total & ~7;
+         } else
+#endif
+         {
+            stbi__hdr_to_ldr_simd(output, data, total, scale_i, g, comp);
+            done = total & ~3;
+         }
       }
-      if (k < comp) {
-         float z = data[i*comp+k] * 255 + 0.5f;
-         if (z < 0) z = 0;
-         if (z > 255) z = 255;
-         output[i*comp + k] = (stbi_uc) stbi__float2int(z);
+#endif
+      for (i=done; i < total; ++i) {
+         if (n < comp && i % comp == n)
+            output[i] = stbi__ldr_alpha(data[i]);
+         else
+            output[i] = stbi__ldr_color(data[i], scale_i, g);
       }
    }
-   STBI_FREE(data);
-   return output;
+   // give back the unused 3/4 of the buffer
+   output = (stbi_uc *) STBI_REALLOC_SIZED(data, total*sizeof(float), total);
+   return output ? output : (stbi_uc *) data;
 }
 #endif
 
@@ -1672,6 +3238,7 @@ typedef struct
       int dc_pred;
 
       int x,y,w2,h2;
+      int scale; // log2 of this component's block downscale, <= jpeg scale
       stbi_uc *data;
       void *raw_data, *raw_coeff;
       stbi_uc *linebuf;
@@ -1696,6 +3263,7 @@ typedef struct
 
    int scan_n, order[4];
    int restart_interval, todo;
+   int scale; // log2 of the downscale of the whole image
 
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
@@ -2211,6 +3779,59 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
    }
 }
 
+// reduced IDCTs for scaled decoding (see stbi_options.jpeg_scale). an
+// NxN block is the N-point IDCT of the lowest NxN coefficients, which
+// with JPEG's normalization is the 8-point formula with cos((2x+1)u*pi/2N);
+// so the 4x4 kernel is half an 8-point IDCT and the smaller ones are trivial.
+#define STBI__IDCT_1D_4(s0,s1,s2,s3)                  \
+   e0 = ((s0)+(s2)) * stbi__f2f(0.353553391f);        \
+   e1 = ((s0)-(s2)) * stbi__f2f(0.353553391f);        \
+   o0 = (s1)*stbi__f2f(0.461939766f) + (s3)*stbi__f2f(0.191341716f); \
+   o1 = (s1)*stbi__f2f(0.191341716f) - (s3)*stbi__f2f(0.461939766f);
+
+static void stbi__idct_block_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,e0,e1,o0,o1,val[16],*v=val;
+   short *d = data;
+
+   // columns; like the 8x8 IDCT, keep 2 extra bits of precision
+   for (i=0; i < 4; ++i,++d,++v) {
+      STBI__IDCT_1D_4(d[0],d[8],d[16],d[24])
+      e0 += 512; e1 += 512;
+      v[ 0] = (e0+o0) >> 10;
+      v[12] = (e0-o0) >> 10;
+      v[ 4] = (e1+o1) >> 10;
+      v[ 8] = (e1-o1) >> 10;
+   }
+
+   for (i=0, v=val; i < 4; ++i,v+=4,out+=out_stride) {
+      STBI__IDCT_1D_4(v[0],v[1],v[2],v[3])
+      e0 += 8192 + (128<<14);
+      e1 += 8192 + (128<<14);
+      out[0] = stbi__clamp((e0+o0) >> 14);
+      out[3] = stbi__clamp((e0-o0) >> 14);
+      out[1] = stbi__clamp((e1+o1) >> 14);
+      out[2] = stbi__clamp((e1-o1) >> 14);
+   }
+}
+
+static void stbi__idct_block_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+   // every basis value is +-1/sqrt(8), so the products are exactly 1/8
+   int a = data[0] + data[8], b = data[0] - data[8];
+   int c = data[1] + data[9], d = data[1] - data[9];
+   out[0]            = stbi__clamp(((a+c+4) >> 3) + 128);
+   out[1]            = stbi__clamp(((a-c+4) >> 3) + 128);
+   out[out_stride]   = stbi__clamp(((b+d+4) >> 3) + 128);
+   out[out_stride+1] = stbi__clamp(((b-d+4) >> 3) + 128);
+}
+
+static void stbi__idct_block_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+   STBI_NOTUSED(out_stride);
+   out[0] = stbi__clamp(((data[0]+4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2619,6 +4240,20 @@ static stbi_uc stbi__get_marker(stbi__jpeg *j)
 // of the components is specified by order[]
 #define STBI__RESTART(x)     ((x) >= 0xd0 && (x) <= 0xd7)
 
+static void (*stbi__idct_reduced[4])(stbi_uc *out, int out_stride, short data[64]) =
+   { NULL, stbi__idct_block_4x4, stbi__idct_block_2x2, stbi__idct_block_1x1 };
+
+// IDCT block (bx,by) of component n into its place in the component plane
+stbi_inline static void stbi__jpeg_idct(stbi__jpeg *z, int n, int bx, int by, short data[64])
+{
+   int sc = z->img_comp[n].scale;
+   stbi_uc *out = z->img_comp[n].data + ((z->img_comp[n].w2*by + bx) << (3 - sc));
+   if (sc)
+      stbi__idct_reduced[sc](out, z->img_comp[n].w2, data);
+   else
+      z->idct_block_kernel(out, z->img_comp[n].w2, data);
+}
+
 // after a restart interval, stbi__jpeg_reset the entropy decoder and
 // the dc prediction
 static void stbi__jpeg_reset(stbi__jpeg *j)
@@ -2634,8 +4269,178 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+#ifdef STBI_THREADS
+// a baseline scan split at its RSTn markers; segment k holds MCUs
+// [k*restart_interval, (k+1)*restart_interval) and starts at seg_start[k]
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc **seg_start;
+   int nseg, units, nthreads;
+   int failed[STBI__MAX_THREADS];
+   // stbi__err is thread-local, so a worker's reason is kept here and
+   // raised again on the calling thread
+   const char *reason[STBI__MAX_THREADS];
+   // where a thread's scan ended: after the last segment, or at a segment
+   // that didn't end at its RSTn, which is where the serial decoder stops
+   int ended[STBI__MAX_THREADS];
+   stbi_uc *end_buffer[STBI__MAX_THREADS];
+   stbi_uc end_marker[STBI__MAX_THREADS];
+} stbi__jpeg_scan_job;
+
+// decode baseline MCUs [first,last) of the current scan; 'unit' is a block
+// for non-interleaved scans and an interleaved MCU otherwise
+static int stbi__jpeg_decode_baseline_run(stbi__jpeg *z, int first, int last)
+{
+   STBI_SIMD_ALIGN(short, data[64]);
+   int u,k,x,y;
+   for (u=first; u < last; ++u) {
+      if (z->scan_n == 1) {
+         int n = z->order[0];
+         int w = (z->img_comp[n].x+7) >> 3;
+         int i = u % w, j = u / w;
+         int ha = z->img_comp[n].ha;
+         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+         stbi__jpeg_idct(z, n, i, j, data);
+      } else {
+         int i = u % z->img_mcu_x, j = u / z->img_mcu_x;
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int x2 = i*z->img_comp[n].h + x;
+                  int y2 = j*z->img_comp[n].v + y;
+                  int ha = z->img_comp[n].ha;
+                  if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                  stbi__jpeg_idct(z, n, x2, y2, data);
+               }
+            }
+         }
+      }
+   }
+   return 1;
+}
+
+static void stbi__jpeg_scan_worker(void *arg, int index)
+{
+   stbi__jpeg_scan_job *job = (stbi__jpeg_scan_job *) arg;
+   int first = job->nseg *  index    / job->nthreads;
+   int last  = job->nseg * (index+1) / job->nthreads;
+   int k, ri = job->z->restart_interval;
+   // private decoder state: the bit reader, dc predictors and input
+   // position are per-segment, everything else is shared read-only
+   stbi__context s = *job->z->s;
+   stbi__jpeg *z = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   if (!z) {
+      stbi__err("outofmem", "Out of memory");
+      job->failed[index] = 1;
+      job->reason[index] = stbi__g_failure_reason;
+      return;
+   }
+   *z = *job->z;
+   z->s = &s;
+   for (k=first; k < last; ++k) {
+      int u1 = (k+1)*ri < job->units ? (k+1)*ri : job->units;
+      s.img_buffer = job->seg_start[k];
+      stbi__jpeg_reset(z);
+      if (!stbi__jpeg_decode_baseline_run(z, k*ri, u1)) {
+         job->failed[index] = 1;
+         job->reason[index] = stbi__g_failure_reason;
+         break;
+      }
+      // same check as the serial loop at the end of each full interval
+      if (u1 - k*ri == ri && z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+      if (k == job->nseg-1 || !STBI__RESTART(z->marker) || s.img_buffer != job->seg_start[k+1]) {
+         job->ended[index] = 1;
+         job->end_buffer[index] = s.img_buffer;
+         job->end_marker[index] = z->marker;
+         break;
+      }
+   }
+   STBI_FREE(z);
+}
+
+// returns -1 if this scan can't be split, so the caller decodes it serially
+static int stbi__jpeg_parse_entropy_parallel(stbi__jpeg *z)
+{
+   stbi__jpeg_scan_job job;
+   stbi_uc *p, *end, *term = NULL;
+   int units, k, nrst = 0;
+
+   if (z->progressive || z->restart_interval == 0 || z->s->io.read != NULL)
+      return -1;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      units = ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   } else
+      units = z->img_mcu_x * z->img_mcu_y;
+   job.nseg = (units + z->restart_interval-1) / z->restart_interval;
+   // don't bother with threads for small scans
+   if (job.nseg < 2 || z->s->img_x * z->s->img_y < 256*256)
+      return -1;
+   job.nthreads = stbi__thread_count(z->s->jpeg_threads, job.nseg);
+   if (job.nthreads < 2)
+      return -1;
+
+   job.seg_start = (stbi_uc **) stbi__scratch_malloc(z->s->decoder, sizeof(stbi_uc *) * job.nseg);
+   if (!job.seg_start) return -1;
+
+   // find the RSTn markers and the marker that ends the scan. anything
+   // unexpected (wrong marker count, truncation) falls back to the serial
+   // decoder so corrupt files behave exactly as before.
+   job.seg_start[0] = z->s->img_buffer;
+   p = z->s->img_buffer;
+   end = z->s->img_buffer_end;
+   while (p+1 < end) {
+      if (p[0] != 0xff) { ++p; continue; }
+      if (p[1] == 0x00) { p += 2; continue; } // stuffed byte
+      if (p[1] == 0xff) { ++p; continue; }    // fill byte
+      if (!STBI__RESTART(p[1])) { term = p; break; }
+      if (++nrst >= job.nseg) break;
+      job.seg_start[nrst] = p+2;
+      p += 2;
+   }
+   if (term == NULL || nrst != job.nseg-1) {
+      stbi__scratch_free(z->s->decoder, job.seg_start);
+      return -1;
+   }
+
+   job.z = z;
+   job.units = units;
+   for (k=0; k < job.nthreads; ++k) {
+      job.failed[k] = job.ended[k] = 0;
+      job.reason[k] = NULL;
+   }
+   stbi__parallel_run(stbi__jpeg_scan_worker, &job, job.nthreads);
+   stbi__scratch_free(z->s->decoder, job.seg_start);
+
+   // threads own consecutive segments, so the first one that failed or
+   // ended decides the result, as the serial decoder would have. segments
+   // decoded past that point are ignored.
+   for (k=0; k < job.nthreads; ++k) {
+      if (job.failed[k]) {
+         stbi__g_failure_reason = job.reason[k];
+         return 0;
+      }
+      if (job.ended[k]) break;
+   }
+   if (k == job.nthreads) return stbi__err("bad restart","Corrupt JPEG");
+
+   // leave the stream where the serial decoder would, so a scan that ended
+   // early fails (or recovers) the same way afterwards
+   stbi__jpeg_reset(z);
+   z->marker = job.end_marker[k];
+   z->s->img_buffer = job.end_buffer[k];
+   return 1;
+}
+#endif // STBI_THREADS
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
+#ifdef STBI_THREADS
+   int r = stbi__jpeg_parse_entropy_parallel(z);
+   if (r >= 0) return r;
+#endif
    stbi__jpeg_reset(z);
    if (!z->progressive) {
       if (z->scan_n == 1) {
@@ -2652,7 +4457,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
                if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               stbi__jpeg_idct(z, n, i, j, data);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2676,11 +4481,11 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   // by the basic H and V specified for the component
                   for (y=0; y < z->img_comp[n].v; ++y) {
                      for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
+                        int x2 = i*z->img_comp[n].h + x;
+                        int y2 = j*z->img_comp[n].v + y;
                         int ha = z->img_comp[n].ha;
                         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        stbi__jpeg_idct(z, n, x2, y2, data);
                      }
                   }
                }
@@ -2777,7 +4582,7 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               stbi__jpeg_idct(z, n, i, j, data);
             }
          }
       }
@@ -2931,17 +4736,17 @@ static int stbi__free_jpeg_components(stbi__jpeg *z, int ncomp, int why)
    int i;
    for (i=0; i < ncomp; ++i) {
       if (z->img_comp[i].raw_data) {
-         STBI_FREE(z->img_comp[i].raw_data);
+         stbi__scratch_free(z->s->decoder, z->img_comp[i].raw_data);
          z->img_comp[i].raw_data = NULL;
          z->img_comp[i].data = NULL;
       }
       if (z->img_comp[i].raw_coeff) {
-         STBI_FREE(z->img_comp[i].raw_coeff);
+         stbi__scratch_free(z->s->decoder, z->img_comp[i].raw_coeff);
          z->img_comp[i].raw_coeff = 0;
          z->img_comp[i].coeff = 0;
       }
       if (z->img_comp[i].linebuf) {
-         STBI_FREE(z->img_comp[i].linebuf);
+         stbi__scratch_free(z->s->decoder, z->img_comp[i].linebuf);
          z->img_comp[i].linebuf = NULL;
       }
    }
@@ -3007,21 +4812,34 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       //
       // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
       // so these muls can't overflow with 32-bit ints (which we require)
-      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      // when scaling down, a subsampled component gets a bigger IDCT than
+      // the full-resolution ones, as far as that takes it to full output
+      // resolution, so it doesn't need upsampling afterwards. like IJG
+      // this only handles the same power of 2 in both directions.
+      z->img_comp[i].scale = z->scale;
+      if (h_max % z->img_comp[i].h == 0 && v_max % z->img_comp[i].v == 0
+          && h_max / z->img_comp[i].h == v_max / z->img_comp[i].v) {
+         int f = h_max / z->img_comp[i].h;
+         while (f > 1 && (f & 1) == 0 && z->img_comp[i].scale > 0) {
+            f >>= 1;
+            --z->img_comp[i].scale;
+         }
+      }
+      z->img_comp[i].w2 = (z->img_mcu_x * z->img_comp[i].h * 8) >> z->img_comp[i].scale;
+      z->img_comp[i].h2 = (z->img_mcu_y * z->img_comp[i].v * 8) >> z->img_comp[i].scale;
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
-      z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
+      z->img_comp[i].raw_data = stbi__scratch_mad2(s->decoder, z->img_comp[i].w2, z->img_comp[i].h2, 15);
       if (z->img_comp[i].raw_data == NULL)
          return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
       if (z->progressive) {
-         // w2, h2 are multiples of 8 (see above)
-         z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-         z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+         // one block per 8x8 pixels, whatever the scale
+         z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+         z->img_comp[i].raw_coeff = stbi__scratch_mad3(s->decoder, z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
          if (z->img_comp[i].raw_coeff == NULL)
             return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3065,7 +4883,7 @@ static int stbi__decode_jpeg_header(stbi__jpeg *z, int scan)
 }
 
 // decode image to YCbCr format
-static int stbi__decode_jpeg_image(stbi__jpeg *j)
+static int stbi__decode_jpeg_image(stbi__jpeg *j, int req_comp)
 {
    int m;
    for (m = 0; m < 4; m++) {
@@ -3074,6 +4892,15 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
    }
    j->restart_interval = 0;
    if (!stbi__decode_jpeg_header(j, STBI__SCAN_load)) return 0;
+   if (j->s->dest) {
+      // the frame header gives the output size, so a caller buffer that
+      // can't hold it fails here rather than after the entropy decode
+      int d = 1 << j->scale;
+      int w = (int) ((j->s->img_x + d-1) >> j->scale);
+      int h = (int) ((j->s->img_y + d-1) >> j->scale);
+      int n = req_comp ? req_comp : j->s->img_n >= 3 ? 3 : 1;
+      if (!stbi__dest_fits(j->s, w, h, n)) return stbi__err("buffer too small", "Output buffer too small for image");
+   }
    m = stbi__get_marker(j);
    while (!stbi__EOI(m)) {
       if (stbi__SOS(m)) {
@@ -3302,6 +5129,77 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+STBI__AVX2_TARGET
+static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   // same filter as stbi__resample_row_hv_2_simd, 16 input pixels at a time
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass: 3*near + far = 4*near + (far - near)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff); // current row
+
+      // byte shifts only work within 128-bit lanes, so build "prev" and
+      // "next" with alignr against a lane-swapped copy of the current row.
+      __m256i lo0  = _mm256_permute2x128_si256(curr, curr, 0x08); // (0, curr.lo)
+      __m256i hi0  = _mm256_permute2x128_si256(curr, curr, 0x81); // (curr.hi, 0)
+      __m256i prv0 = _mm256_alignr_epi8(curr, lo0, 14);
+      __m256i nxt0 = _mm256_alignr_epi8(hi0, curr, 2);
+      __m256i prev = _mm256_insert_epi16(prv0, t1, 0);
+      __m256i next = _mm256_insert_epi16(nxt0, 3*in_near[i+16] + in_far[i+16], 15);
+
+      // horizontal pass, polyphase as in the SSE2 version
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleave even and odd pixels, then undo scaling. the per-lane
+      // unpack/pack pair leaves the 32 output bytes in order.
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+
+      __m256i outv = _mm256_packus_epi16(de0, de1);
+      _mm256_storeu_si256((__m256i *) (out + i*2), outv);
+
+      // "previous" value for next iter
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3476,6 +5374,75 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+STBI__AVX2_TARGET
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   // same fixed-point math as the SSE2 kernel, 16 pixels at a time
+   if (step == 4) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         // load
+         __m128i y_bytes = _mm_loadu_si128((__m128i *) (y+i));
+         __m128i cr_bytes = _mm_loadu_si128((__m128i *) (pcr+i));
+         __m128i cb_bytes = _mm_loadu_si128((__m128i *) (pcb+i));
+         __m128i cr_biased = _mm_xor_si128(cr_bytes, signflip); // -128
+         __m128i cb_biased = _mm_xor_si128(cb_bytes, signflip); // -128
+
+         // widen to short, with y in the high byte (+128 below) and cr, cb
+         // left-shifted by 8, matching the SSE2 unpack
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cr_biased), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cb_biased), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte, set up for transpose
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+
+         // transpose to interleave channels; each lane ends up holding
+         // pixels 0-3/8-11 (o0) and 4-7/12-15 (o1)
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+         // store, putting the lanes back in pixel order
+         _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+
+   // leftovers (and step != 4) go through the SSE2 kernel, which ends in the C loop
+   stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
@@ -3491,11 +5458,22 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    }
 #endif
 
+#ifdef STBI_AVX2
+   // an 8x8 IDCT already fills exactly eight 128-bit rows, so the SSE2
+   // IDCT stays in place; only the row-oriented kernels get wider.
+   if (stbi__avx2_available()) {
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+   }
+#endif
+
 #ifdef STBI_NEON
    j->idct_block_kernel = stbi__idct_simd;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
 #endif
+
+   j->scale = j->s->jpeg_scale;
 }
 
 // clean up the temporary component buffers
@@ -3521,6 +5499,194 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+// resample and color-convert output rows [j0,j1), which are 'pitch' bytes
+// apart in output. res_init is the resampler state for row 0; a copy is
+// advanced to row j0 first, so separate strips of rows can be converted
+// independently of each other.
+//
+// the n==3 paths store a junk 4th byte past each pixel (output has a spare
+// byte for it), which spills onto the first byte of row j1. if last_row is
+// given, row j1-1 is converted there and copied out, keeping the strip's
+// writes inside [j0,j1). rows that aren't packed back to back (a caller's
+// buffer) have nowhere to spill, so then every row goes through last_row.
+static void stbi__jpeg_emit_rows(stbi__jpeg *z, stbi__resample *res_init, stbi_uc **linebuf, stbi_uc *output, int pitch, int n, int decode_n, int is_rgb, stbi__uint32 j0, stbi__uint32 j1, stbi_uc *last_row)
+{
+   int k;
+   unsigned int i,j;
+   stbi_uc *coutput[4];
+   stbi__resample res_comp[4];
+
+   for (k=0; k < decode_n; ++k) {
+      stbi__resample *r = &res_comp[k];
+      int t, a, rows = z->img_comp[k].y;
+      *r = res_init[k];
+      // each row advances ystep; every vs rows the source lines move down
+      // one, clamped to the last line of the component
+      t = r->ystep + (int) j0;
+      a = t / r->vs;
+      r->ystep = t % r->vs;
+      r->ypos  = a;
+      r->line1 = z->img_comp[k].data + z->img_comp[k].w2 * (a < rows ? a : rows-1);
+      if (a > 0)
+         r->line0 = z->img_comp[k].data + z->img_comp[k].w2 * (a-1 < rows ? a-1 : rows-1);
+   }
+
+   for (j=j0; j < j1; ++j) {
+      stbi_uc *dst = output + (ptrdiff_t) pitch * (int) j;
+      stbi_uc *out = dst;
+      int via_last_row = last_row && (j == j1-1 || (n == 3 && pitch != 3 * (int) z->s->img_x));
+      if (via_last_row)
+         out = last_row;
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(linebuf[k],
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
+               for (i=0; i < z->s->img_x; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
+                  out += n;
+               }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  out[3] = 255;
+                  out += n;
+               }
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
+                  out += n;
+               }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               out[1] = 255;
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
+         }
+      }
+      if (via_last_row)
+         memcpy(dst, last_row, n * z->s->img_x);
+   }
+}
+
+#ifdef STBI_THREADS
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__resample *res_comp;
+   stbi_uc *output;
+   int pitch;
+   stbi_uc *scratch; // per-thread line buffers + one output row
+   int scratch_size;
+   int n, decode_n, is_rgb, nthreads;
+} stbi__jpeg_rows_job;
+
+static void stbi__jpeg_rows_worker(void *arg, int index)
+{
+   stbi__jpeg_rows_job *job = (stbi__jpeg_rows_job *) arg;
+   stbi__jpeg *z = job->z;
+   stbi__uint32 j0 = z->s->img_y *  index    / job->nthreads;
+   stbi__uint32 j1 = z->s->img_y * (index+1) / job->nthreads;
+   stbi_uc *buf = job->scratch + job->scratch_size * index;
+   stbi_uc *linebuf[4];
+   int k;
+   for (k=0; k < job->decode_n; ++k)
+      linebuf[k] = buf + k * (z->s->img_x + 3);
+   stbi__jpeg_emit_rows(z, job->res_comp, linebuf, job->output, job->pitch, job->n, job->decode_n, job->is_rgb, j0, j1, buf + job->decode_n * (z->s->img_x + 3));
+}
+
+// convert all rows in parallel strips. returns 0 if the image is too small
+// to bother or scratch memory isn't available; the caller then goes serial
+static int stbi__jpeg_emit_rows_parallel(stbi__jpeg *z, stbi__resample *res_comp, stbi_uc *output, int pitch, int n, int decode_n, int is_rgb)
+{
+   stbi__jpeg_rows_job job;
+   if (z->s->img_x * z->s->img_y < 256*256) // can't overflow, both are 16-bit
+      return 0;
+   job.nthreads = stbi__thread_count(z->s->jpeg_threads, z->s->img_y / 16);
+   if (job.nthreads < 2)
+      return 0;
+   // line buffers, then room for one output row plus the spare byte
+   job.scratch_size = (decode_n + n) * (z->s->img_x + 3) + 1;
+   job.scratch = (stbi_uc *) stbi__scratch_mad2(z->s->decoder, job.nthreads, job.scratch_size, 0);
+   if (!job.scratch)
+      return 0;
+   job.z = z;
+   job.res_comp = res_comp;
+   job.output = output;
+   job.pitch = pitch;
+   job.n = n;
+   job.decode_n = decode_n;
+   job.is_rgb = is_rgb;
+   stbi__parallel_run(stbi__jpeg_rows_worker, &job, job.nthreads);
+   stbi__scratch_free(z->s->decoder, job.scratch);
+   return 1;
+}
+#endif // STBI_THREADS
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
@@ -3530,7 +5696,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
 
    // load a jpeg image from whichever source, but leave in YCbCr format
-   if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
+   if (!stbi__decode_jpeg_image(z, req_comp)) { stbi__cleanup_jpeg(z); return NULL; }
 
    // determine actual number of components to generate
    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
@@ -3542,12 +5708,22 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    else
       decode_n = z->s->img_n;
 
+   // everything from here on works on the scaled-down image
+   if (z->scale) {
+      int k, d = 1 << z->scale;
+      z->s->img_x = (z->s->img_x + d-1) >> z->scale;
+      z->s->img_y = (z->s->img_y + d-1) >> z->scale;
+      for (k=0; k < decode_n; ++k) {
+         int cs = z->img_comp[k].scale;
+         z->img_comp[k].y = (z->img_comp[k].y + (1 << cs)-1) >> cs;
+      }
+   }
+
    // resample and color-convert
    {
-      int k;
-      unsigned int i,j;
-      stbi_uc *output;
-      stbi_uc *coutput[4];
+      int k, pitch;
+      stbi_uc *output, *last_row = NULL;
+      stbi_uc *linebuf[4];
 
       stbi__resample res_comp[4];
 
@@ -3556,122 +5732,49 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 
          // allocate line buffer big enough for upsampling off the edges
          // with upsample factor of 4
-         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
+         z->img_comp[k].linebuf = (stbi_uc *) stbi__scratch_malloc(z->s->decoder, z->s->img_x + 3);
          if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
-         r->ystep   = r->vs >> 1;
-         r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
-         r->ypos    = 0;
-         r->line0   = r->line1 = z->img_comp[k].data;
-
-         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-         else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-         else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-         else                               r->resample = stbi__resample_row_generic;
-      }
-
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
-            }
+         // a component IDCT'd at less than the image's downscale is
+         // already that much closer to full size
+         r->hs      = (z->img_h_max / z->img_comp[k].h) >> (z->scale - z->img_comp[k].scale);
+         r->vs      = (z->img_v_max / z->img_comp[k].v) >> (z->scale - z->img_comp[k].scale);
+         r->ystep   = r->vs >> 1;
+         r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
+         r->ypos    = 0;
+         r->line0   = r->line1 = z->img_comp[k].data;
+
+         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+         else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+         else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+         else                               r->resample = stbi__resample_row_generic;
+      }
+
+      // can't error after this so, this is safe
+      output = stbi__dest_rows(z->s, z->s->img_x, z->s->img_y, n, &pitch);
+      if (output) {
+         // writing into the caller's buffer; n==3 rows need somewhere to
+         // put their spare byte, see stbi__jpeg_emit_rows
+         if (n == 3) {
+            last_row = (stbi_uc *) stbi__scratch_mad2(z->s->decoder, n, z->s->img_x, 1);
+            if (!last_row) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
          }
+      } else {
+         output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+         if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         pitch = n * z->s->img_x;
       }
+
+      for (k=0; k < decode_n; ++k)
+         linebuf[k] = z->img_comp[k].linebuf;
+
+      // now go ahead and resample
+#ifdef STBI_THREADS
+      if (!stbi__jpeg_emit_rows_parallel(z, res_comp, output, pitch, n, decode_n, is_rgb))
+#endif
+      stbi__jpeg_emit_rows(z, res_comp, linebuf, output, pitch, n, decode_n, is_rgb, 0, z->s->img_y, last_row);
+      stbi__scratch_free(z->s->decoder, last_row);
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
       *out_y = z->s->img_y;
@@ -3683,24 +5786,24 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
    unsigned char* result;
-   stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
+   stbi__jpeg* j = (stbi__jpeg*) stbi__scratch_malloc(s->decoder, sizeof(stbi__jpeg));
    STBI_NOTUSED(ri);
    j->s = s;
    stbi__setup_jpeg(j);
    result = load_jpeg_image(j, x,y,comp,req_comp);
-   STBI_FREE(j);
+   stbi__scratch_free(s->decoder, j);
    return result;
 }
 
 static int stbi__jpeg_test(stbi__context *s)
 {
    int r;
-   stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
+   stbi__jpeg* j = (stbi__jpeg*) stbi__scratch_malloc(s->decoder, sizeof(stbi__jpeg));
    j->s = s;
    stbi__setup_jpeg(j);
    r = stbi__decode_jpeg_header(j, STBI__SCAN_type);
    stbi__rewind(s);
-   STBI_FREE(j);
+   stbi__scratch_free(s->decoder, j);
    return r;
 }
 
@@ -3737,7 +5840,7 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #ifndef STBI_NO_ZLIB
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
-#define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
+#define STBI__ZFAST_BITS  11 // accelerate all cases in default tables, and pairs of short literals
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 
 // zlib-style huffman encoding
@@ -3826,7 +5929,8 @@ typedef struct
 {
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
-   stbi__uint32 code_buffer;
+   int num_zeros; // zero bytes fed into code_buffer after running out of input
+   stbi__uint64 code_buffer;
 
    char *zout;
    char *zout_start;
@@ -3834,6 +5938,14 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+
+   // z_length.fast, extended so one lookup can also return a second
+   // literal: bits 0-15 as in fast[], 16-23 the second literal, 24-27
+   // its code length (0 if the entry only decodes one symbol). 8k, so it
+   // comes from the decoder's scratch memory rather than the stack
+   stbi__uint32 *z_pair;
+
+   stbi_decoder *decoder; // where an expandable zout comes from
 } stbi__zbuf;
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
@@ -3842,20 +5954,46 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
    return *z->zbuffer++;
 }
 
+// unaligned little-endian 64-bit load
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p)
+{
+#if defined(STBI__X86_TARGET) || defined(STBI__X64_TARGET) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+   stbi__uint64 v;
+   memcpy(&v, p, 8);
+   return v;
+#else
+   return  (stbi__uint64) p[0]        | ((stbi__uint64) p[1] <<  8) |
+          ((stbi__uint64) p[2] << 16) | ((stbi__uint64) p[3] << 24) |
+          ((stbi__uint64) p[4] << 32) | ((stbi__uint64) p[5] << 40) |
+          ((stbi__uint64) p[6] << 48) | ((stbi__uint64) p[7] << 56);
+#endif
+}
+
 static void stbi__fill_bits(stbi__zbuf *z)
 {
-   do {
-      STBI_ASSERT(z->code_buffer < (1U << z->num_bits));
-      z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
-      z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   if (z->zbuffer_end - z->zbuffer >= 8) {
+      // branchless refill to at least 56 bits: load 8 bytes, keep the whole
+      // ones that fit. bits above num_bits then hold the start of the next
+      // unconsumed byte, which the next refill ORs in again unchanged.
+      z->code_buffer |= stbi__zload64(z->zbuffer) << z->num_bits;
+      z->zbuffer += (63 - z->num_bits) >> 3;
+      z->num_bits |= 56;
+   } else {
+      do {
+         if (z->zbuffer < z->zbuffer_end)
+            z->code_buffer |= (stbi__uint64) *z->zbuffer++ << z->num_bits;
+         else
+            ++z->num_zeros; // past the end reads as zeros, as before
+         z->num_bits += 8;
+      } while (z->num_bits <= 56);
+   }
 }
 
 stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) stbi__fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) (z->code_buffer & ((1 << n) - 1));
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
@@ -3866,7 +6004,7 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -3883,7 +6021,7 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
 {
    int b,s;
    if (a->num_bits < 16) stbi__fill_bits(a);
-   b = z->fast[a->code_buffer & STBI__ZFAST_MASK];
+   b = z->fast[(int) a->code_buffer & STBI__ZFAST_MASK];
    if (b) {
       s = b >> 9;
       a->code_buffer >>= s;
@@ -3903,7 +6041,7 @@ static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room
    limit = old_limit = (int) (z->zout_end - z->zout_start);
    while (cur + n > limit)
       limit *= 2;
-   q = (char *) STBI_REALLOC_SIZED(z->zout_start, old_limit, limit);
+   q = (char *) stbi__scratch_realloc(z->decoder, z->zout_start, old_limit, limit);
    STBI_NOTUSED(old_limit);
    if (q == NULL) return stbi__err("outofmem", "Out of memory");
    z->zout_start = q;
@@ -3926,11 +6064,61 @@ static int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,
 static int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+// fill z_pair from z_length.fast: where a literal's code leaves enough of
+// the STBI__ZFAST_BITS lookup bits for a whole second literal code, store
+// that literal too
+static void stbi__zbuild_pairs(stbi__zbuf *a)
+{
+   stbi__zhuffman *h = &a->z_length;
+   int i;
+   for (i=0; i < (1 << STBI__ZFAST_BITS); ++i) {
+      stbi__uint32 e = h->fast[i];
+      if (e && (e & 511) < 256) {
+         int s = e >> 9;
+         // upper s bits of i >> s are unknown, so only codes that fit in
+         // the remaining bits are resolved correctly by this lookup
+         stbi__uint32 e2 = h->fast[i >> s];
+         if (e2 && (e2 & 511) < 256 && (int) (e2 >> 9) <= STBI__ZFAST_BITS - s)
+            e |= ((e2 & 255) << 16) | ((e2 >> 9) << 24);
+      }
+      a->z_pair[i] = e;
+   }
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      stbi__uint32 e;
+      int z;
+      // 32 bits covers a literal pair, or a length code and its extra bits
+      if (a->num_bits < 32) {
+         stbi__fill_bits(a);
+         // a few zero bytes past the end are tolerated as before, but a
+         // truncated stream must not keep decoding zeros indefinitely
+         if (a->num_zeros > 16) return stbi__err("unexpected end","Corrupt PNG");
+      }
+      e = a->z_pair[(int) a->code_buffer & STBI__ZFAST_MASK];
+      if (e >> 24) {
+         // two literals from one lookup
+         if (zout + 2 > a->zout_end) {
+            if (!stbi__zexpand(a, zout, 2)) return 0;
+            zout = a->zout;
+         }
+         zout[0] = (char) (e & 255);
+         zout[1] = (char) ((e >> 16) & 255);
+         zout += 2;
+         e = ((e >> 9) & 15) + (e >> 24);
+         a->code_buffer >>= e;
+         a->num_bits -= e;
+         continue;
+      }
+      if (e) {
+         z = e & 511;
+         a->code_buffer >>= e >> 9;
+         a->num_bits -= e >> 9;
+      } else
+         z = stbi__zhuffman_decode_slowpath(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -3958,9 +6146,20 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
             zout = a->zout;
          }
          p = (stbi_uc *) (zout - dist);
-         if (dist == 1) { // run of one byte; common in images.
-            stbi_uc v = *p;
-            if (len) { do *zout++ = v; while (--len); }
+         if (dist >= 8 && a->zout_end - zout >= len + 8) {
+            // copy 8 bytes at a time; may write up to 7 bytes past the match,
+            // which is still inside the buffer and gets overwritten later.
+            // dist >= 8 means each chunk only reads bytes already written.
+            char *end = zout + len;
+            do {
+               memcpy(zout, p, 8);
+               zout += 8;
+               p += 8;
+            } while (zout < end);
+            zout = end;
+         } else if (dist == 1) { // run of one byte; common in images.
+            memset(zout, *p, len);
+            zout += len;
          } else {
             if (len) { do *zout++ = *p++; while (--len); }
          }
@@ -4023,17 +6222,16 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
    int len,nlen,k;
    if (a->num_bits & 7)
       stbi__zreceive(a, a->num_bits & 7); // discard
-   // drain the bit-packed data into header
-   k = 0;
-   while (a->num_bits > 0) {
-      header[k++] = (stbi_uc) (a->code_buffer & 255); // suppress MSVC run-time check
-      a->code_buffer >>= 8;
-      a->num_bits -= 8;
-   }
-   STBI_ASSERT(a->num_bits == 0);
-   // now fill header the normal way
-   while (k < 4)
-      header[k++] = stbi__zget8(a);
+   // the bit buffer can hold several whole bytes; hand back the ones that
+   // came from the input (any zero padding sits on top) and read the
+   // header and data straight from the input
+   k = a->num_bits >> 3;
+   a->zbuffer -= k > a->num_zeros ? k - a->num_zeros : 0;
+   a->code_buffer = 0;
+   a->num_bits = 0;
+   a->num_zeros = 0;
+   for (k=0; k < 4; ++k)
+      header[k] = stbi__zget8(a);
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
@@ -4094,6 +6292,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
    if (parse_header)
       if (!stbi__parse_zlib_header(a)) return 0;
    a->num_bits = 0;
+   a->num_zeros = 0;
    a->code_buffer = 0;
    do {
       final = stbi__zreceive(a,1);
@@ -4110,6 +6309,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
+         stbi__zbuild_pairs(a);
          if (!stbi__parse_huffman_block(a)) return 0;
       }
    } while (!final);
@@ -4118,12 +6318,17 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
 
 static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse_header)
 {
+   int r;
    a->zout_start = obuf;
    a->zout       = obuf;
    a->zout_end   = obuf + olen;
    a->z_expandable = exp;
 
-   return stbi__parse_zlib(a, parse_header);
+   a->z_pair = (stbi__uint32 *) stbi__scratch_malloc(a->decoder, sizeof(stbi__uint32) << STBI__ZFAST_BITS);
+   if (a->z_pair == NULL) return stbi__err("outofmem", "Out of memory");
+   r = stbi__parse_zlib(a, parse_header);
+   stbi__scratch_free(a->decoder, a->z_pair);
+   return r;
 }
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen)
@@ -4133,6 +6338,7 @@ STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int
    if (p == NULL) return NULL;
    a.zbuffer = (stbi_uc *) buffer;
    a.zbuffer_end = (stbi_uc *) buffer + len;
+   a.decoder = NULL;
    if (stbi__do_zlib(&a, p, initial_size, 1, 1)) {
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
@@ -4147,27 +6353,35 @@ STBIDEF char *stbi_zlib_decode_malloc(char const *buffer, int len, int *outlen)
    return stbi_zlib_decode_malloc_guesssize(buffer, len, 16384, outlen);
 }
 
-STBIDEF char *stbi_zlib_decode_malloc_guesssize_headerflag(const char *buffer, int len, int initial_size, int *outlen, int parse_header)
+// decode into a growable buffer from the decoder's scratch pool
+static char *stbi__zlib_decode_scratch(stbi_decoder *d, const char *buffer, int len, int initial_size, int *outlen, int parse_header)
 {
    stbi__zbuf a;
-   char *p = (char *) stbi__malloc(initial_size);
+   char *p = (char *) stbi__scratch_malloc(d, initial_size);
    if (p == NULL) return NULL;
    a.zbuffer = (stbi_uc *) buffer;
    a.zbuffer_end = (stbi_uc *) buffer + len;
+   a.decoder = d;
    if (stbi__do_zlib(&a, p, initial_size, 1, parse_header)) {
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
    } else {
-      STBI_FREE(a.zout_start);
+      stbi__scratch_free(d, a.zout_start);
       return NULL;
    }
 }
 
+STBIDEF char *stbi_zlib_decode_malloc_guesssize_headerflag(const char *buffer, int len, int initial_size, int *outlen, int parse_header)
+{
+   return stbi__zlib_decode_scratch(NULL, buffer, len, initial_size, outlen, parse_header);
+}
+
 STBIDEF int stbi_zlib_decode_buffer(char *obuffer, int olen, char const *ibuffer, int ilen)
 {
    stbi__zbuf a;
    a.zbuffer = (stbi_uc *) ibuffer;
    a.zbuffer_end = (stbi_uc *) ibuffer + ilen;
+   a.decoder = NULL;
    if (stbi__do_zlib(&a, obuffer, olen, 0, 1))
       return (int) (a.zout - a.zout_start);
    else
@@ -4181,6 +6395,7 @@ STBIDEF char *stbi_zlib_decode_noheader_malloc(char const *buffer, int len, int
    if (p == NULL) return NULL;
    a.zbuffer = (stbi_uc *) buffer;
    a.zbuffer_end = (stbi_uc *) buffer+len;
+   a.decoder = NULL;
    if (stbi__do_zlib(&a, p, 16384, 1, 0)) {
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
@@ -4195,6 +6410,7 @@ STBIDEF int stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const char
    stbi__zbuf a;
    a.zbuffer = (stbi_uc *) ibuffer;
    a.zbuffer_end = (stbi_uc *) ibuffer + ilen;
+   a.decoder = NULL;
    if (stbi__do_zlib(&a, obuffer, olen, 0, 0))
       return (int) (a.zout - a.zout_start);
    else
@@ -4241,6 +6457,8 @@ typedef struct
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   stbi_uc *dest; // caller's buffer to decode into, if any (row 0)
+   int dest_pitch;
 } stbi__png;
 
 
@@ -4277,14 +6495,186 @@ static int stbi__paeth(int a, int b, int c)
 
 static stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#ifdef STBI_SSE2
+// SIMD unfiltering for 8-bit rgb/rgba and 16-bit rgb/rgba (and 16-bit
+// grey+alpha) rows, i.e. 3, 4, 6 or 8 bytes per pixel. PNG filters work on
+// bytes, so a 16-bit pixel is just a wider one here. Sub/Avg/Paeth depend on
+// the previous pixel, so these go one pixel per step with all its bytes in
+// one register; Up has no such dependency and runs at full vector width.
+
+// loads bpp bytes into the low bytes of a register. away from the end of
+// the row we read 8 bytes and ignore the extras, so no copy is needed.
+stbi_inline static __m128i stbi__png_load_px(const stbi_uc *p, int left, int bpp)
+{
+   stbi_uc tmp[8] = { 0 };
+   if (left >= 8) return _mm_loadl_epi64((const __m128i *) p);
+   memcpy(tmp, p, bpp);
+   return _mm_loadl_epi64((const __m128i *) tmp);
+}
+
+// likewise, storing 8 bytes away from the end of the row is fine: the
+// extra bytes belong to the next pixel, which is written after this one.
+stbi_inline static void stbi__png_store_px(stbi_uc *p, __m128i v, int left, int bpp)
+{
+   stbi_uc tmp[8];
+   if (left >= 8) {
+      _mm_storel_epi64((__m128i *) p, v);
+   } else {
+      _mm_storel_epi64((__m128i *) tmp, v);
+      memcpy(p, tmp, bpp);
+   }
+}
+
+static void stbi__png_sub_simd(stbi_uc *cur, const stbi_uc *raw, int n, int bpp)
+{
+   __m128i a = _mm_setzero_si128();
+   int i;
+   for (i=0; i < n; i += bpp) {
+      a = _mm_add_epi8(stbi__png_load_px(raw+i, n-i, bpp), a);
+      stbi__png_store_px(cur+i, a, n-i, bpp);
+   }
+}
+
+static void stbi__png_up_simd(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int n)
+{
+   int i = 0;
+   for (; i+16 <= n; i += 16) {
+      __m128i r = _mm_loadu_si128((const __m128i *) (raw+i));
+      __m128i b = _mm_loadu_si128((const __m128i *) (prior+i));
+      _mm_storeu_si128((__m128i *) (cur+i), _mm_add_epi8(r, b));
+   }
+   for (; i < n; ++i)
+      cur[i] = STBI__BYTECAST(raw[i] + prior[i]);
+}
+
+static void stbi__png_avg_simd(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int n, int bpp)
+{
+   __m128i one = _mm_set1_epi8(1);
+   __m128i a = _mm_setzero_si128();
+   int i;
+   for (i=0; i < n; i += bpp) {
+      __m128i b = stbi__png_load_px(prior+i, n-i, bpp);
+      // pavgb rounds up; (a+b)>>1 rounds down, so subtract the carry bit
+      __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+      a = _mm_add_epi8(stbi__png_load_px(raw+i, n-i, bpp), avg);
+      stbi__png_store_px(cur+i, a, n-i, bpp);
+   }
+}
+
+static void stbi__png_paeth_simd(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int n, int bpp)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i a = zero, c = zero; // left and upper-left, widened to 16 bits
+   int i;
+   for (i=0; i < n; i += bpp) {
+      __m128i b = _mm_unpacklo_epi8(stbi__png_load_px(prior+i, n-i, bpp), zero);
+      __m128i x = stbi__png_load_px(raw+i, n-i, bpp);
+      // same distances as stbi__paeth: p-a = b-c, p-b = a-c, p-c = a+b-2c
+      __m128i pa = _mm_sub_epi16(b, c);
+      __m128i pb = _mm_sub_epi16(a, c);
+      __m128i pc = _mm_add_epi16(pa, pb);
+      __m128i smallest, mask_a, mask_b, pred;
+      pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+      pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+      pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+      // a if pa is smallest, else b if pb is, else c; ties resolve in that order
+      smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+      mask_a = _mm_cmpeq_epi16(pa, smallest);
+      mask_b = _mm_andnot_si128(mask_a, _mm_cmpeq_epi16(pb, smallest));
+      pred = _mm_andnot_si128(_mm_or_si128(mask_a, mask_b), c);
+      pred = _mm_or_si128(pred, _mm_and_si128(mask_a, a));
+      pred = _mm_or_si128(pred, _mm_and_si128(mask_b, b));
+      x = _mm_add_epi8(x, _mm_packus_epi16(pred, pred));
+      stbi__png_store_px(cur+i, x, n-i, bpp);
+      a = _mm_unpacklo_epi8(x, zero);
+      c = b;
+   }
+}
+
+#ifdef STBI_AVX2
+STBI__AVX2_TARGET
+static void stbi__png_up_avx2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int n)
+{
+   int i = 0;
+   for (; i+32 <= n; i += 32) {
+      __m256i r = _mm256_loadu_si256((const __m256i *) (raw+i));
+      __m256i b = _mm256_loadu_si256((const __m256i *) (prior+i));
+      _mm256_storeu_si256((__m256i *) (cur+i), _mm256_add_epi8(r, b));
+   }
+   _mm256_zeroupper();
+   stbi__png_up_simd(cur+i, raw+i, prior+i, n-i);
+}
+#endif
+
+// unfilters all rows of an 8/16-bit image with 3, 4, 6 or 8 bytes per pixel.
+// a row of zeros stands in for the row above the first one, which turns
+// each filter into its first-row variant. when an alpha channel is being
+// added, rows are unfiltered into a pair of scratch lines and expanded
+// into the output from there.
+static int stbi__png_unfilter_simd(stbi__png *a, stbi_uc *raw, stbi__uint32 x, stbi__uint32 y, int stride, int bpp, int output_bytes)
+{
+   int n = x * bpp;
+   int expand = output_bytes != bpp;
+   stbi__uint32 i, j;
+   stbi_uc *line, *prior;
+   void (*up)(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int n) = stbi__png_up_simd;
+
+#ifdef STBI_AVX2
+   if (stbi__avx2_available())
+      up = stbi__png_up_avx2;
+#endif
+
+   line = (stbi_uc *) stbi__malloc_mad2(n, expand ? 3 : 1, 0);
+   if (!line) return stbi__err("outofmem", "Out of memory");
+   memset(line, 0, n);
+   prior = line;
+
+   for (j=0; j < y; ++j) {
+      stbi_uc *cur = expand ? line + n * (1 + (j & 1)) : a->out + (ptrdiff_t) stride * (int) j;
+      int filter = *raw++;
+      switch (filter) {
+         case STBI__F_none:  memcpy(cur, raw, n); break;
+         case STBI__F_sub:   stbi__png_sub_simd(cur, raw, n, bpp); break;
+         case STBI__F_up:    up(cur, raw, prior, n); break;
+         case STBI__F_avg:   stbi__png_avg_simd(cur, raw, prior, n, bpp); break;
+         case STBI__F_paeth: stbi__png_paeth_simd(cur, raw, prior, n, bpp); break;
+         default:
+            STBI_FREE(line);
+            return stbi__err("invalid filter","Corrupt PNG");
+      }
+      if (expand) {
+         // alpha is the last output_bytes-bpp bytes of each pixel; 255 (or
+         // 0xffff for 16-bit) is the same in either byte order
+         stbi_uc *out = a->out + (ptrdiff_t) stride * (int) j, *in = cur;
+         if (bpp == 3) {
+            for (i=0; i < x; ++i, in += 3, out += 4) {
+               out[0] = in[0]; out[1] = in[1]; out[2] = in[2]; out[3] = 255;
+            }
+         } else {
+            STBI_ASSERT(bpp == 6);
+            for (i=0; i < x; ++i, in += 6, out += 8) {
+               out[0] = in[0]; out[1] = in[1]; out[2] = in[2];
+               out[3] = in[3]; out[4] = in[4]; out[5] = in[5];
+               out[6] = 255;   out[7] = 255;
+            }
+         }
+      }
+      raw += n;
+      prior = cur;
+   }
+   STBI_FREE(line);
+   return 1;
+}
+#endif // STBI_SSE2
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
    int bytes = (depth == 16? 2 : 1);
    stbi__context *s = a->s;
-   stbi__uint32 i,j,stride = x*out_n*bytes;
+   stbi__uint32 i,j;
    stbi__uint32 img_len, img_width_bytes;
-   int k;
+   int k, stride;
    int img_n = s->img_n; // copy it into a local for later
 
    int output_bytes = out_n*bytes;
@@ -4292,8 +6682,16 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    int width = x;
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
-   a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
-   if (!a->out) return stbi__err("outofmem", "Out of memory");
+   if (a->dest) {
+      // final pixels go straight into the caller's buffer; rows may be
+      // padded or run bottom-up, so only ever step by 'stride'
+      a->out = a->dest;
+      stride = a->dest_pitch;
+   } else {
+      a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
+      if (!a->out) return stbi__err("outofmem", "Out of memory");
+      stride = x*output_bytes;
+   }
 
    img_width_bytes = (((img_n * x * depth) + 7) >> 3);
    img_len = (img_width_bytes + 1) * y;
@@ -4302,8 +6700,13 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    // so just check for raw_len < img_len always.
    if (raw_len < img_len) return stbi__err("not enough pixels","Corrupt PNG");
 
+#ifdef STBI_SSE2
+   if (depth >= 8 && (filter_bytes == 3 || filter_bytes == 4 || filter_bytes == 6 || filter_bytes == 8) && stbi__sse2_available()) {
+      if (!stbi__png_unfilter_simd(a, raw, x, y, stride, filter_bytes, output_bytes)) return 0;
+   } else
+#endif
    for (j=0; j < y; ++j) {
-      stbi_uc *cur = a->out + stride*j;
+      stbi_uc *cur = a->out + (ptrdiff_t) stride * (int) j;
       stbi_uc *prior;
       int filter = *raw++;
 
@@ -4392,7 +6795,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          // the loop above sets the high byte of the pixels' alpha, but for
          // 16 bit png files we also need the low byte set. we'll do that here.
          if (depth == 16) {
-            cur = a->out + stride*j; // start at the beginning of the row again
+            cur = a->out + (ptrdiff_t) stride * (int) j; // start at the beginning of the row again
             for (i=0; i < x; ++i,cur+=output_bytes) {
                cur[filter_bytes+1] = 255;
             }
@@ -4405,8 +6808,8 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    // intefere with filtering but will still be in the cache.
    if (depth < 8) {
       for (j=0; j < y; ++j) {
-         stbi_uc *cur = a->out + stride*j;
-         stbi_uc *in  = a->out + stride*j + x*out_n - img_width_bytes;
+         stbi_uc *cur = a->out + (ptrdiff_t) stride * (int) j;
+         stbi_uc *in  = cur + x*out_n - img_width_bytes;
          // unpack 1/2/4-bit into a 8-bit buffer. allows us to keep the common 8-bit path optimal at minimal cost for 1/2/4-bit
          // png guarante byte alignment, if width is not multiple of 8/4/2 we'll decode dummy trailing data that will be skipped in the later loop
          stbi_uc scale = (color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
@@ -4488,6 +6891,29 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    return 1;
 }
 
+// Adam7 pass origins and spacing
+static const int stbi__png_xorig[7] = { 0,4,0,2,0,1,0 };
+static const int stbi__png_yorig[7] = { 0,0,4,0,2,0,1 };
+static const int stbi__png_xspc[7]  = { 8,8,4,4,2,2,1 };
+static const int stbi__png_yspc[7]  = { 8,8,8,4,4,2,2 };
+
+// exact size of the filtered scanline data for an image, so that inflate
+// can decode into a single allocation without growing it
+static stbi__uint32 stbi__png_raw_size(stbi__context *s, int depth, int interlaced)
+{
+   stbi__uint32 total = 0;
+   int p;
+   if (!interlaced)
+      return ((s->img_x * s->img_n * depth + 7) >> 3) * s->img_y + s->img_y;
+   for (p=0; p < 7; ++p) {
+      stbi__uint32 x = (s->img_x - stbi__png_xorig[p] + stbi__png_xspc[p]-1) / stbi__png_xspc[p];
+      stbi__uint32 y = (s->img_y - stbi__png_yorig[p] + stbi__png_yspc[p]-1) / stbi__png_yspc[p];
+      if (x && y)
+         total += ((((s->img_n * x * depth) + 7) >> 3) + 1) * y;
+   }
+   return total;
+}
+
 static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced)
 {
    int bytes = (depth == 16 ? 2 : 1);
@@ -4500,10 +6926,8 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    // de-interlacing
    final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
    for (p=0; p < 7; ++p) {
-      int xorig[] = { 0,4,0,2,0,1,0 };
-      int yorig[] = { 0,0,4,0,2,0,1 };
-      int xspc[]  = { 8,8,4,4,2,2,1 };
-      int yspc[]  = { 8,8,8,4,4,2,2 };
+      const int *xorig = stbi__png_xorig, *yorig = stbi__png_yorig;
+      const int *xspc = stbi__png_xspc, *yspc = stbi__png_yspc;
       int i,j,x,y;
       // pass1_x[4] = 0, pass1_x[5] = 1, pass1_x[12] = 1
       x = (a->s->img_x - xorig[p] + xspc[p]-1) / xspc[p];
@@ -4619,9 +7043,6 @@ static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int
    return 1;
 }
 
-static int stbi__unpremultiply_on_load = 0;
-static int stbi__de_iphone_flag = 0;
-
 STBIDEF void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultiply)
 {
    stbi__unpremultiply_on_load = flag_true_if_should_unpremultiply;
@@ -4647,7 +7068,7 @@ static void stbi__de_iphone(stbi__png *z)
       }
    } else {
       STBI_ASSERT(s->img_out_n == 4);
-      if (stbi__unpremultiply_on_load) {
+      if (s->unpremultiply) {
          // convert bgr to rgb and unpremultiply
          for (i=0; i < pixel_count; ++i) {
             stbi_uc a = p[3];
@@ -4689,6 +7110,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
    z->expanded = NULL;
    z->idata = NULL;
    z->out = NULL;
+   z->dest = NULL;
 
    if (!stbi__check_png_header(s)) return 0;
 
@@ -4779,7 +7201,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                while (ioff + c.length > idata_limit)
                   idata_limit *= 2;
                STBI_NOTUSED(idata_limit_old);
-               p = (stbi_uc *) STBI_REALLOC_SIZED(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
+               p = (stbi_uc *) stbi__scratch_realloc(s->decoder, z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
                z->idata = p;
             }
             if (!stbi__getn(s, z->idata+ioff,c.length)) return stbi__err("outofdata","Corrupt PNG");
@@ -4788,20 +7210,24 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
          }
 
          case STBI__PNG_TYPE('I','E','N','D'): {
-            stbi__uint32 raw_len, bpl;
+            stbi__uint32 raw_len;
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
-            // initial guess for decoded data size to avoid unnecessary reallocs
-            bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
-            raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
-            z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
+            // exact decoded size (plus slack for the wide match copies) so
+            // inflate never has to realloc on well-formed files
+            raw_len = stbi__png_raw_size(s, z->depth, interlace) + 8;
+            z->expanded = (stbi_uc *) stbi__zlib_decode_scratch(s->decoder, (char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
             if (z->expanded == NULL) return 0; // zlib should set error
-            STBI_FREE(z->idata); z->idata = NULL;
+            stbi__scratch_free(s->decoder, z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
+            // decode into the caller's buffer if the unfiltered rows are
+            // already the final pixels, i.e. no pass below rewrites them
+            if (z->depth == 8 && !interlace && !pal_img_n && !has_trans && !is_iphone && (req_comp == 0 || req_comp == s->img_out_n))
+               z->dest = stbi__dest_rows(s, s->img_x, s->img_y, s->img_out_n, &z->dest_pitch);
             if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
             if (has_trans) {
                if (z->depth == 16) {
@@ -4810,7 +7236,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                   if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
                }
             }
-            if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
+            if (is_iphone && s->de_iphone && s->img_out_n > 2)
                stbi__de_iphone(z);
             if (pal_img_n) {
                // pal_img_n == 3 or 4
@@ -4823,7 +7249,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                // non-paletted image with tRNS -> source image has (constant) alpha
                ++s->img_n;
             }
-            STBI_FREE(z->expanded); z->expanded = NULL;
+            stbi__scratch_free(s->decoder, z->expanded); z->expanded = NULL;
             return 1;
          }
 
@@ -4832,8 +7258,8 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if ((c.type & (1 << 29)) == 0) {
                #ifndef STBI_NO_FAILURE_STRINGS
-               // not threadsafe
-               static char invalid_chunk[] = "XXXX PNG chunk not known";
+               // per thread, like stbi__g_failure_reason
+               static STBI_THREAD_LOCAL char invalid_chunk[] = "XXXX PNG chunk not known";
                invalid_chunk[0] = STBI__BYTECAST(c.type >> 24);
                invalid_chunk[1] = STBI__BYTECAST(c.type >> 16);
                invalid_chunk[2] = STBI__BYTECAST(c.type >>  8);
@@ -4872,9 +7298,10 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
       *y = p->s->img_y;
       if (n) *n = p->s->img_n;
    }
-   STBI_FREE(p->out);      p->out      = NULL;
-   STBI_FREE(p->expanded); p->expanded = NULL;
-   STBI_FREE(p->idata);    p->idata    = NULL;
+   if (p->out != p->dest) STBI_FREE(p->out);
+   p->out = NULL;
+   stbi__scratch_free(p->s->decoder, p->expanded); p->expanded = NULL;
+   stbi__scratch_free(p->s->decoder, p->idata);    p->idata    = NULL;
 
    return result;
 }
@@ -6038,7 +8465,8 @@ typedef struct
 typedef struct
 {
    int w,h;
-   stbi_uc *out, *old_out;             // output buffer (always 4 components)
+   stbi_uc *out;                       // the canvas (always 4 components)
+   stbi_uc *old_out;                   // saved canvas for "dispose to previous"
    int flags, bgindex, ratio, transparent, eflags, delay;
    stbi_uc  pal[256][4];
    stbi_uc lpal[256][4];
@@ -6050,6 +8478,8 @@ typedef struct
    int max_x, max_y;
    int cur_x, cur_y;
    int line_size;
+   int frame;                          // index of the next frame
+   int dirty_x0, dirty_y0, dirty_x1, dirty_y1; // pixels the last frame changed
 } stbi__gif;
 
 static int stbi__gif_test_raw(stbi__context *s)
@@ -6251,40 +8681,59 @@ static void stbi__fill_gif_background(stbi__gif *g, int x0, int y0, int x1, int
    }
 }
 
-// this function is designed to support animated gifs, although stb_image doesn't support it
+// grow the dirty rectangle to cover a box given in canvas byte offsets,
+// like start_x/start_y/max_x/max_y
+static void stbi__gif_add_dirty(stbi__gif *g, int x0, int y0, int x1, int y1)
+{
+   x0 /= 4; x1 /= 4;
+   y0 /= 4 * g->w; y1 /= 4 * g->w;
+   if (x1 <= x0 || y1 <= y0) return;
+   if (g->dirty_x1 <= g->dirty_x0) {
+      g->dirty_x0 = x0; g->dirty_y0 = y0;
+      g->dirty_x1 = x1; g->dirty_y1 = y1;
+   } else {
+      if (x0 < g->dirty_x0) g->dirty_x0 = x0;
+      if (y0 < g->dirty_y0) g->dirty_y0 = y0;
+      if (x1 > g->dirty_x1) g->dirty_x1 = x1;
+      if (y1 > g->dirty_y1) g->dirty_y1 = y1;
+   }
+}
+
+// decodes the next frame onto g->out, which persists from frame to frame
 static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, int req_comp)
 {
    int i;
-   stbi_uc *prev_out = 0;
-
-   if (g->out == 0 && !stbi__gif_header(s, g, comp,0))
-      return 0; // stbi__g_failure_reason set by stbi__gif_header
-
-   if (!stbi__mad3sizes_valid(g->w, g->h, 4, 0))
-      return stbi__errpuc("too large", "GIF too large");
 
-   prev_out = g->out;
-   g->out = (stbi_uc *) stbi__malloc_mad3(4, g->w, g->h, 0);
-   if (g->out == 0) return stbi__errpuc("outofmem", "Out of memory");
+   if (g->out == 0) {
+      if (!stbi__gif_header(s, g, comp,0))
+         return 0; // stbi__g_failure_reason set by stbi__gif_header
+      if (!stbi__mad3sizes_valid(g->w, g->h, 4, 0))
+         return stbi__errpuc("too large", "GIF too large");
+      g->out = (stbi_uc *) stbi__malloc_mad3(4, g->w, g->h, 0);
+      if (g->out == 0) return stbi__errpuc("outofmem", "Out of memory");
+   }
 
-   switch ((g->eflags & 0x1C) >> 2) {
-      case 0: // unspecified (also always used on 1st frame)
-         stbi__fill_gif_background(g, 0, 0, 4 * g->w, 4 * g->w * g->h);
-         break;
-      case 1: // do not dispose
-         if (prev_out) memcpy(g->out, prev_out, 4 * g->w * g->h);
-         g->old_out = prev_out;
-         break;
-      case 2: // dispose to background
-         if (prev_out) memcpy(g->out, prev_out, 4 * g->w * g->h);
-         stbi__fill_gif_background(g, g->start_x, g->start_y, g->max_x, g->max_y);
-         break;
-      case 3: // dispose to previous
-         if (g->old_out) {
-            for (i = g->start_y; i < g->max_y; i += 4 * g->w)
-               memcpy(&g->out[i + g->start_x], &g->old_out[i + g->start_x], g->max_x - g->start_x);
-         }
-         break;
+   g->dirty_x0 = g->dirty_y0 = g->dirty_x1 = g->dirty_y1 = 0;
+   if (g->frame == 0) {
+      stbi__fill_gif_background(g, 0, 0, 4 * g->w, 4 * g->w * g->h);
+      stbi__gif_add_dirty(g, 0, 0, 4 * g->w, 4 * g->w * g->h);
+   } else {
+      // eflags and the box still describe the previous frame here
+      switch ((g->eflags & 0x1C) >> 2) {
+         case 2: // dispose to background
+            stbi__fill_gif_background(g, g->start_x, g->start_y, g->max_x, g->max_y);
+            stbi__gif_add_dirty(g, g->start_x, g->start_y, g->max_x, g->max_y);
+            break;
+         case 3: // dispose to previous
+            if (g->old_out) {
+               for (i = g->start_y; i < g->max_y; i += 4 * g->w)
+                  memcpy(&g->out[i + g->start_x], &g->old_out[i + g->start_x], g->max_x - g->start_x);
+               stbi__gif_add_dirty(g, g->start_x, g->start_y, g->max_x, g->max_y);
+            }
+            break;
+         default: // unspecified or do not dispose: leave it
+            break;
+      }
    }
 
    for (;;) {
@@ -6320,8 +8769,21 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
                g->parse = 0;
             }
 
+            // this frame is undone by restoring what's under it, so keep that
+            if (((g->eflags & 0x1C) >> 2) == 3) {
+               if (!g->old_out) {
+                  g->old_out = (stbi_uc *) stbi__malloc_mad3(4, g->w, g->h, 0);
+                  if (!g->old_out) return stbi__errpuc("outofmem", "Out of memory");
+               }
+               for (i = g->start_y; i < g->max_y; i += 4 * g->w)
+                  memcpy(&g->old_out[i + g->start_x], &g->out[i + g->start_x], g->max_x - g->start_x);
+            }
+
             if (g->lflags & 0x80) {
                stbi__gif_parse_colortable(s,g->lpal, 2 << (g->lflags & 7), g->eflags & 0x01 ? g->transparent : -1);
+               // the transparent index may lie past a short local table
+               if (g->transparent >= 0 && (g->eflags & 0x01))
+                  g->lpal[g->transparent][3] = 0;
                g->color_table = (stbi_uc *) g->lpal;
             } else if (g->flags & 0x80) {
                if (g->transparent >= 0 && (g->eflags & 0x01)) {
@@ -6338,6 +8800,8 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
             if (prev_trans != -1)
                g->pal[g->transparent][3] = (stbi_uc) prev_trans;
 
+            stbi__gif_add_dirty(g, g->start_x, g->start_y, g->max_x, g->max_y);
+            ++g->frame;
             return o;
          }
 
@@ -6388,6 +8852,7 @@ static void *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int req
    }
    else if (g->out)
       STBI_FREE(g->out);
+   STBI_FREE(g->old_out);
    STBI_FREE(g);
    return u;
 }
@@ -6396,6 +8861,137 @@ static int stbi__gif_info(stbi__context *s, int *x, int *y, int *comp)
 {
    return stbi__gif_info_raw(s,x,y,comp);
 }
+
+struct stbi_gif_anim
+{
+   stbi__context s;
+   stbi__gif g;
+   stbi_uc *owned; // file contents, if the file couldn't be mapped
+#ifndef STBI_NO_STDIO
+   stbi__filemap map;
+#endif
+};
+
+// walk the blocks after the header without decoding anything. s must be a
+// memory context: it's copied, so the caller's read position doesn't move
+static int stbi__gif_count_frames(stbi__context *s)
+{
+   stbi__context c = *s;
+   int n = 0, len, flags;
+   for (;;) {
+      switch (stbi__get8(&c)) {
+         case 0x2C:
+            stbi__skip(&c, 8);
+            flags = stbi__get8(&c);
+            if (flags & 0x80) stbi__skip(&c, 3 * (2 << (flags & 7)));
+            stbi__get8(&c); // lzw code size
+            ++n;
+            break;
+         case 0x21:
+            stbi__get8(&c); // label
+            break;
+         default: // 0x3B (end) or garbage
+            return n;
+      }
+      while ((len = stbi__get8(&c)) != 0)
+         stbi__skip(&c, len);
+      if (stbi__at_eof(&c)) return n;
+   }
+}
+
+static stbi_gif_anim *stbi__gif_anim_start(stbi_gif_anim *a, int *x, int *y, int *frames)
+{
+   if (!stbi__gif_header(&a->s, &a->g, NULL, 0)) {
+      stbi_gif_anim_close(a);
+      return NULL;
+   }
+   if (!stbi__mad3sizes_valid(a->g.w, a->g.h, 4, 0)) {
+      stbi_gif_anim_close(a);
+      return (stbi_gif_anim *) stbi__errpuc("too large", "GIF too large");
+   }
+   a->g.out = (stbi_uc *) stbi__malloc_mad3(4, a->g.w, a->g.h, 0);
+   if (!a->g.out) {
+      stbi_gif_anim_close(a);
+      return (stbi_gif_anim *) stbi__errpuc("outofmem", "Out of memory");
+   }
+   if (x) *x = a->g.w;
+   if (y) *y = a->g.h;
+   if (frames) *frames = stbi__gif_count_frames(&a->s);
+   return a;
+}
+
+STBIDEF stbi_gif_anim *stbi_gif_anim_open_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *frames)
+{
+   stbi_gif_anim *a = (stbi_gif_anim *) stbi__malloc(sizeof(*a));
+   if (!a) return (stbi_gif_anim *) stbi__errpuc("outofmem", "Out of memory");
+   memset(a, 0, sizeof(*a));
+   stbi__start_mem(&a->s, buffer, len);
+   return stbi__gif_anim_start(a, x, y, frames);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_gif_anim *stbi_gif_anim_open(char const *filename, int *x, int *y, int *frames)
+{
+   stbi_gif_anim *a = (stbi_gif_anim *) stbi__malloc(sizeof(*a));
+   if (!a) return (stbi_gif_anim *) stbi__errpuc("outofmem", "Out of memory");
+   memset(a, 0, sizeof(*a));
+   if (stbi__map_file(&a->map, filename)) {
+      stbi__start_mem(&a->s, a->map.data, a->map.size);
+   } else {
+      // the whole file has to be in memory to count frames and rewind
+      FILE *f = stbi__fopen(filename, "rb");
+      long size;
+      if (!f) { STBI_FREE(a); return (stbi_gif_anim *) stbi__errpuc("can't fopen", "Unable to open file"); }
+      fseek(f, 0, SEEK_END);
+      size = ftell(f);
+      fseek(f, 0, SEEK_SET);
+      if (size > 0 && size < INT_MAX) a->owned = (stbi_uc *) stbi__malloc((size_t) size);
+      if (!a->owned || fread(a->owned, 1, (size_t) size, f) != (size_t) size) {
+         fclose(f);
+         STBI_FREE(a->owned);
+         STBI_FREE(a);
+         return (stbi_gif_anim *) stbi__errpuc("can't read", "Unable to read file");
+      }
+      fclose(f);
+      stbi__start_mem(&a->s, a->owned, (int) size);
+   }
+   return stbi__gif_anim_start(a, x, y, frames);
+}
+#endif
+
+STBIDEF int stbi_gif_anim_next(stbi_gif_anim *a, stbi_gif_frame *frame)
+{
+   stbi_uc *u = stbi__gif_load_next(&a->s, &a->g, NULL, 4);
+   if (u == NULL || u == (stbi_uc *) &a->s) return 0;
+   frame->pixels = a->g.out;
+   frame->delay_ms = a->g.delay * 10; // stored in 1/100ths of a second
+   frame->x = a->g.dirty_x0;
+   frame->y = a->g.dirty_y0;
+   frame->w = a->g.dirty_x1 - a->g.dirty_x0;
+   frame->h = a->g.dirty_y1 - a->g.dirty_y0;
+   return 1;
+}
+
+STBIDEF void stbi_gif_anim_rewind(stbi_gif_anim *a)
+{
+   stbi__rewind(&a->s); // a memory context, so this is the start of the file
+   stbi__gif_header(&a->s, &a->g, NULL, 0);
+   a->g.frame = 0;
+   a->g.eflags = 0;
+   a->g.delay = 0;
+}
+
+STBIDEF void stbi_gif_anim_close(stbi_gif_anim *a)
+{
+   if (!a) return;
+   STBI_FREE(a->g.out);
+   STBI_FREE(a->g.old_out);
+#ifndef STBI_NO_STDIO
+   stbi__close_filemap(&a->map);
+#endif
+   STBI_FREE(a->owned);
+   STBI_FREE(a);
+}
 #endif
 
 // *************************************************************************************************
@@ -6473,19 +9069,163 @@ static void stbi__hdr_convert(float *output, stbi_uc *input, int req_comp)
    }
 }
 
+#ifndef STBI_NO_LINEAR
+#ifdef STBI_SSE2
+// stbi__float_to_half for 4 floats. each result is in the low 16 bits of
+// a lane, sign-extended, so _mm_packs_epi32 keeps it intact
+static __m128i stbi__float_to_half_sse2(__m128 f)
+{
+   __m128i sign = _mm_and_si128(_mm_castps_si128(f), _mm_set1_epi32((int) 0x80000000u));
+   __m128i u = _mm_xor_si128(_mm_castps_si128(f), sign);
+   __m128i magic = _mm_set1_epi32(((127-15) + (23-10) + 1) << 23);
+   __m128i is_nan = _mm_cmpgt_epi32(u, _mm_set1_epi32(255 << 23));
+   __m128i is_regular = _mm_cmpgt_epi32(_mm_set1_epi32((127+16) << 23), u);
+   __m128i is_sub = _mm_cmpgt_epi32(_mm_set1_epi32((127-14) << 23), u);
+   __m128i special = _mm_or_si128(_mm_and_si128(is_nan, _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+   __m128i sub = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(u), _mm_castsi128_ps(magic))), magic);
+   __m128i odd = _mm_and_si128(_mm_srli_epi32(u, 13), _mm_set1_epi32(1));
+   __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(u, _mm_set1_epi32((int) ((stbi__uint32) (15-127) << 23) + 0xfff)), odd), 13);
+   __m128i h = _mm_or_si128(_mm_and_si128(is_sub, sub), _mm_andnot_si128(is_sub, normal));
+   h = _mm_or_si128(_mm_and_si128(is_regular, h), _mm_andnot_si128(is_regular, special));
+   return _mm_or_si128(h, _mm_srai_epi32(sign, 16));
+}
+
+// one RGBE pixel per vector; the float for each channel is m * 2^(e-136),
+// built from e directly. e < 10 would need a denormal, but those values are
+// far below the smallest half, so they're just 0. returns pixels done
+static int stbi__hdr_convert_half_simd(stbi__uint16 *output, stbi_uc const *input, int n, int req_comp)
+{
+   __m128i zero = _mm_setzero_si128(), nine = _mm_set1_epi32(9);
+   __m128 amask = _mm_castsi128_ps(_mm_setr_epi32(0,0,0,-1)), one = _mm_set1_ps(1.0f);
+   // a 3-channel pixel is stored with 8 bytes, running 2 into the next one
+   int i, last = req_comp == 4 ? n : n-1, packed;
+   for (i=0; i < last; ++i) {
+      __m128i p, e, h;
+      __m128 scale, v;
+      memcpy(&packed, input + i*4, 4);
+      p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+      e = _mm_shuffle_epi32(p, _MM_SHUFFLE(3,3,3,3));
+      scale = _mm_castsi128_ps(_mm_and_si128(_mm_slli_epi32(_mm_sub_epi32(e, nine), 23), _mm_cmpgt_epi32(e, nine)));
+      v = _mm_mul_ps(_mm_cvtepi32_ps(p), scale);
+      v = _mm_or_ps(_mm_and_ps(amask, one), _mm_andnot_ps(amask, v));
+      h = stbi__float_to_half_sse2(v);
+      _mm_storel_epi64((__m128i *) (output + i*req_comp), _mm_packs_epi32(h, h));
+   }
+   return i;
+}
+#endif
+
+#ifdef STBI_AVX2
+// two pixels per vector, with the conversion done by F16C (every CPU with
+// AVX2 has it)
+STBI__F16C_TARGET
+static int stbi__hdr_convert_half_f16c(stbi__uint16 *output, stbi_uc const *input, int n, int req_comp)
+{
+   __m256i nine = _mm256_set1_epi32(9);
+   __m256 amask = _mm256_castsi256_ps(_mm256_setr_epi32(0,0,0,-1,0,0,0,-1)), one = _mm256_set1_ps(1.0f);
+   int i, last = req_comp == 4 ? n : n-1;
+   for (i=0; i+2 <= last; i += 2) {
+      __m256i p = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const *) (input + i*4)));
+      __m256i e = _mm256_shuffle_epi32(p, _MM_SHUFFLE(3,3,3,3));
+      __m256 scale = _mm256_castsi256_ps(_mm256_and_si256(_mm256_slli_epi32(_mm256_sub_epi32(e, nine), 23), _mm256_cmpgt_epi32(e, nine)));
+      __m256 v = _mm256_blendv_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(p), scale), one, amask);
+      __m128i h = _mm256_cvtps_ph(v, 0); // round to nearest even
+      if (req_comp == 4)
+         _mm_storeu_si128((__m128i *) (output + i*4), h);
+      else {
+         _mm_storel_epi64((__m128i *) (output + i*3), h);
+         _mm_storel_epi64((__m128i *) (output + i*3 + 3), _mm_unpackhi_epi64(h, h));
+      }
+   }
+   return i;
+}
+#endif
+
+// what stbi__hdr_load_main's 'half' becomes, so the cpu is asked once per
+// image rather than per row (or per pixel, for flat data)
+enum
+{
+   STBI__HDR_HALF = 1,
+   STBI__HDR_HALF_SSE2,
+   STBI__HDR_HALF_F16C
+};
+
+static int stbi__hdr_half_mode(int req_comp)
+{
+#ifdef STBI_SSE2
+   if (req_comp >= 3 && stbi__sse2_available()) {
+#ifdef STBI_AVX2
+      if (stbi__avx2_available() && stbi__f16c_available())
+         return STBI__HDR_HALF_F16C;
+#endif
+      return STBI__HDR_HALF_SSE2;
+   }
+#else
+   STBI_NOTUSED(req_comp);
+#endif
+   return STBI__HDR_HALF;
+}
+
+// RGBE to half floats. every channel is exact as a float, so rounding that
+// to half once gives the same bits as stbi_loadf followed by a conversion
+static void stbi__hdr_convert_half(stbi__uint16 *output, stbi_uc *input, int n, int req_comp, int mode)
+{
+   int i = 0, k;
+   float f[4];
+#ifdef STBI_SSE2
+#ifdef STBI_AVX2
+   if (mode == STBI__HDR_HALF_F16C)
+      i = stbi__hdr_convert_half_f16c(output, input, n, req_comp);
+#endif
+   if (mode == STBI__HDR_HALF_SSE2)
+      i = stbi__hdr_convert_half_simd(output, input, n, req_comp);
+#else
+   STBI_NOTUSED(mode);
+#endif
+   for (; i < n; ++i) {
+      stbi__hdr_convert(f, input + i*4, req_comp);
+      for (k=0; k < req_comp; ++k)
+         output[i*req_comp + k] = stbi__float_to_half(f[k]);
+   }
+}
+#endif
+
+// converts 'n' RGBE pixels to req_comp floats each, or halves if 'half'
+// (one of the STBI__HDR_HALF modes)
+static void stbi__hdr_convert_row(stbi_uc *output, stbi_uc *input, int n, int req_comp, int half)
+{
+   int i;
+#ifndef STBI_NO_LINEAR
+   if (half) {
+      stbi__hdr_convert_half((stbi__uint16 *) output, input, n, req_comp, half);
+      return;
+   }
+#else
+   STBI_NOTUSED(half);
+#endif
+   for (i=0; i < n; ++i)
+      stbi__hdr_convert((float *) output + i*req_comp, input + i*4, req_comp);
+}
+
 static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
+{
+   STBI_NOTUSED(ri);
+   return (float *) stbi__hdr_load_main(s, x, y, comp, req_comp, 0);
+}
+
+// loads as floats, or as half floats if 'half'
+static void *stbi__hdr_load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, int half)
 {
    char buffer[STBI__HDR_BUFLEN];
    char *token;
    int valid = 0;
    int width, height;
    stbi_uc *scanline;
-   float *hdr_data;
-   int len;
+   stbi_uc *hdr_data;
+   int len, pixel_bytes;
    unsigned char count, value;
    int i, j, k, c1,c2, z;
    const char *headerToken;
-   STBI_NOTUSED(ri);
 
    // Check identifier
    headerToken = stbi__hdr_gettoken(s,buffer);
@@ -6522,7 +9262,11 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
       return stbi__errpf("too large", "HDR image is too large");
 
    // Read data
-   hdr_data = (float *) stbi__malloc_mad4(width, height, req_comp, sizeof(float), 0);
+#ifndef STBI_NO_LINEAR
+   if (half) half = stbi__hdr_half_mode(req_comp);
+#endif
+   pixel_bytes = req_comp * (half ? 2 : 4);
+   hdr_data = (stbi_uc *) stbi__malloc_mad3(width, height, pixel_bytes, 0);
    if (!hdr_data)
       return stbi__errpf("outofmem", "Out of memory");
 
@@ -6535,7 +9279,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
             stbi_uc rgbe[4];
            main_decode_loop:
             stbi__getn(s, rgbe, 4);
-            stbi__hdr_convert(hdr_data + j * width * req_comp + i * req_comp, rgbe, req_comp);
+            stbi__hdr_convert_row(hdr_data + (j * width + i) * pixel_bytes, rgbe, 1, req_comp, half);
          }
       }
    } else {
@@ -6554,7 +9298,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
             rgbe[1] = (stbi_uc) c2;
             rgbe[2] = (stbi_uc) len;
             rgbe[3] = (stbi_uc) stbi__get8(s);
-            stbi__hdr_convert(hdr_data, rgbe, req_comp);
+            stbi__hdr_convert_row(hdr_data, rgbe, 1, req_comp, half);
             i = 1;
             j = 0;
             STBI_FREE(scanline);
@@ -6591,8 +9335,7 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
                }
             }
          }
-         for (i=0; i < width; ++i)
-            stbi__hdr_convert(hdr_data+(j*width + i)*req_comp, scanline + i*4, req_comp);
+         stbi__hdr_convert_row(hdr_data + j*width*pixel_bytes, scanline, width, req_comp, half);
       }
       if (scanline)
          STBI_FREE(scanline);
@@ -6949,6 +9692,54 @@ STBIDEF int stbi_info_from_file(FILE *f, int *x, int *y, int *comp)
    fseek(f,pos,SEEK_SET);
    return r;
 }
+
+static void stbi__info_one(char const *filename, stbi_info_result *r)
+{
+   r->ok = stbi_info(filename, &r->x, &r->y, &r->comp);
+   if (!r->ok)
+      r->x = r->y = r->comp = 0;
+}
+
+#ifdef STBI_THREADS
+typedef struct
+{
+   char const * const *filenames;
+   stbi_info_result *results;
+   int count, nthreads;
+} stbi__info_job;
+
+static void stbi__info_worker(void *arg, int index)
+{
+   stbi__info_job *job = (stbi__info_job *) arg;
+   int i;
+   // interleaved, so a directory of big files next to small ones still
+   // splits evenly
+   for (i=index; i < job->count; i += job->nthreads)
+      stbi__info_one(job->filenames[i], &job->results[i]);
+}
+#endif
+
+STBIDEF int stbi_info_many(char const * const *filenames, int count, stbi_info_result *results)
+{
+   int i, n = 0;
+   if (count <= 0) return 0;
+#ifdef STBI_THREADS
+   {
+      stbi__info_job job;
+      job.filenames = filenames;
+      job.results = results;
+      job.count = count;
+      job.nthreads = stbi__thread_count(stbi__jpeg_threads, count);
+      stbi__parallel_run(stbi__info_worker, &job, job.nthreads);
+   }
+#else
+   for (i=0; i < count; ++i)
+      stbi__info_one(filenames[i], &results[i]);
+#endif
+   for (i=0; i < count; ++i)
+      n += results[i].ok;
+   return n;
+}
 #endif // !STBI_NO_STDIO
 
 STBIDEF int stbi_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)